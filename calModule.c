@@ -7,10 +7,10 @@
 * E-mail: norkic@mail.uoguelph.ca
 *
 ********/
-#include <string.h>
-#include <stdio.h>
 #include "calutil.h"
 #include "caltool.h"
+#include <string.h>
+#include <stdio.h>
 #include <Python.h>
 
 
@@ -40,9 +40,21 @@ static PyObject *Cal_readFile(PyObject *self, PyObject *args);
 ********************************************************************************************/
 static PyObject *Cal_freeFile(PyObject *self, PyObject *args);
 
+/*Cal_memUsage
+*
+* Purpose: A wrapper function for Calutil's getCalArenaUsage function. Reports the memory held by
+*          an open CalComp structure's arena
+*
+* Arguments: - The address of a open CalComp structure (python int)
+*
+* Retuns:    - A tuple (bytes used, bytes wasted); (0,0) if the CalComp was not arena allocated
+*
+********************************************************************************************/
+static PyObject *Cal_memUsage(PyObject *self, PyObject *args);
+
 /*Cal_writeFile
 *
-* Purpose: A wrapper function for Calutil's writeCalComp function. Writes specified open CalComp Structure's subcompenents
+* Purpose: A wrapper function for Calutil's writeCalCompThreads function. Writes specified open CalComp Structure's subcompenents
 *          to a given file
 *
 * Arguments:   - The name of a file to write to (python string)
@@ -57,6 +69,159 @@ static PyObject *Cal_freeFile(PyObject *self, PyObject *args);
 ********************************************************************************************/
 static PyObject *Cal_writeFile(PyObject *self, PyObject *args);
 
+/*Cal_writeBuffer
+*
+* Purpose: A wrapper function for Calutil's writeCalCompToBuffer function. Writes specified open CalComp
+*          Structure's subcompenents to memory, exactly as writeFile would write them to a file
+*
+* Arguments:   - The address of a open CalComp structure (python int)
+*              - A list specifying which subcomponents to write, as for writeFile (python list)
+*
+* Returns:     - The text of the calendar (python bytes) on success
+*              - A description of an error with the number of lines written (python string) on fail
+*
+********************************************************************************************/
+static PyObject *Cal_writeBuffer(PyObject *self, PyObject *args);
+
+/*Cal_calInfo
+*
+* Purpose: A wrapper function for Caltool's calInfo function. Describes specified open CalComp Structure's
+*          subcomponents as 'caltool -info' would describe them saved to a file, without saving them
+*
+* Arguments: - The address of a open CalComp structure (python int)
+*            - A list specifying which subcomponents to describe, as for writeFile (python list)
+*
+* Returns:   - A tuple (info, errors) of python strings: the description and "", or "" and a
+*              description of an error
+*
+********************************************************************************************/
+static PyObject *Cal_calInfo(PyObject *self, PyObject *args);
+
+/*Cal_calExtract
+*
+* Purpose: A wrapper function for Caltool's calExtract function. Lists the events or X-properties of
+*          specified open CalComp Structure's subcomponents, as 'caltool -extract' would
+*
+* Arguments: - The address of a open CalComp structure (python int)
+*            - A list specifying which subcomponents to look through, as for writeFile (python list)
+*            - "e" for events or "x" for X-properties (python string)
+*
+* Returns:   - A tuple (text, errors) of python strings, as for calInfo
+*
+********************************************************************************************/
+static PyObject *Cal_calExtract(PyObject *self, PyObject *args);
+
+/*Cal_calFilter
+*
+* Purpose: A wrapper function for Caltool's calFilter function. Makes a new calendar in memory of the
+*          events or to-dos of specified open CalComp Structure's subcomponents in a range of dates,
+*          as 'caltool -filter' would
+*
+* Arguments: - The address of a open CalComp structure (python int)
+*            - A list specifying which subcomponents to filter, as for writeFile (python list)
+*            - "e" for events or "t" for to-dos (python string)
+*            - The date from and the date to, as caltool takes them; "" for none (python string)
+*            - The address of a python list (list), populated as readFile populates it for the
+*              new calendar (to be freed by freeFile)
+*
+* Returns:   - "OK" (as a python string) on success
+*            - A string describing the error on fail (e.g. nothing found)
+*
+********************************************************************************************/
+static PyObject *Cal_calFilter(PyObject *self, PyObject *args);
+
+/*Cal_calCombine
+*
+* Purpose: A wrapper function for Caltool's calCombine function. Makes a new calendar in memory of the
+*          components of an ics file and specified open CalComp Structure's subcomponents, as
+*          'caltool -combine' would
+*
+* Arguments: - The address of a open CalComp structure (python int)
+*            - A list specifying which subcomponents to combine, as for writeFile (python list)
+*            - The name of the ics file to combine with (python string)
+*            - The address of a python list (list), populated as for calFilter
+*
+* Returns:   - "OK" (as a python string) on success
+*            - A string describing the error on fail
+*
+********************************************************************************************/
+static PyObject *Cal_calCombine(PyObject *self, PyObject *args);
+
+/*Cal_indexFile
+*
+* Purpose: A wrapper function for Caltool's InitializeCalIndex function. Indexes the dates of an
+*          open CalComp structure's events and to-dos, so they can be filtered by queryIndex
+*
+* Arguments: - The address of a open CalComp structure (python int)
+*
+* Retuns:    - The address of the index (python int), to be freed by freeIndex
+*            - 0 on fail
+*
+********************************************************************************************/
+static PyObject *Cal_indexFile(PyObject *self, PyObject *args);
+
+/*Cal_queryIndex
+*
+* Purpose: A wrapper function for Caltool's queryCalIndex function. Finds the sub-components
+*          caltool's -filter would keep
+*
+* Arguments: - The address of an index (python int)
+*            - "e" for events or "t" for to-dos (python string)
+*            - The date from and date to, as seconds since the epoch; 0 for no date to, and
+*              both 0 for every dated component (python int)
+*
+* Retuns:    - A list of the numbers of the sub-components found, in ascending order
+*            - None on fail
+*
+********************************************************************************************/
+static PyObject *Cal_queryIndex(PyObject *self, PyObject *args);
+
+/*Cal_freeIndex
+*
+* Purpose: A wrapper function for Caltool's freeCalIndex function. Frees an index made by indexFile
+*
+* Arguments: - The address of an index (python int)
+*
+* Retuns:    - 1 on success
+*            - 0 on fail
+*
+********************************************************************************************/
+static PyObject *Cal_freeIndex(PyObject *self, PyObject *args);
+
+/*listCalComp
+*
+* Purpose: To store a CalComp, and information about each of it's sub-components, in a python list
+*          (see readFile)
+*
+* Arguments:   - The address of the CalComp (CalComp*)
+*              - The address of a python list (PyObject*)
+*
+********************************************************************************************/
+static void listCalComp(CalComp *pCal, PyObject *result);
+
+/*shallowFromList
+*
+* Purpose: To create a shallow copy of a component with the subcomponents a python list specifies
+*          (see createShallow)
+*
+* Arguments:   - The address of the initial component (CalComp*)
+*              - A list specifying which subcomponents to copy, as for writeFile (PyObject*)
+*
+* Returns:     - A shallow copy of the orignal CalComp (free it)
+*
+********************************************************************************************/
+static CalComp *shallowFromList(CalComp *pCal, PyObject *pyPosToWrite);
+
+/*describeCalError
+*
+* Purpose:  To obtain an error string describing a calError and the lines it occured on.
+*
+* Arguments:   - A CalStatus indicating the error (CalStatus)
+*              - The address of a string to store the error string (char*, 200 characters)
+*
+********************************************************************************************/
+static void describeCalError(CalStatus stat, char *errorStore);
+
 /*createShallow
 *
 * Purpose: To create a shallow copy of a component with specified subcomponents that are a subset
@@ -86,7 +251,16 @@ static PyMethodDef CalMethods[] = {
     // {"Python_func_name", c function, Argument style}
     {"readFile", Cal_readFile, METH_VARARGS, "Reads iCalendar 2.0 File"},
     {"writeFile", Cal_writeFile, METH_VARARGS, "Writes the current file"},
+    {"writeBuffer", Cal_writeBuffer, METH_VARARGS, "Returns the current file as it would be written, as bytes"},
     {"freeFile", Cal_freeFile, METH_VARARGS, "Frees memory from a CalComp populated to result of readFile"},
+    {"memUsage", Cal_memUsage, METH_VARARGS, "Returns (bytes used, bytes wasted) by a CalComp's arena"},
+    {"indexFile", Cal_indexFile, METH_VARARGS, "Indexes the dates of a CalComp's events and to-dos"},
+    {"queryIndex", Cal_queryIndex, METH_VARARGS, "Returns the sub-components of an index in a range of dates"},
+    {"freeIndex", Cal_freeIndex, METH_VARARGS, "Frees an index made by indexFile"},
+    {"calInfo", Cal_calInfo, METH_VARARGS, "Returns (info, errors) as 'caltool -info' gives for a CalComp"},
+    {"calExtract", Cal_calExtract, METH_VARARGS, "Returns (text, errors) as 'caltool -extract' gives for a CalComp"},
+    {"calFilter", Cal_calFilter, METH_VARARGS, "Filters a CalComp's events or to-dos into a new CalComp"},
+    {"calCombine", Cal_calCombine, METH_VARARGS, "Combines a CalComp and an ics file into a new CalComp"},
     {NULL, NULL, 0, NULL}, //denotes end of list
 };
 
@@ -113,39 +287,20 @@ static PyObject *Cal_readFile(PyObject *self, PyObject *args)
     FILE *fh;
 
     CalComp *pCal;     //Calcomp to populate
-    CalProp *tempProp; //temp Pointer to look through property lsit
-    CalEvent *cEvent; //To store Event information
-    CalTodo *cTodo; //to Store Todo information
+    CalParser *parser; //parser reading the file into an arena
     CalStatus stat;    //To store the status of readCalfile
 
     char *fileName;    //fileName argument from function call
     PyObject *result;   // python list that will be populated
 
-    //Objects used to construct final result/return value
-    PyObject *listOfPrimTuples, *listOfSecTuples,*tempTuple, *noFileObj;
+    //Object used to construct final result/return value
+    PyObject *noFileObj;
 
     //message for when file cannot open
     char *noFileMsg;
-    char calErrBuff[50];
-    char errMsgBuff[100];
-
-    // information to place in a pyObject tuple
-    char *name, *summary, *priority,*dtStart,*location, *orgName, *orgContact;
-    char dateStart[100];
-    int props,comps;
+    char errMsgBuff[200];
 
     pCal = NULL;
-    tempProp = NULL;
-
-    name = NULL;
-    summary = NULL;
-    dtStart = NULL;
-    location = NULL;
-    priority = NULL;
-    orgName = NULL;
-    orgContact = NULL;
-    cEvent = NULL;
-    cTodo = NULL;
 
     //parse function call args
     if (PyArg_ParseTuple(args, "sO", &fileName, &result))
@@ -164,120 +319,33 @@ static PyObject *Cal_readFile(PyObject *self, PyObject *args)
             return(noFileObj);
         }
 
-        stat = readCalFile(fh,&pCal);
+        //the tree lives until freeFile, so allocate it from one arena that keeps the mapped file for the values
+        //(see CAL_SLICES), and where each component is in it to save it unchanged (CAL_SOURCE);
+        //large files are parsed on every processor
+        parser = InitializeCalParserFd(fileno(fh));
+        if (parser != NULL)
+        {
+            setCalParserOptions(parser,CAL_ARENA | CAL_SLICES | CAL_SOURCE);
+            setCalParserThreads(parser,0);
+            stat = readCalFileEx(parser,&pCal);
+            freeCalParser(parser);
+        }
+        else
+        {
+            stat = InitializeCalStatus();
+            stat.code = IOERR;
+        }
         fclose(fh);
 
         if (stat.code == OK)
         {
 
-            listOfPrimTuples = Py_BuildValue("[]");
-            listOfSecTuples = Py_BuildValue("[]");
-            //loop Through top level components and creat tuples from
-            //their infomation
-            for (int i = 0; i < pCal->ncomps; i++)
-            {
-                name = NULL;
-                summary = NULL;
-                dtStart = NULL;
-                priority = NULL;
-                location = NULL;
-                orgName = NULL;
-                orgContact = NULL;
-                name  = pCal->comp[i]->name;
-                props = pCal->comp[i]->nprops;
-                comps = pCal->comp[i]->ncomps;
-                tempProp = pCal->comp[i]->prop;
-
-                if (strcmp(name,"VEVENT") == 0)
-                {
-                    cEvent = InitializeCalEvent();
-                    cEvent = extractEvent(pCal->comp[i]);
-                    strftime(dateStart,100,"%F %H:%M:%S",cEvent->dateStart);
-                    dtStart = dateStart;
-                    location = cEvent->location;
-                    summary = cEvent->summary;
-
-                    if (summary == NULL)
-                    {
-                        summary = "";
-                    }
-                    if (cEvent->org != NULL)
-                    {   
-                        orgName = cEvent->org->name;
-                        orgContact = cEvent->org->contact;
-                    }
-                }
-
-                else if (strcmp(name,"VTODO") == 0)
-                {
-                    cTodo = InitializeCalTodo();
-                    cTodo = extractTodo(pCal->comp[i]);
-                    dtStart = NULL;
-                    location = NULL;
-                    summary = cTodo->summary;
-                    priority = cTodo->priority;
-                    if (summary == NULL)
-                    {
-                        summary = "";
-                    }
-                    if (cTodo->org != NULL)
-                    {   
-                        orgName = cTodo->org->name;
-                        orgContact = cTodo->org->contact;
-                    }
-                }
-                else
-                {
-                    //Looks for 'Summary' property and stores a pointer to it
-                    for (int j = 0; j < pCal->comp[i]->nprops; j++)
-                    {
-                        if (strcmp(tempProp->name,"SUMMARY") == 0)
-                        {
-                            summary = tempProp->value;
-                            break;
-                        }
-                        tempProp = tempProp->next;
-                    }
-                    if (summary == NULL)
-                    {
-                        summary = "";
-                    }
-                }
-                //build a tuple of the comp's information and append it to the list of tuples
-                tempTuple = Py_BuildValue("(siis)",name,props,comps,summary);
-                PyList_Append(listOfPrimTuples, tempTuple);
-                tempTuple = Py_BuildValue("(sssss)",dtStart,priority,location,orgName,orgContact);
-                PyList_Append(listOfSecTuples, tempTuple);
-
-            }
-
-            //add CalComp pointer and  the list of informaion tuples the result 
-            PyList_Append(result,Py_BuildValue("k",pCal));
-            PyList_Append(result,listOfPrimTuples);
-            PyList_Append(result,listOfSecTuples);
-            if (cEvent != NULL)
-            {
-                freeCalEvent(cEvent);
-                cEvent = NULL;
-            }
-            if (cTodo != NULL)
-            {
-                freeCalTodo(cTodo);
-                cTodo = NULL;
-            }
+            listCalComp(pCal,result);
         }
         //Failed to read Cal file, return error
         else
         {
-            getCalError(stat,calErrBuff);
-            if (stat.lineto == stat.linefrom)
-            {
-                sprintf(errMsgBuff,"Error on line: %d\n%s",stat.lineto,calErrBuff);
-            }
-            else
-            {
-                sprintf(errMsgBuff,"Error from line %d to line %d\n%s",stat.linefrom,stat.lineto,calErrBuff);
-            }
+            describeCalError(stat,errMsgBuff);
             return(Py_BuildValue("s",errMsgBuff));
         }
         //Success
@@ -306,6 +374,90 @@ static PyObject *Cal_freeFile(PyObject *self, PyObject *args)
     }
 }
 
+static PyObject *Cal_memUsage(PyObject *self, PyObject *args)
+{
+    CalComp *pCal;
+    size_t used, wasted;
+
+    pCal = NULL;
+    used = 0;
+    wasted = 0;
+    if (PyArg_ParseTuple(args, "k", (unsigned long*)&pCal) && pCal != NULL)
+    {
+        getCalArenaUsage(pCal,&used,&wasted);
+        return(Py_BuildValue("(nn)",(Py_ssize_t)used,(Py_ssize_t)wasted));
+    }
+    return(Py_BuildValue("(ii)",0,0));
+}
+
+static PyObject *Cal_indexFile(PyObject *self, PyObject *args)
+{
+    CalComp *pCal;
+    CalIndex *index;
+
+    pCal = NULL;
+    if (PyArg_ParseTuple(args, "k", (unsigned long*)&pCal) && pCal != NULL)
+    {
+        index = InitializeCalIndex(pCal);
+        return(Py_BuildValue("k",index));
+    }
+    return(Py_BuildValue("k",0));
+}
+
+static PyObject *Cal_queryIndex(PyObject *self, PyObject *args)
+{
+    CalIndex *index;
+    CalOpt kind;
+    PyObject *foundList, *tempInt;
+    char *kindCode;
+    long long datefrom, dateto;
+    int *found, nfound;
+
+    index = NULL;
+    kindCode = NULL;
+    if (!PyArg_ParseTuple(args, "ksLL", (unsigned long*)&index, &kindCode, &datefrom, &dateto) || index == NULL)
+    {
+        Py_RETURN_NONE;
+    }
+    if (strcmp(kindCode,"e") == 0)
+    {
+        kind = OEVENT;
+    }
+    else if (strcmp(kindCode,"t") == 0)
+    {
+        kind = OTODO;
+    }
+    else
+    {
+        Py_RETURN_NONE;
+    }
+
+    found = queryCalIndex(index,kind,(time_t)datefrom,(time_t)dateto,&nfound);
+
+    foundList = PyList_New(0);
+    for (int i = 0; i < nfound; i++)
+    {
+        tempInt = Py_BuildValue("i",found[i]);
+        PyList_Append(foundList,tempInt);
+        Py_DECREF(tempInt);
+    }
+    free(found);
+    return(foundList);
+}
+
+static PyObject *Cal_freeIndex(PyObject *self, PyObject *args)
+{
+    CalIndex *index;
+
+    index = NULL;
+    if (PyArg_ParseTuple(args, "k", (unsigned long*)&index))
+    {
+        freeCalIndex(index);
+        return(Py_BuildValue("i",1));
+    }
+    return(Py_BuildValue("i",0));
+}
+
 static PyObject *Cal_writeFile(PyObject *self, PyObject *args)
 {
 
@@ -322,7 +474,7 @@ static PyObject *Cal_writeFile(PyObject *self, PyObject *args)
 
     //message for when file cannot open or error occurs
     char *noFileMsg;
-    char buffer[200];
+    char buffer[150];   // as long as getCalError's messages
     char buff2[200];
 
     cPosToWrite = NULL;
@@ -353,10 +505,12 @@ static PyObject *Cal_writeFile(PyObject *self, PyObject *args)
 
         if (toWrite->ncomps == 0)
         {
+            free(toWrite);
+            free(cPosToWrite);
             stat.code = NOCAL;
             getCalError(stat,buffer);
-            sprintf(buff2,"\n%s%d Lines written.",buffer, stat.lineto);
-            return(Py_BuildValue("s",&buff2));
+            snprintf(buff2,sizeof(buff2),"\n%s%d Lines written.",buffer, stat.lineto);
+            return(Py_BuildValue("s",buff2));
         }
 
         fh = fopen(fileName,"w" );
@@ -370,39 +524,482 @@ static PyObject *Cal_writeFile(PyObject *self, PyObject *args)
             strcat(noFileMsg,strerror(errno));
             noFileObj = Py_BuildValue("s",noFileMsg);
             free(noFileMsg);
+            free(toWrite);
             free(cPosToWrite);
             return(noFileObj);
         }
 
 
-        stat = writeCalComp(fh,toWrite);
-
-        if (stat.code != OK)
-        {
-            getCalError(stat,buffer);
-            sprintf(buffer,"\n%s%d Lines written.",buffer, stat.lineto);
-            return(Py_BuildValue("s",&buffer));
-        }
+        stat = writeCalCompThreads(fh,toWrite,0);
 
         free(toWrite);
         free(cPosToWrite);
         fclose(fh);
-        
+
         if (stat.code != OK)
         {
             getCalError(stat,buffer);
-            sprintf(buffer,"%s%d Lines written",buffer, stat.lineto);
-            return(Py_BuildValue("s",&buffer));
+            snprintf(buff2,sizeof(buff2),"\n%s%d Lines written.",buffer, stat.lineto);
+            return(Py_BuildValue("s",buff2));
         }
     }
     else
     {
         return(Py_BuildValue("s","Bad Args"));
     }
-    sprintf(buffer,"OK%d Lines written",stat.lineto);
+    snprintf(buffer,sizeof(buffer),"OK%d Lines written",stat.lineto);
     return(Py_BuildValue("s",buffer));
 }
 
+static PyObject *Cal_writeBuffer(PyObject *self, PyObject *args)
+{
+    CalComp *pCal, *toWrite;
+    CalStatus stat;
+    int *cPosToWrite, size, tempInt;
+    PyObject *pyPosToWrite, *index, *text;
+    char *buff;
+    size_t len;
+    char buffer[150];   // as long as getCalError's messages
+    char buff2[200];
+
+    tempInt = 0;
+    pCal = NULL;
+    pyPosToWrite = NULL;
+    buff = NULL;
+    if (!PyArg_ParseTuple(args, "kO", (unsigned long*)&pCal, &pyPosToWrite))
+    {
+        return(Py_BuildValue("s","Bad Args"));
+    }
+
+    //convert int list from py to c
+    size = PyList_Size(pyPosToWrite);
+    cPosToWrite = malloc(sizeof(int)*size);
+    assert(cPosToWrite != NULL);
+    for (int i = 0; i < size; i++)
+    {
+        index = PyList_GetItem(pyPosToWrite,i);
+        PyArg_Parse(index,"i",&tempInt);
+
+        cPosToWrite[i] = tempInt;
+    }
+
+    //build a shallow copy
+    toWrite = createShallow(pCal,cPosToWrite,size);
+    free(cPosToWrite);
+
+    if (toWrite->ncomps == 0)
+    {
+        free(toWrite);
+        stat = InitializeCalStatus();
+        stat.code = NOCAL;
+        getCalError(stat,buffer);
+        snprintf(buff2,sizeof(buff2),"\n%s%d Lines written.",buffer, stat.lineto);
+        return(Py_BuildValue("s",buff2));
+    }
+
+    //one allocation of the calendar's exact length, copied once into the bytes object
+    stat = writeCalCompToBuffer(toWrite,&buff,&len);
+    free(toWrite);
+    if (stat.code != OK)
+    {
+        free(buff);
+        getCalError(stat,buffer);
+        snprintf(buff2,sizeof(buff2),"\n%s%d Lines written.",buffer, stat.lineto);
+        return(Py_BuildValue("s",buff2));
+    }
+    text = PyBytes_FromStringAndSize(buff,len);
+    free(buff);
+    return(text);
+}
+
+static PyObject *Cal_calInfo(PyObject *self, PyObject *args)
+{
+    CalComp *pCal, *toDescribe;
+    CalStatus stat;
+    PyObject *pyPosToWrite, *info;
+    FILE *txtfile;
+    char *text;
+    size_t len;
+    char errMsgBuff[200];
+
+    pCal = NULL;
+    pyPosToWrite = NULL;
+    if (!PyArg_ParseTuple(args, "kO", (unsigned long*)&pCal, &pyPosToWrite) || pCal == NULL)
+    {
+        return(Py_BuildValue("(ss)","","Bad Args"));
+    }
+
+    toDescribe = shallowFromList(pCal,pyPosToWrite);
+    if (toDescribe->ncomps == 0)
+    {
+        free(toDescribe);
+        stat = InitializeCalStatus();
+        stat.code = NOCAL;
+        describeCalError(stat,errMsgBuff);
+        return(Py_BuildValue("(ss)","",errMsgBuff));
+    }
+
+    //the lines are those the calendar comes to saved, as caltool would have read them
+    txtfile = open_memstream(&text,&len);
+    assert(txtfile != NULL);
+    stat = calInfo(toDescribe,calCompLines(toDescribe),txtfile);
+    fclose(txtfile);
+    free(toDescribe);
+
+    if (stat.code != OK)
+    {
+        free(text);
+        describeCalError(stat,errMsgBuff);
+        return(Py_BuildValue("(ss)","",errMsgBuff));
+    }
+    info = Py_BuildValue("(Ns)",PyUnicode_DecodeUTF8(text,len,"replace"),"");
+    free(text);
+    return(info);
+}
+
+static PyObject *Cal_calExtract(PyObject *self, PyObject *args)
+{
+    CalComp *pCal, *toExtract;
+    CalStatus stat;
+    CalOpt kind;
+    PyObject *pyPosToWrite, *extracted;
+    FILE *txtfile;
+    char *kindCode, *text;
+    size_t len;
+    char errMsgBuff[200];
+
+    pCal = NULL;
+    pyPosToWrite = NULL;
+    kindCode = NULL;
+    if (!PyArg_ParseTuple(args, "kOs", (unsigned long*)&pCal, &pyPosToWrite, &kindCode) || pCal == NULL)
+    {
+        return(Py_BuildValue("(ss)","","Bad Args"));
+    }
+    if (strcmp(kindCode,"e") == 0)
+    {
+        kind = OEVENT;
+    }
+    else if (strcmp(kindCode,"x") == 0)
+    {
+        kind = OPROP;
+    }
+    else
+    {
+        return(Py_BuildValue("(ss)","","ERROR: invalid argument for -extract.\n"));
+    }
+
+    toExtract = shallowFromList(pCal,pyPosToWrite);
+    if (toExtract->ncomps == 0)
+    {
+        free(toExtract);
+        stat = InitializeCalStatus();
+        stat.code = NOCAL;
+        describeCalError(stat,errMsgBuff);
+        return(Py_BuildValue("(ss)","",errMsgBuff));
+    }
+
+    txtfile = open_memstream(&text,&len);
+    assert(txtfile != NULL);
+    stat = calExtract(toExtract,kind,txtfile);
+    fclose(txtfile);
+    free(toExtract);
+
+    if (stat.code != OK)
+    {
+        free(text);
+        describeCalError(stat,errMsgBuff);
+        return(Py_BuildValue("(ss)","",errMsgBuff));
+    }
+    extracted = Py_BuildValue("(Ns)",PyUnicode_DecodeUTF8(text,len,"replace"),"");
+    free(text);
+    return(extracted);
+}
+
+static PyObject *Cal_calFilter(PyObject *self, PyObject *args)
+{
+    CalComp *pCal, *toFilter, *kept, *filtered;
+    CalIndex *index;
+    CalStatus stat;
+    CalOpt content;
+    PyObject *pyPosToWrite, *result;
+    char *kindCode, *fromStr, *toStr;
+    time_t datefrom, dateto;
+    int *found, *keep;
+    int dtErr, nfound;
+    char errMsgBuff[200];
+
+    pCal = NULL;
+    pyPosToWrite = NULL;
+    datefrom = 0;
+    dateto = 0;
+    if (!PyArg_ParseTuple(args, "kOsssO", (unsigned long*)&pCal, &pyPosToWrite, &kindCode, &fromStr, &toStr, &result) || pCal == NULL)
+    {
+        return(Py_BuildValue("s","Bad Args"));
+    }
+    if (strcmp(kindCode,"e") == 0)
+    {
+        content = OEVENT;
+    }
+    else if (strcmp(kindCode,"t") == 0)
+    {
+        content = OTODO;
+    }
+    else
+    {
+        return(Py_BuildValue("s","ERROR: invalid argument for -filter.\n"));
+    }
+
+    //dates as 'caltool -filter' reads them
+    dtErr = 0;
+    if (strlen(fromStr) > 0)
+    {
+        dtErr = getCalDate(fromStr,0,&datefrom);
+        if (dtErr == 2)
+        {
+            return(Py_BuildValue("s","The 'from' date could not be interpreted.\n"));
+        }
+    }
+    if (dtErr == 0 && strlen(toStr) > 0)
+    {
+        dtErr = getCalDate(toStr,1,&dateto);
+        if (dtErr == 2)
+        {
+            return(Py_BuildValue("s","The 'to' date could not be interpreted.\n"));
+        }
+    }
+    if (dtErr == 1)
+    {
+        return(Py_BuildValue("s","Problem with DATEMSK environment variable or template file.\n"));
+    }
+    if (dateto != 0 && datefrom != 0 && dateto < datefrom)
+    {
+        return(Py_BuildValue("s","ERROR: 'from \"date\" must occur eariler than 'to \"date\"'.\n"));
+    }
+
+    //the components calFilter would write, copied into a calendar of their own
+    toFilter = shallowFromList(pCal,pyPosToWrite);
+    index = InitializeCalIndex(toFilter);
+    found = queryCalIndex(index,content,datefrom,dateto,&nfound);
+    freeCalIndex(index);
+    if (nfound == 0)
+    {
+        free(found);
+        free(toFilter);
+        stat = InitializeCalStatus();
+        stat.code = NOCAL;
+        describeCalError(stat,errMsgBuff);
+        return(Py_BuildValue("s",errMsgBuff));
+    }
+
+    keep = malloc(sizeof(int)*(toFilter->ncomps+1));
+    assert(keep != NULL);
+    memset(keep,0,sizeof(int)*(toFilter->ncomps+1));
+    for (int i = 0; i < nfound; i++)
+    {
+        keep[found[i]] = 1;
+    }
+    kept = createShallow(toFilter,keep,toFilter->ncomps);
+    filtered = copyCalComp(kept);
+    free(kept);
+    free(keep);
+    free(found);
+    free(toFilter);
+
+    listCalComp(filtered,result);
+    return(Py_BuildValue("s","OK"));
+}
+
+static PyObject *Cal_calCombine(PyObject *self, PyObject *args)
+{
+    CalComp *pCal, *toCombine, *fileComp, *both, *combined;
+    CalParser *parser;
+    CalStatus stat;
+    PyObject *pyPosToWrite, *result, *noFileObj;
+    FILE *fh;
+    char *fileName, *noFileMsg;
+    char errMsgBuff[200];
+
+    pCal = NULL;
+    pyPosToWrite = NULL;
+    fileComp = NULL;
+    if (!PyArg_ParseTuple(args, "kOsO", (unsigned long*)&pCal, &pyPosToWrite, &fileName, &result) || pCal == NULL)
+    {
+        return(Py_BuildValue("s","Bad Args"));
+    }
+
+    fh = fopen(fileName,"r");
+    //File Open failed: return error string
+    if (fh == NULL)
+    {
+        noFileMsg = malloc(sizeof(char)*(strlen(fileName)+strlen(strerror(errno))+3));
+        assert(noFileMsg != NULL);
+        strcpy(noFileMsg,fileName);
+        strcat(noFileMsg,": ");
+        strcat(noFileMsg,strerror(errno));
+        noFileObj = Py_BuildValue("s",noFileMsg);
+        free(noFileMsg);
+        return(noFileObj);
+    }
+
+    //the file is only needed until the combined calendar is copied, as for 'caltool -combine'
+    parser = InitializeCalParserFd(fileno(fh));
+    if (parser != NULL)
+    {
+        setCalParserOptions(parser,CAL_ARENA | CAL_SLICES | CAL_SOURCE);
+        setCalParserThreads(parser,0);
+        stat = readCalFileEx(parser,&fileComp);
+        freeCalParser(parser);
+    }
+    else
+    {
+        stat = InitializeCalStatus();
+        stat.code = IOERR;
+    }
+    fclose(fh);
+    if (stat.code != OK)
+    {
+        describeCalError(stat,errMsgBuff);
+        return(Py_BuildValue("s",errMsgBuff));
+    }
+
+    //the calendar calCombine would write, copied into one of its own
+    toCombine = shallowFromList(pCal,pyPosToWrite);
+    both = combineCalComps(fileComp,toCombine);
+    combined = copyCalComp(both);
+    free(both);
+    free(toCombine);
+    freeCalComp(fileComp);
+
+    listCalComp(combined,result);
+    return(Py_BuildValue("s","OK"));
+}
+
+static void listCalComp(CalComp *pCal, PyObject *result)
+{
+    CalProp *tempProp; //temp Pointer to look through property lsit
+    CalEvent *cEvent; //To store Event information
+    CalTodo *cTodo; //to Store Todo information
+
+    //Objects used to construct the result
+    PyObject *listOfPrimTuples, *listOfSecTuples,*tempTuple;
+
+    // information to place in a pyObject tuple
+    char *name, *summary, *priority,*dtStart,*location, *orgName, *orgContact;
+    char dateStart[100];
+    int props,comps;
+
+    tempProp = NULL;
+    cEvent = NULL;
+    cTodo = NULL;
+
+    listOfPrimTuples = Py_BuildValue("[]");
+    listOfSecTuples = Py_BuildValue("[]");
+    //loop Through top level components and creat tuples from
+    //their infomation
+    for (int i = 0; i < pCal->ncomps; i++)
+    {
+        name = NULL;
+        summary = NULL;
+        dtStart = NULL;
+        priority = NULL;
+        location = NULL;
+        orgName = NULL;
+        orgContact = NULL;
+        name  = pCal->comp[i]->name;
+        props = pCal->comp[i]->nprops;
+        comps = pCal->comp[i]->ncomps;
+        tempProp = pCal->comp[i]->prop;
+
+        //an event without a start date it can read is listed like any other component
+        if (pCal->comp[i]->kind == COMP_VEVENT)
+        {
+            cEvent = extractEvent(pCal->comp[i]);
+        }
+
+        if (cEvent != NULL)
+        {
+            strftime(dateStart,100,"%F %H:%M:%S",cEvent->dateStart);
+            dtStart = dateStart;
+            location = cEvent->location;
+            summary = cEvent->summary;
+
+            if (summary == NULL)
+            {
+                summary = "";
+            }
+            if (cEvent->org != NULL)
+            {   
+                orgName = cEvent->org->name;
+                orgContact = cEvent->org->contact;
+            }
+        }
+
+        else if (pCal->comp[i]->kind == COMP_VTODO)
+        {
+            cTodo = extractTodo(pCal->comp[i]);
+            dtStart = NULL;
+            location = NULL;
+            summary = cTodo->summary;
+            priority = cTodo->priority;
+            if (summary == NULL)
+            {
+                summary = "";
+            }
+            if (cTodo->org != NULL)
+            {   
+                orgName = cTodo->org->name;
+                orgContact = cTodo->org->contact;
+            }
+        }
+        else
+        {
+            //Looks for 'Summary' property and stores a pointer to it
+            for (int j = 0; j < pCal->comp[i]->nprops; j++)
+            {
+                if (tempProp->kind == PROP_SUMMARY)
+                {
+                    summary = (char *)calPropValue(pCal->comp[i],tempProp);
+                    break;
+                }
+                tempProp = tempProp->next;
+            }
+            if (summary == NULL)
+            {
+                summary = "";
+            }
+        }
+        //build a tuple of the comp's information and append it to the list of tuples
+        tempTuple = Py_BuildValue("(siis)",name,props,comps,summary);
+        PyList_Append(listOfPrimTuples, tempTuple);
+        Py_DECREF(tempTuple);
+        tempTuple = Py_BuildValue("(sssss)",dtStart,priority,location,orgName,orgContact);
+        PyList_Append(listOfSecTuples, tempTuple);
+        Py_DECREF(tempTuple);
+
+        //the tuples hold copies of the strings
+        if (cEvent != NULL)
+        {
+            freeCalEvent(cEvent);
+            cEvent = NULL;
+        }
+        if (cTodo != NULL)
+        {
+            freeCalTodo(cTodo);
+            cTodo = NULL;
+        }
+
+    }
+
+    //add CalComp pointer and  the list of informaion tuples the result 
+    tempTuple = Py_BuildValue("k",pCal);
+    PyList_Append(result,tempTuple);
+    Py_DECREF(tempTuple);
+    PyList_Append(result,listOfPrimTuples);
+    Py_DECREF(listOfPrimTuples);
+    PyList_Append(result,listOfSecTuples);
+    Py_DECREF(listOfSecTuples);
+}
+
 static CalComp *createShallow(CalComp *Cal, int *indexes, int nIndexes)
 {
 
@@ -428,8 +1025,12 @@ static CalComp *createShallow(CalComp *Cal, int *indexes, int nIndexes)
 
     //assign values to shallow copy
     shalCal->name = Cal->name;
+    shalCal->kind = Cal->kind;
     shalCal->nprops = Cal->nprops;
     shalCal->prop = Cal->prop;
+    shalCal->arena = NULL;
+    shalCal->text = NULL;
+    shalCal->textLen = 0;
     shalCal->ncomps = sizeShallow;
 
     //on '1' in indexes, assign value to shalCal
@@ -445,6 +1046,46 @@ static CalComp *createShallow(CalComp *Cal, int *indexes, int nIndexes)
 
     return(shalCal);
 }
+static CalComp *shallowFromList(CalComp *pCal, PyObject *pyPosToWrite)
+{
+    CalComp *shalCal;
+    PyObject *index;
+    int *cPosToWrite, size, tempInt;
+
+    tempInt = 0;
+
+    //convert int list from py to c
+    size = PyList_Size(pyPosToWrite);
+    cPosToWrite = malloc(sizeof(int)*(size+1));
+    assert(cPosToWrite != NULL);
+    for (int i = 0; i < size; i++)
+    {
+        index = PyList_GetItem(pyPosToWrite,i);
+        PyArg_Parse(index,"i",&tempInt);
+
+        cPosToWrite[i] = tempInt;
+    }
+
+    shalCal = createShallow(pCal,cPosToWrite,size);
+    free(cPosToWrite);
+    return(shalCal);
+}
+
+static void describeCalError(CalStatus stat, char *errorStore)
+{
+    char calErrBuff[150];
+
+    getCalError(stat,calErrBuff);
+    if (stat.lineto == stat.linefrom)
+    {
+        sprintf(errorStore,"Error on line: %d\n%s",stat.lineto,calErrBuff);
+    }
+    else
+    {
+        sprintf(errorStore,"Error from line %d to line %d\n%s",stat.linefrom,stat.lineto,calErrBuff);
+    }
+}
+
 static void getCalError(CalStatus stat, char *errorStore)
 {
     char buffer[150];
@@ -0,0 +1,1561 @@
+/* calrecur.c
+*
+*  These functions expand the recurrence of a component (its RRULE, RDATE and EXDATE
+*  properties, RFC 5545 3.8.5) into its occurrences. The rule is expanded one period
+*  (year, month, week, day, ...) at a time and only while the period can hold an
+*  occurrence inside the window, so an unbounded series is never materialized, and
+*  the first period of a window far from DTSTART is found by arithmetic.
+*
+*  A rule with COUNT must know how many occurrences came before the window. When every
+*  period holds the same number of them (e.g. FREQ=WEEKLY;BYDAY=MO,WE;COUNT=500) that is
+*  computed too; otherwise the periods before the window are expanded to count them.
+*
+********************************************************************************************/
+
+#include "calrecur.h"
+
+#define RECUR_SLACK 172800      // more than a wall time and its instant can differ by (seconds)
+#define RECUR_MAX_DAYS 371      // most days in one period of a rule (a week-numbered year)
+#define RECUR_MAX_SETPOS 732    // most positions BYSETPOS can choose (1..366 and -1..-366)
+#define RECUR_BITS 46           // bytes of a set of the numbers 0..366
+#define RECUR_MAX_WALK 1000000  // most periods spanCalRecur expands when it cannot skip them
+
+typedef enum { FREQ_NONE=0, FREQ_SECONDLY, FREQ_MINUTELY, FREQ_HOURLY, FREQ_DAILY,
+    FREQ_WEEKLY, FREQ_MONTHLY, FREQ_YEARLY,
+} RecurFreq;
+
+/* How the wall times of a series become instants */
+typedef enum { ZONE_UTC=0, ZONE_LOCAL, ZONE_TZ, ZONE_FIXED } RecurZone;
+
+/* Numbers of a BY rule part (BYMONTHDAY=1,15,-1), as sets of bits */
+typedef struct RecurList {
+    int given;                      // 1 if the rule has the part
+    unsigned char pos[RECUR_BITS];  // 0 .. 366
+    unsigned char neg[RECUR_BITS];  // -1 .. -366, by absolute value
+} RecurList;
+
+/* RRULE, decoded */
+typedef struct RecurRule {
+    RecurFreq freq;
+    long interval;
+    long count;             // 0 if the rule has no COUNT
+    time_t until;           // CAL_RECUR_LAST if it has no UNTIL
+    int wkst;               // first day of a week, 0 (SU) .. 6 (SA)
+    RecurList bySecond, byMinute, byHour, byMonth, byMonthDay, byYearDay, byWeekNo, bySetPos;
+    RecurList byDay[7];     // per weekday: pos 0 for every one, pos n / neg n for the n-th / -n-th
+    int hasDay;             // 1 if byDay has any
+    int nthInMonth;         // 1 if n-th weekdays count within the month (else within the year)
+} RecurRule;
+
+/* Occurrence of a series */
+typedef struct RecurDate {
+    CalTime start;
+    CalTime end;
+} RecurDate;
+
+struct CalRecur {
+    RecurZone mode;
+    CalTzCache *zones;      // to find TZIDs (may be NULL)
+    char tzid[CAL_TZID_MAX];// DTSTART's TZID (ZONE_TZ)
+    const CalTz *tz;
+    long tzEnd;             // wall time tz covers up to
+    long offset;            // ZONE_FIXED: seconds east of UTC
+    CalTime dtstart;
+    long startWall;         // wall time of DTSTART
+    long endWall;           // wall seconds from the start to the end of an occurrence
+    long endExact;          // and exact seconds after those
+    time_t from, to;        // the window
+
+    int ruleDone;           // 1 if the rule has no (more) occurrences
+    int forever;            // 1 if the rule has neither COUNT nor UNTIL
+    int skips;              // 1 if a window far from DTSTART is reached by arithmetic
+    RecurRule rule;
+    long anchor;            // year, month (year*12+mon-1), first day of week, day or second
+                            // where period 0 starts
+    long limitWall;         // wall time after which no period is expanded
+    long period;            // no. of the period expanded next
+    long ndays, days[RECUR_MAX_DAYS];   // days of the current period in the rule
+    int nhours, hours[24];  // times of day of each of those days
+    int nmins, mins[60];
+    int nsecs, secs[61];
+    long total;             // no. of dates in the period (days x hours x mins x secs)
+    long nsel, sel[RECUR_MAX_SETPOS];   // positions BYSETPOS chose of them
+    long npos, pos;         // no. of positions of the period (nsel or total), next one
+    long emitted;           // dates of the rule so far, DTSTART included (for COUNT)
+    long budget;            // periods that may still be expanded, or -1 for no limit
+    int pending;            // 1 if next holds the rule's next occurrence
+    RecurDate next;
+
+    int ndates, dateAt;     // DTSTART and RDATEs in the window, sorted by start
+    RecurDate *dates;
+    int nexcl, nexclDays;   // EXDATE instants, and days of EXDATE DATE values, sorted
+    time_t *excl;
+    long *exclDays;
+};
+
+/*floorDiv
+*
+* Purpose: To divide rounding towards minus infinity, for times before 1970.
+*
+* Arguments: The dividend (long) and a positive divisor (long)
+********************************************************************************************/
+static long floorDiv(long a, long b)
+{
+    return(a / b - (a % b < 0));
+}
+
+/*setBit / testBit
+*
+* Purpose: To add a number to, or look for it in, a set of the numbers 0..366.
+********************************************************************************************/
+static void setBit(unsigned char *bits, long n)
+{
+    bits[n >> 3] |= 1 << (n & 7);
+}
+
+static int testBit(const unsigned char *bits, long n)
+{
+    return(n >= 0 && n < RECUR_BITS*8 && (bits[n >> 3] >> (n & 7)) & 1);
+}
+
+/*countBits
+*
+* Purpose: To count the numbers in a set.
+********************************************************************************************/
+static int countBits(const unsigned char *bits)
+{
+    int n;
+
+    n = 0;
+    for (int i = 0; i < RECUR_BITS; i++)
+    {
+        n += __builtin_popcount(bits[i]);
+    }
+    return(n);
+}
+
+/*inList
+*
+* Purpose: To find whether a number counted from the start (n) or from the end (fromEnd,
+*          i.e. -fromEnd) is in a BY rule part.
+********************************************************************************************/
+static int inList(const RecurList *list, long n, long fromEnd)
+{
+    return(testBit(list->pos,n) || testBit(list->neg,fromEnd));
+}
+
+/*readList
+*
+* Purpose: To read the numbers of a BY rule part ("1,15,-1"). Numbers out of range are ignored.
+*
+* Arguments: The value (const char*), the list to set (RecurList*), and the least and greatest
+*            numbers allowed (int); 0 is not allowed when negative numbers are
+********************************************************************************************/
+static void readList(const char *value, RecurList *list, int min, int max)
+{
+    long n;
+    char *next;
+
+    memset(list,0,sizeof(RecurList));
+    for (;;)
+    {
+        n = strtol(value,&next,10);
+        if (next != value && n >= min && n <= max && (n != 0 || min == 0))
+        {
+            list->given = 1;
+            if (n >= 0)
+            {
+                setBit(list->pos,n);
+            }
+            else
+            {
+                setBit(list->neg,-n);
+            }
+        }
+        if (*next != ',')
+        {
+            return;
+        }
+        value = next + 1;
+    }
+}
+
+/*listNumbers
+*
+* Purpose: To list the numbers of a BY rule part in order, or a default if the rule has none.
+*
+* Arguments: The list (const RecurList*), the greatest number (int), the default (int) and
+*            the array to fill (int*)
+*
+* Returns: The no. of numbers
+********************************************************************************************/
+static int listNumbers(const RecurList *list, int max, int deflt, int *numbers)
+{
+    int n;
+
+    if (!list->given)
+    {
+        numbers[0] = deflt;
+        return(1);
+    }
+    n = 0;
+    for (int i = 0; i <= max; i++)
+    {
+        if (testBit(list->pos,i))
+        {
+            numbers[n] = i;
+            n += 1;
+        }
+    }
+    return(n);
+}
+
+/*weekdayCode
+*
+* Purpose: To read an RFC 5545 weekday ("SU" .. "SA").
+*
+* Returns: 0 (Sunday) .. 6 (Saturday), or -1 if the text is not a weekday
+********************************************************************************************/
+static int weekdayCode(const char *text)
+{
+    const char *codes[] = {"SU","MO","TU","WE","TH","FR","SA"};
+
+    for (int i = 0; i < 7; i++)
+    {
+        if (strncmp(text,codes[i],2) == 0)
+        {
+            return(i);
+        }
+    }
+    return(-1);
+}
+
+/*readDuration
+*
+* Purpose: To read an RFC 5545 DURATION value ("P1W", "-PT15M", "P1DT12H").
+*
+* Arguments: The value (const char*), and the addresses of its days (weeks included) and of
+*            its seconds (long*)
+*
+* Returns: 1 if the value is a duration, 0 otherwise
+********************************************************************************************/
+static int readDuration(const char *value, long *days, long *secs)
+{
+    long n, sign;
+    char *next;
+
+    *days = 0;
+    *secs = 0;
+    sign = 1;
+    if (*value == '+' || *value == '-')
+    {
+        sign = *value == '-' ? -1 : 1;
+        value += 1;
+    }
+    if (*value != 'P')
+    {
+        return(0);
+    }
+    value += 1;
+
+    while (*value != '\0' && *value != ',')
+    {
+        if (*value == 'T')
+        {
+            value += 1;
+            continue;
+        }
+        n = strtol(value,&next,10);
+        if (next == value)
+        {
+            return(0);
+        }
+        switch (*next)
+        {
+            case 'W':
+                *days += 7*n;
+                break;
+            case 'D':
+                *days += n;
+                break;
+            case 'H':
+                *secs += 3600*n;
+                break;
+            case 'M':
+                *secs += 60*n;
+                break;
+            case 'S':
+                *secs += n;
+                break;
+            default:
+                return(0);
+        }
+        value = next + 1;
+    }
+    *days *= sign;
+    *secs *= sign;
+    return(1);
+}
+
+/*toInstant
+*
+* Purpose: To find the instant of a wall time of the series' timezone. Tables of a TZID are
+*          extended when the series runs past the years they cover.
+*
+* Arguments: The iterator (CalRecur*) and the address of the wall time (long*); a local time
+*            skipped by a DST change is moved past it
+*
+* Returns: Seconds since the epoch
+********************************************************************************************/
+static time_t toInstant(CalRecur *recur, long *wall)
+{
+    const CalTz *tz;
+    int year, mon, mday;
+
+    switch (recur->mode)
+    {
+        case ZONE_LOCAL:
+            return(calLocalToUtc(wall));
+        case ZONE_FIXED:
+            return(*wall - recur->offset);
+        case ZONE_TZ:
+            if (*wall >= recur->tzEnd)
+            {
+                calCivilFromDays(floorDiv(*wall,86400),&year,&mon,&mday);
+                year = year + 10 > 9999 ? 9999 : year + 10;
+                tz = findCalTz(recur->zones,recur->tzid,year);
+                if (tz != NULL)
+                {
+                    recur->tz = tz;
+                }
+                recur->tzEnd = calDaysFromCivil(year+1,1,1)*86400;
+            }
+            return(calTzToUtc(recur->tz,*wall));
+        default:
+            return(*wall);
+    }
+}
+
+/*toWall
+*
+* Purpose: To find the wall time of the series' timezone at an instant.
+*
+* Arguments: The iterator (const CalRecur*) and seconds since the epoch (time_t)
+*
+* Returns: The wall time, in seconds from 1970-01-01 00:00 as if it were UTC
+********************************************************************************************/
+static long toWall(const CalRecur *recur, time_t t)
+{
+    struct tm tm;
+
+    switch (recur->mode)
+    {
+        case ZONE_LOCAL:
+            localtime_r(&t,&tm);
+            return(calDaysFromCivil(tm.tm_year+1900,tm.tm_mon+1,tm.tm_mday)*86400 +
+                   tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec);
+        case ZONE_FIXED:
+            return(t + recur->offset);
+        case ZONE_TZ:
+            return(t + calTzOffset(recur->tz,t));
+        default:
+            return(t);
+    }
+}
+
+/*setOccurrence
+*
+* Purpose: To fill the start and end of an occurrence of the series at a wall time.
+*
+* Arguments: The iterator (CalRecur*), the wall time (long) and the occurrence (RecurDate*)
+********************************************************************************************/
+static void setOccurrence(CalRecur *recur, long wall, RecurDate *date)
+{
+    long endWall;
+
+    date->start = recur->dtstart;
+    date->start.t = toInstant(recur,&wall);
+    calTimeFromWall(wall,&date->start);
+
+    date->end = date->start;
+    if (recur->endWall == 0 && recur->endExact == 0)
+    {
+        return;
+    }
+    endWall = wall + recur->endWall;
+    if (recur->endWall != 0)
+    {
+        date->end.t = toInstant(recur,&endWall);
+    }
+    if (recur->endExact != 0)
+    {
+        date->end.t += recur->endExact;
+        endWall = toWall(recur,date->end.t);
+    }
+    calTimeFromWall(endWall,&date->end);
+}
+
+/*resolveDate
+*
+* Purpose: To set the instant of a date read from an RDATE or EXDATE, which has its own zone.
+*
+* Arguments: The iterator (CalRecur*), the property (const CalProp*) and the date (CalTime*)
+********************************************************************************************/
+static void resolveDate(CalRecur *recur, const CalProp *prop, CalTime *date)
+{
+    char tzid[CAL_TZID_MAX];
+    const CalTz *tz;
+
+    if (date->zone == CAL_UTC)
+    {
+        date->t = calWallSeconds(date);
+        return;
+    }
+    if (!getCalPropTzid(prop,tzid,sizeof(tzid)))
+    {
+        return;     //floating: parseCalTime read it as local time
+    }
+    date->zone = CAL_TZID;
+    if (recur->zones != NULL)
+    {
+        tz = findCalTz(recur->zones,tzid,date->year+1);
+        if (tz != NULL)
+        {
+            date->t = calTzToUtc(tz,calWallSeconds(date));
+        }
+    }
+}
+
+/*week1Start
+*
+* Purpose: To find the first day of week 1 of a year: the week (starting on wkst) that has
+*          at least four days of the year (RFC 5545 BYWEEKNO).
+*
+* Returns: The day counted from 1970-01-01
+********************************************************************************************/
+static long week1Start(int year, int wkst)
+{
+    long jan4;
+
+    jan4 = calDaysFromCivil(year,1,4);
+    return(jan4 - (calWeekday(jan4) - wkst + 7) % 7);
+}
+
+/*dayMatches
+*
+* Purpose: To find whether a day is one of the rule's: in its BYMONTH, BYMONTHDAY,
+*          BYYEARDAY, BYWEEKNO and BYDAY, if it has them.
+*
+* Arguments: The rule (const RecurRule*), the day counted from 1970-01-01 (long) and the
+*            year whose weeks BYWEEKNO counts (int)
+*
+* Returns: 1 if it is, 0 otherwise
+********************************************************************************************/
+static int dayMatches(const RecurRule *rule, long day, int weekYear)
+{
+    const RecurList *byDay;
+    int year, mon, mday, dim, wday;
+    long jan1, doy, diy, week1, nweeks, week;
+
+    calCivilFromDays(day,&year,&mon,&mday);
+    if (rule->byMonth.given && !testBit(rule->byMonth.pos,mon))
+    {
+        return(0);
+    }
+    dim = calDaysInMonth(year,mon);
+    if (rule->byMonthDay.given && !inList(&rule->byMonthDay,mday,dim-mday+1))
+    {
+        return(0);
+    }
+
+    jan1 = calDaysFromCivil(year,1,1);
+    doy = day - jan1 + 1;
+    diy = calDaysFromCivil(year+1,1,1) - jan1;
+    if (rule->byYearDay.given && !inList(&rule->byYearDay,doy,diy-doy+1))
+    {
+        return(0);
+    }
+    if (rule->byWeekNo.given)
+    {
+        week1 = week1Start(weekYear,rule->wkst);
+        nweeks = (week1Start(weekYear+1,rule->wkst) - week1) / 7;
+        week = floorDiv(day - week1,7) + 1;
+        if (!inList(&rule->byWeekNo,week,nweeks-week+1))
+        {
+            return(0);
+        }
+    }
+
+    if (!rule->hasDay)
+    {
+        return(1);
+    }
+    wday = calWeekday(day);
+    byDay = &rule->byDay[wday];
+    if (testBit(byDay->pos,0))
+    {
+        return(1);
+    }
+    if (rule->nthInMonth)
+    {
+        return(inList(byDay,(mday-1)/7+1,(dim-mday)/7+1));
+    }
+    return(inList(byDay,(doy-1)/7+1,(diy-doy)/7+1));
+}
+
+/*comparePositions / compareInstants
+*
+* Purpose: To order positions, days (long) and instants (time_t) for qsort and bsearch.
+********************************************************************************************/
+static int comparePositions(const void *pos1, const void *pos2)
+{
+    long a = *(const long*)pos1, b = *(const long*)pos2;
+
+    return((a > b) - (a < b));
+}
+
+static int compareInstants(const void *t1, const void *t2)
+{
+    time_t a = *(const time_t*)t1, b = *(const time_t*)t2;
+
+    return((a > b) - (a < b));
+}
+
+static int compareDates(const void *date1, const void *date2)
+{
+    return(compareInstants(&((const RecurDate*)date1)->start.t,&((const RecurDate*)date2)->start.t));
+}
+
+/*selectPositions
+*
+* Purpose: To choose the positions of the period's dates that BYSETPOS names, in order.
+*
+* Arguments: The iterator (CalRecur*), whose total is set
+********************************************************************************************/
+static void selectPositions(CalRecur *recur)
+{
+    const RecurList *setPos;
+    long n, kept;
+
+    setPos = &recur->rule.bySetPos;
+    n = 0;
+    for (long p = 1; p <= 366 && p <= recur->total; p++)
+    {
+        if (testBit(setPos->pos,p))
+        {
+            recur->sel[n] = p - 1;
+            n += 1;
+        }
+        if (testBit(setPos->neg,p))
+        {
+            recur->sel[n] = recur->total - p;
+            n += 1;
+        }
+    }
+    qsort(recur->sel,n,sizeof(long),&comparePositions);
+
+    kept = 0;
+    for (long i = 0; i < n; i++)
+    {
+        if (kept == 0 || recur->sel[i] != recur->sel[kept-1])
+        {
+            recur->sel[kept] = recur->sel[i];
+            kept += 1;
+        }
+    }
+    recur->nsel = kept;
+}
+
+/*wallAt
+*
+* Purpose: To find the wall time at a position of the current period (days x hours x
+*          minutes x seconds, in order).
+*
+* Arguments: The iterator (const CalRecur*) and the position (long)
+*
+* Returns: The wall time
+********************************************************************************************/
+static long wallAt(const CalRecur *recur, long i)
+{
+    int sec, min, hour;
+
+    if (recur->rule.bySetPos.given)
+    {
+        i = recur->sel[i];
+    }
+    sec = recur->secs[i % recur->nsecs];
+    i /= recur->nsecs;
+    min = recur->mins[i % recur->nmins];
+    i /= recur->nmins;
+    hour = recur->hours[i % recur->nhours];
+    i /= recur->nhours;
+    return(recur->days[i]*86400 + hour*3600 + min*60 + sec);
+}
+
+/*expandPeriod
+*
+* Purpose: To find the dates of a period of the rule (days, and times of day), and the
+*          period to expand after it. A period of less than a day that is not in the rule
+*          skips the periods up to the next day, hour or minute that can be.
+*
+* Arguments: The iterator (CalRecur*) and the no. of the period (long)
+*
+* Returns: 1, or 0 if the period starts after the window, UNTIL or the year 9999
+********************************************************************************************/
+static int expandPeriod(CalRecur *recur, long k)
+{
+    RecurRule *rule;
+    long first, last, wall, day, step, skipTo;
+    int year, mon, mday, secOfDay, weekYear;
+
+    rule = &recur->rule;
+    recur->ndays = 0;
+    recur->total = 0;
+    recur->npos = 0;
+    recur->pos = 0;
+    recur->period = k + 1;
+    weekYear = 0;
+
+    switch (rule->freq)
+    {
+        case FREQ_YEARLY:
+            year = recur->anchor + k*rule->interval;
+            if (year > 9999)
+            {
+                return(0);
+            }
+            weekYear = year;
+            if (rule->byWeekNo.given)
+            {
+                first = week1Start(year,rule->wkst);
+                last = week1Start(year+1,rule->wkst) - 1;
+            }
+            else
+            {
+                first = calDaysFromCivil(year,1,1);
+                last = calDaysFromCivil(year+1,1,1) - 1;
+            }
+            break;
+        case FREQ_MONTHLY:
+            first = recur->anchor + k*rule->interval;
+            year = floorDiv(first,12);
+            mon = first - year*12 + 1;
+            if (year > 9999)
+            {
+                return(0);
+            }
+            first = calDaysFromCivil(year,mon,1);
+            last = first + calDaysInMonth(year,mon) - 1;
+            break;
+        case FREQ_WEEKLY:
+            first = recur->anchor + 7*k*rule->interval;
+            last = first + 6;
+            break;
+        case FREQ_DAILY:
+            first = recur->anchor + k*rule->interval;
+            last = first;
+            break;
+        default:
+            //Hourly, minutely or secondly: one hour, minute or second of a day
+            step = rule->interval * (rule->freq == FREQ_HOURLY ? 3600 : rule->freq == FREQ_MINUTELY ? 60 : 1);
+            wall = recur->anchor + k*step;
+            if (wall > recur->limitWall)
+            {
+                return(0);
+            }
+            day = floorDiv(wall,86400);
+            secOfDay = wall - day*86400;
+            skipTo = 0;
+            if (!dayMatches(rule,day,0))
+            {
+                skipTo = (day+1)*86400;
+            }
+            else if (rule->byHour.given && !testBit(rule->byHour.pos,secOfDay/3600))
+            {
+                skipTo = day*86400 + (secOfDay/3600 + 1)*3600;
+            }
+            else if (rule->freq != FREQ_HOURLY && rule->byMinute.given &&
+                     !testBit(rule->byMinute.pos,secOfDay/60%60))
+            {
+                skipTo = wall - secOfDay%60 + 60;
+            }
+            else if (rule->freq == FREQ_SECONDLY && rule->bySecond.given &&
+                     !testBit(rule->bySecond.pos,secOfDay%60))
+            {
+                skipTo = wall + 1;
+            }
+            if (skipTo != 0)
+            {
+                recur->period = k + (skipTo - wall + step - 1) / step;
+                return(1);
+            }
+
+            recur->days[0] = day;
+            recur->ndays = 1;
+            recur->hours[0] = secOfDay / 3600;
+            if (rule->freq != FREQ_HOURLY)
+            {
+                recur->mins[0] = secOfDay / 60 % 60;
+            }
+            if (rule->freq == FREQ_SECONDLY)
+            {
+                recur->secs[0] = secOfDay % 60;
+            }
+            first = day;
+            last = day;
+            break;
+    }
+
+    if (rule->freq >= FREQ_DAILY)
+    {
+        calCivilFromDays(first,&year,&mon,&mday);
+        if (first*86400 > recur->limitWall || year > 9999)
+        {
+            return(0);
+        }
+        for (day = first; day <= last; day++)
+        {
+            if (dayMatches(rule,day,weekYear))
+            {
+                recur->days[recur->ndays] = day;
+                recur->ndays += 1;
+            }
+        }
+    }
+
+    recur->total = recur->ndays * recur->nhours * recur->nmins * recur->nsecs;
+    recur->npos = recur->total;
+    if (rule->bySetPos.given)
+    {
+        selectPositions(recur);
+        recur->npos = recur->nsel;
+    }
+    return(1);
+}
+
+/*periodOf
+*
+* Purpose: To find the no. of the period of the rule that holds a wall time.
+*
+* Arguments: The iterator (const CalRecur*) and the wall time (long)
+*
+* Returns: The no. of the period (negative before DTSTART's)
+********************************************************************************************/
+static long periodOf(const CalRecur *recur, long wall)
+{
+    const RecurRule *rule;
+    long day;
+    int year, mon, mday;
+
+    rule = &recur->rule;
+    day = floorDiv(wall,86400);
+    calCivilFromDays(day,&year,&mon,&mday);
+    switch (rule->freq)
+    {
+        case FREQ_YEARLY:
+            return(floorDiv(year - recur->anchor,rule->interval));
+        case FREQ_MONTHLY:
+            return(floorDiv(year*12L + mon - 1 - recur->anchor,rule->interval));
+        case FREQ_WEEKLY:
+            return(floorDiv(floorDiv(day - recur->anchor,7),rule->interval));
+        case FREQ_DAILY:
+            return(floorDiv(day - recur->anchor,rule->interval));
+        case FREQ_HOURLY:
+            return(floorDiv(wall - recur->anchor,rule->interval*3600));
+        case FREQ_MINUTELY:
+            return(floorDiv(wall - recur->anchor,rule->interval*60));
+        default:
+            return(floorDiv(wall - recur->anchor,rule->interval));
+    }
+}
+
+/*datesPerPeriod
+*
+* Purpose: To find the number of dates every period of the rule has, if they all have the
+*          same number: no BY rule part limits some periods more than others, and every
+*          BYMONTHDAY is in every month.
+*
+* Arguments: The iterator (CalRecur*), with the times of day of its rule set
+*
+* Returns: The number, or -1 if it differs from period to period
+********************************************************************************************/
+static long datesPerPeriod(CalRecur *recur)
+{
+    const RecurRule *rule;
+    const RecurList *monthDay;
+    long days, per;
+    int shortMonths;
+
+    rule = &recur->rule;
+    monthDay = &rule->byMonthDay;
+    //Days 29..31 and -29..-31 are not in every month; days from both ends may coincide
+    shortMonths = testBit(monthDay->pos,29) || testBit(monthDay->pos,30) || testBit(monthDay->pos,31) ||
+                  testBit(monthDay->neg,29) || testBit(monthDay->neg,30) || testBit(monthDay->neg,31) ||
+                  (countBits(monthDay->pos) > 0 && countBits(monthDay->neg) > 0);
+
+    switch (rule->freq)
+    {
+        case FREQ_YEARLY:
+            if (rule->byWeekNo.given || rule->byYearDay.given || rule->hasDay ||
+                !monthDay->given || shortMonths)
+            {
+                return(-1);
+            }
+            days = (countBits(monthDay->pos) + countBits(monthDay->neg)) *
+                   (rule->byMonth.given ? countBits(rule->byMonth.pos) : 12);
+            break;
+        case FREQ_MONTHLY:
+            if (rule->byMonth.given || rule->byYearDay.given || rule->hasDay ||
+                !monthDay->given || shortMonths)
+            {
+                return(-1);
+            }
+            days = countBits(monthDay->pos) + countBits(monthDay->neg);
+            break;
+        case FREQ_WEEKLY:
+            if (rule->byMonth.given || monthDay->given || rule->byYearDay.given)
+            {
+                return(-1);
+            }
+            days = 0;
+            for (int w = 0; w < 7; w++)
+            {
+                days += testBit(rule->byDay[w].pos,0);
+            }
+            break;
+        default:
+            if (rule->byMonth.given || monthDay->given || rule->byYearDay.given || rule->hasDay ||
+                (rule->freq <= FREQ_HOURLY && rule->byHour.given) ||
+                (rule->freq <= FREQ_MINUTELY && rule->byMinute.given) ||
+                (rule->freq == FREQ_SECONDLY && rule->bySecond.given))
+            {
+                return(-1);
+            }
+            days = 1;
+            break;
+    }
+
+    recur->total = days * recur->nhours * recur->nmins * recur->nsecs;
+    per = recur->total;
+    if (rule->bySetPos.given)
+    {
+        selectPositions(recur);
+        per = recur->nsel;
+    }
+    return(per);
+}
+
+/*decodeRule
+*
+* Purpose: To decode an RRULE ("FREQ=MONTHLY;BYDAY=1FR;UNTIL=20091203T220000Z") and prepare
+*          the iterator to expand it from the first period that can reach the window.
+*          Parts the rule lacks default to DTSTART's, as RFC 5545 says.
+*
+* Arguments: The iterator (CalRecur*), with its DTSTART, zone, duration and window set,
+*            and the rule (const char*)
+********************************************************************************************/
+static void decodeRule(CalRecur *recur, const char *rrule)
+{
+    const char *freqs[] = {"","SECONDLY","MINUTELY","HOURLY","DAILY","WEEKLY","MONTHLY","YEARLY"};
+    RecurRule *rule;
+    const char *part, *value, *end;
+    char *next;
+    CalTime until;
+    long wall, startDay, n, per, first, limit, fromWall;
+    int wday, nth;
+
+    rule = &recur->rule;
+    memset(rule,0,sizeof(RecurRule));
+    rule->interval = 1;
+    rule->until = CAL_RECUR_LAST;
+    rule->wkst = 1;
+
+    //Read NAME=VALUE parts
+    for (part = rrule; part != NULL && *part != '\0'; part = end == NULL ? NULL : end + 1)
+    {
+        end = strchr(part,';');
+        value = strchr(part,'=');
+        if (value == NULL || (end != NULL && value > end))
+        {
+            continue;
+        }
+        value += 1;
+
+        if (strncmp(part,"FREQ=",5) == 0)
+        {
+            for (int i = FREQ_SECONDLY; i <= FREQ_YEARLY; i++)
+            {
+                if (strncmp(value,freqs[i],strlen(freqs[i])) == 0)
+                {
+                    rule->freq = i;
+                }
+            }
+        }
+        else if (strncmp(part,"INTERVAL=",9) == 0)
+        {
+            rule->interval = strtol(value,NULL,10);
+        }
+        else if (strncmp(part,"COUNT=",6) == 0)
+        {
+            rule->count = strtol(value,NULL,10);
+        }
+        else if (strncmp(part,"UNTIL=",6) == 0 && parseCalTime(value,&until) == OK)
+        {
+            if (until.zone == CAL_UTC)
+            {
+                rule->until = calWallSeconds(&until);
+            }
+            else
+            {
+                //a DATE lasts until the end of the day
+                wall = calWallSeconds(&until) + (until.dateOnly ? 86399 : 0);
+                rule->until = toInstant(recur,&wall);
+            }
+        }
+        else if (strncmp(part,"WKST=",5) == 0 && weekdayCode(value) >= 0)
+        {
+            rule->wkst = weekdayCode(value);
+        }
+        else if (strncmp(part,"BYSECOND=",9) == 0)
+        {
+            readList(value,&rule->bySecond,0,60);
+        }
+        else if (strncmp(part,"BYMINUTE=",9) == 0)
+        {
+            readList(value,&rule->byMinute,0,59);
+        }
+        else if (strncmp(part,"BYHOUR=",7) == 0)
+        {
+            readList(value,&rule->byHour,0,23);
+        }
+        else if (strncmp(part,"BYMONTH=",8) == 0)
+        {
+            readList(value,&rule->byMonth,1,12);
+        }
+        else if (strncmp(part,"BYMONTHDAY=",11) == 0)
+        {
+            readList(value,&rule->byMonthDay,-31,31);
+        }
+        else if (strncmp(part,"BYYEARDAY=",10) == 0)
+        {
+            readList(value,&rule->byYearDay,-366,366);
+        }
+        else if (strncmp(part,"BYWEEKNO=",9) == 0)
+        {
+            readList(value,&rule->byWeekNo,-53,53);
+        }
+        else if (strncmp(part,"BYSETPOS=",9) == 0)
+        {
+            readList(value,&rule->bySetPos,-366,366);
+        }
+        else if (strncmp(part,"BYDAY=",6) == 0)
+        {
+            //[+|-][n]weekday, e.g. MO, 1FR, -1SU
+            for (;;)
+            {
+                n = strtol(value,&next,10);
+                wday = weekdayCode(next);
+                if (wday >= 0 && n >= -53 && n <= 53)
+                {
+                    rule->hasDay = 1;
+                    rule->byDay[wday].given = 1;
+                    if (n >= 0)
+                    {
+                        setBit(rule->byDay[wday].pos,n);
+                    }
+                    else
+                    {
+                        setBit(rule->byDay[wday].neg,-n);
+                    }
+                }
+                value = strchr(next,',');
+                if (value == NULL || (end != NULL && value > end))
+                {
+                    break;
+                }
+                value += 1;
+            }
+        }
+    }
+    if (rule->freq == FREQ_NONE || rule->interval < 1 || rule->count < 0)
+    {
+        recur->ruleDone = 1;
+        return;
+    }
+    recur->forever = rule->count == 0 && rule->until == CAL_RECUR_LAST;
+
+    //BYWEEKNO is only for yearly rules; n-th weekdays only for monthly and yearly ones
+    //(within the month if the rule has BYMONTH, and not with BYWEEKNO)
+    if (rule->freq != FREQ_YEARLY)
+    {
+        rule->byWeekNo.given = 0;
+    }
+    rule->nthInMonth = rule->freq == FREQ_MONTHLY || rule->byMonth.given;
+    nth = rule->freq == FREQ_MONTHLY || (rule->freq == FREQ_YEARLY && !rule->byWeekNo.given);
+    for (int w = 0; w < 7 && !nth; w++)
+    {
+        if (rule->byDay[w].given)
+        {
+            memset(&rule->byDay[w],0,sizeof(RecurList));
+            rule->byDay[w].given = 1;
+            setBit(rule->byDay[w].pos,0);
+        }
+    }
+
+    //Days the rule does not name are DTSTART's
+    startDay = floorDiv(recur->startWall,86400);
+    if (!rule->byWeekNo.given && !rule->byYearDay.given && !rule->byMonthDay.given && !rule->hasDay)
+    {
+        switch (rule->freq)
+        {
+            case FREQ_YEARLY:
+                if (!rule->byMonth.given)
+                {
+                    rule->byMonth.given = 1;
+                    setBit(rule->byMonth.pos,recur->dtstart.mon);
+                }
+                rule->byMonthDay.given = 1;
+                setBit(rule->byMonthDay.pos,recur->dtstart.mday);
+                break;
+            case FREQ_MONTHLY:
+                rule->byMonthDay.given = 1;
+                setBit(rule->byMonthDay.pos,recur->dtstart.mday);
+                break;
+            case FREQ_WEEKLY:
+                rule->hasDay = 1;
+                rule->byDay[calWeekday(startDay)].given = 1;
+                setBit(rule->byDay[calWeekday(startDay)].pos,0);
+                break;
+            default:
+                break;
+        }
+    }
+
+    //Times of day: those of the period itself for parts finer than the frequency
+    recur->nhours = listNumbers(&rule->byHour,23,recur->dtstart.hour,recur->hours);
+    recur->nmins = listNumbers(&rule->byMinute,59,recur->dtstart.min,recur->mins);
+    recur->nsecs = listNumbers(&rule->bySecond,60,recur->dtstart.sec,recur->secs);
+    switch (rule->freq)
+    {
+        case FREQ_YEARLY:
+            recur->anchor = recur->dtstart.year;
+            break;
+        case FREQ_MONTHLY:
+            recur->anchor = recur->dtstart.year*12L + recur->dtstart.mon - 1;
+            break;
+        case FREQ_WEEKLY:
+            recur->anchor = startDay - (calWeekday(startDay) - rule->wkst + 7) % 7;
+            break;
+        case FREQ_DAILY:
+            recur->anchor = startDay;
+            break;
+        case FREQ_HOURLY:
+            recur->anchor = floorDiv(recur->startWall,3600)*3600;
+            recur->nhours = 1;
+            break;
+        case FREQ_MINUTELY:
+            recur->anchor = floorDiv(recur->startWall,60)*60;
+            recur->nhours = 1;
+            recur->nmins = 1;
+            break;
+        default:
+            recur->anchor = recur->startWall;
+            recur->nhours = 1;
+            recur->nmins = 1;
+            recur->nsecs = 1;
+            break;
+    }
+
+    //No period starting after the window or UNTIL can have an occurrence
+    limit = recur->to < rule->until ? recur->to : rule->until;
+    recur->limitWall = limit + RECUR_SLACK;
+    recur->emitted = 1;
+
+    //With COUNT, the occurrences skipped must be counted, which needs as many in every period
+    per = (rule->count > 0) ? datesPerPeriod(recur) : 0;
+    recur->skips = per >= 0;
+
+    //Start from the period before the one that holds the start of the window; only a local
+    //or TZID wall time is not a fixed offset from its instant
+    fromWall = recur->from - recur->endWall - recur->endExact;
+    if (recur->mode == ZONE_FIXED)
+    {
+        fromWall += recur->offset;
+    }
+    else if (recur->mode != ZONE_UTC)
+    {
+        fromWall -= RECUR_SLACK;
+    }
+    first = periodOf(recur,fromWall) - 1;
+    if (first < 2)
+    {
+        return;
+    }
+    if (rule->count > 0)
+    {
+        if (per < 0)
+        {
+            return;
+        }
+        expandPeriod(recur,0);
+        for (long i = 0; i < recur->npos; i++)
+        {
+            if (wallAt(recur,i) > recur->startWall)
+            {
+                recur->emitted += 1;
+            }
+        }
+        recur->emitted += (first - 1) * per;
+        if (recur->emitted >= rule->count)
+        {
+            recur->ruleDone = 1;
+            return;
+        }
+    }
+    recur->period = first;
+    recur->npos = 0;
+    recur->pos = 0;
+}
+
+/*nextRule
+*
+* Purpose: To find the rule's next occurrence that can overlap the window.
+*
+* Arguments: The iterator (CalRecur*); the occurrence is put in its next
+*
+* Returns: 1 if there was one, 0 if the rule has no more
+********************************************************************************************/
+static int nextRule(CalRecur *recur)
+{
+    long wall;
+
+    while (!recur->ruleDone)
+    {
+        if (recur->pos >= recur->npos)
+        {
+            if (recur->budget == 0 || !expandPeriod(recur,recur->period))
+            {
+                recur->ruleDone = 1;
+            }
+            else if (recur->budget > 0)
+            {
+                recur->budget -= 1;
+            }
+            continue;
+        }
+        wall = wallAt(recur,recur->pos);
+        recur->pos += 1;
+
+        //DTSTART is among the dates; the rule's dates before it do not count
+        if (wall <= recur->startWall)
+        {
+            continue;
+        }
+        if ((recur->rule.count > 0 && recur->emitted >= recur->rule.count) || wall > recur->limitWall)
+        {
+            recur->ruleDone = 1;
+            break;
+        }
+        recur->emitted += 1;
+        if (wall + recur->endWall + recur->endExact + RECUR_SLACK < recur->from)
+        {
+            continue;
+        }
+
+        setOccurrence(recur,wall,&recur->next);
+        if (recur->next.start.t > recur->rule.until)
+        {
+            recur->ruleDone = 1;
+            break;
+        }
+        return(1);
+    }
+    return(0);
+}
+
+/*addDate
+*
+* Purpose: To add DTSTART or an RDATE to the dates of the iterator, if it overlaps the window.
+*
+* Arguments: The iterator (CalRecur*) and the date (const RecurDate*)
+********************************************************************************************/
+static void addDate(CalRecur *recur, const RecurDate *date)
+{
+    if (date->start.t > recur->to || date->end.t < recur->from)
+    {
+        return;
+    }
+    recur->dates = realloc(recur->dates,sizeof(RecurDate)*(recur->ndates+1));
+    assert(recur->dates != NULL);
+    recur->dates[recur->ndates] = *date;
+    recur->ndates += 1;
+}
+
+/*readDates
+*
+* Purpose: To add the dates of an RDATE (DATE, DATE-TIME or PERIOD values) to the iterator,
+*          or the instants or days of an EXDATE to its exclusions.
+*
+* Arguments: The iterator (CalRecur*) and the property (const CalProp*)
+********************************************************************************************/
+static void readDates(CalRecur *recur, const CalProp *prop)
+{
+    RecurDate date;
+    CalTime end;
+    const char *value, *period;
+    long days, secs;
+
+    for (value = prop->value; value != NULL && *value != '\0'; value = strchr(value,','))
+    {
+        if (*value == ',')
+        {
+            value += 1;
+        }
+        if (parseCalTime(value,&date.start) != OK)
+        {
+            continue;
+        }
+        resolveDate(recur,prop,&date.start);
+
+        if (prop->kind == PROP_EXDATE)
+        {
+            if (date.start.dateOnly)
+            {
+                recur->exclDays = realloc(recur->exclDays,sizeof(long)*(recur->nexclDays+1));
+                assert(recur->exclDays != NULL);
+                recur->exclDays[recur->nexclDays] = calDaysFromCivil(date.start.year,date.start.mon,date.start.mday);
+                recur->nexclDays += 1;
+            }
+            else
+            {
+                recur->excl = realloc(recur->excl,sizeof(time_t)*(recur->nexcl+1));
+                assert(recur->excl != NULL);
+                recur->excl[recur->nexcl] = date.start.t;
+                recur->nexcl += 1;
+            }
+            continue;
+        }
+
+        //A PERIOD ends at its own end or after its duration; other dates last as DTSTART does
+        date.end = date.start;
+        period = strpbrk(value,"/,");
+        if (period != NULL && *period == '/' && parseCalTime(period+1,&end) == OK)
+        {
+            resolveDate(recur,prop,&end);
+            date.end = end;
+        }
+        else if (period != NULL && *period == '/' && readDuration(period+1,&days,&secs))
+        {
+            date.end.t += days*86400 + secs;
+            calTimeFromWall(calWallSeconds(&date.start) + days*86400 + secs,&date.end);
+        }
+        else if (recur->endWall != 0 || recur->endExact != 0)
+        {
+            date.end.t += recur->endWall + recur->endExact;
+            calTimeFromWall(calWallSeconds(&date.start) + recur->endWall + recur->endExact,&date.end);
+        }
+        addDate(recur,&date);
+    }
+}
+
+/*newRecur
+*
+* Purpose: To allocate an iterator over a series starting at DTSTART, with an empty rule.
+*
+* Arguments: DTSTART (const CalTime*) and the window (time_t, time_t)
+*
+* Returns: The iterator
+********************************************************************************************/
+static CalRecur *newRecur(const CalTime *dtstart, time_t from, time_t to)
+{
+    CalRecur *recur;
+
+    recur = malloc(sizeof(CalRecur));
+    assert(recur != NULL);
+    memset(recur,0,sizeof(CalRecur));
+    recur->dtstart = *dtstart;
+    recur->startWall = calWallSeconds(dtstart);
+    recur->from = from;
+    recur->to = to;
+    recur->ruleDone = 1;
+    recur->budget = -1;
+    recur->rule.until = CAL_RECUR_LAST;
+    recur->dates = NULL;
+    recur->excl = NULL;
+    recur->exclDays = NULL;
+    return(recur);
+}
+
+int isCalRecurring( const CalComp *comp )
+{
+    for (CalProp *prop = comp->prop; prop != NULL; prop = prop->next)
+    {
+        if (prop->kind == PROP_RRULE || prop->kind == PROP_RDATE)
+        {
+            return(1);
+        }
+    }
+    return(0);
+}
+
+CalRecur *InitializeCalRecur( const CalComp *comp, CalTzCache *zones, time_t from, time_t to )
+{
+    CalRecur *recur;
+    CalProp *prop, *dtstart, *dtend, *duration;
+    const char *rrule;
+    RecurDate first;
+    long days, secs;
+
+    dtstart = NULL;
+    dtend = NULL;
+    duration = NULL;
+    rrule = NULL;
+    for (prop = comp->prop; prop != NULL; prop = prop->next)
+    {
+        switch (prop->kind)
+        {
+            case PROP_DTSTART:
+                dtstart = dtstart == NULL && prop->date != NULL ? prop : dtstart;
+                break;
+            case PROP_DTEND: case PROP_DUE:
+                dtend = dtend == NULL && prop->date != NULL ? prop : dtend;
+                break;
+            case PROP_DURATION:
+                duration = duration == NULL ? prop : duration;
+                break;
+            case PROP_RRULE:
+                rrule = rrule == NULL ? prop->value : rrule;
+                break;
+            default:
+                break;
+        }
+    }
+    if (dtstart == NULL)
+    {
+        return(NULL);
+    }
+
+    recur = newRecur(dtstart->date,from,to);
+    recur->zones = zones;
+    recur->mode = ZONE_LOCAL;
+    if (dtstart->date->zone == CAL_UTC)
+    {
+        recur->mode = ZONE_UTC;
+    }
+    else if (dtstart->date->zone == CAL_TZID && zones != NULL &&
+             getCalPropTzid(dtstart,recur->tzid,sizeof(recur->tzid)))
+    {
+        recur->tz = findCalTz(zones,recur->tzid,dtstart->date->year+1);
+        recur->mode = recur->tz != NULL ? ZONE_TZ : ZONE_LOCAL;
+        recur->tzEnd = calDaysFromCivil(dtstart->date->year+2,1,1)*86400;
+    }
+
+    //An occurrence lasts as long as DTSTART's; DTEND in another zone is an exact duration
+    if (dtend != NULL && dtend->date->t > dtstart->date->t)
+    {
+        if (dtend->date->zone == dtstart->date->zone)
+        {
+            recur->endWall = calWallSeconds(dtend->date) - recur->startWall;
+        }
+        else
+        {
+            recur->endExact = dtend->date->t - dtstart->date->t;
+        }
+    }
+    else if (dtend == NULL && duration != NULL && readDuration(duration->value,&days,&secs) &&
+             days >= 0 && secs >= 0)
+    {
+        recur->endWall = days*86400;
+        recur->endExact = secs;
+    }
+
+    //DTSTART keeps the instant it was read as
+    setOccurrence(recur,recur->startWall,&first);
+    first.start = *dtstart->date;
+    if (recur->endWall == 0 && recur->endExact == 0)
+    {
+        first.end = first.start;
+    }
+    addDate(recur,&first);
+
+    for (prop = comp->prop; prop != NULL; prop = prop->next)
+    {
+        if (prop->kind == PROP_RDATE || prop->kind == PROP_EXDATE)
+        {
+            readDates(recur,prop);
+        }
+    }
+    //a window without DTSTART or an RDATE, or no EXDATE, leaves a list NULL, which qsort
+    //must not be given even to sort nothing
+    if (recur->ndates > 0)
+    {
+        qsort(recur->dates,recur->ndates,sizeof(RecurDate),&compareDates);
+    }
+    if (recur->nexcl > 0)
+    {
+        qsort(recur->excl,recur->nexcl,sizeof(time_t),&compareInstants);
+    }
+    if (recur->nexclDays > 0)
+    {
+        qsort(recur->exclDays,recur->nexclDays,sizeof(long),&comparePositions);
+    }
+
+    if (rrule != NULL)
+    {
+        recur->ruleDone = 0;
+        decodeRule(recur,rrule);
+    }
+    return(recur);
+}
+
+CalRecur *InitializeCalRecurRule( const char *rrule, const CalTime *dtstart, long offset, time_t from, time_t to )
+{
+    CalRecur *recur;
+    RecurDate first;
+
+    recur = newRecur(dtstart,from,to);
+    recur->mode = ZONE_FIXED;
+    recur->offset = offset;
+
+    setOccurrence(recur,recur->startWall,&first);
+    addDate(recur,&first);
+
+    recur->ruleDone = 0;
+    decodeRule(recur,rrule);
+    return(recur);
+}
+
+int nextCalRecur( CalRecur *recur, CalTime *start, CalTime *end )
+{
+    RecurDate date;
+    long day;
+
+    for (;;)
+    {
+        if (!recur->pending)
+        {
+            recur->pending = nextRule(recur);
+        }
+
+        //Merge the rule's occurrences with DTSTART and the RDATEs; an instant comes once
+        if (recur->dateAt < recur->ndates &&
+            (!recur->pending || recur->dates[recur->dateAt].start.t <= recur->next.start.t))
+        {
+            date = recur->dates[recur->dateAt];
+            recur->dateAt += 1;
+            if (recur->pending && date.start.t == recur->next.start.t)
+            {
+                recur->pending = 0;
+            }
+        }
+        else if (recur->pending)
+        {
+            date = recur->next;
+            recur->pending = 0;
+        }
+        else
+        {
+            return(0);
+        }
+
+        if (date.start.t > recur->to || date.end.t < recur->from)
+        {
+            continue;
+        }
+        if (recur->nexcl > 0 &&
+            bsearch(&date.start.t,recur->excl,recur->nexcl,sizeof(time_t),&compareInstants) != NULL)
+        {
+            continue;
+        }
+        day = calDaysFromCivil(date.start.year,date.start.mon,date.start.mday);
+        if (recur->nexclDays > 0 &&
+            bsearch(&day,recur->exclDays,recur->nexclDays,sizeof(long),&comparePositions) != NULL)
+        {
+            continue;
+        }
+
+        *start = date.start;
+        if (end != NULL)
+        {
+            *end = date.end;
+        }
+        return(1);
+    }
+}
+
+int spanCalRecur( const CalComp *comp, CalTzCache *zones, CalTime *first, CalTime *last )
+{
+    CalRecur *recur;
+    CalTime start, end;
+    time_t lo, hi, mid;
+    int walk;
+
+    recur = InitializeCalRecur(comp,zones,CAL_RECUR_FIRST,CAL_RECUR_LAST);
+    if (recur == NULL || recur->forever)
+    {
+        freeCalRecur(recur);
+        return(0);
+    }
+
+    //A rule that must be stepped through to reach a window is walked once, up to a limit
+    walk = !recur->ruleDone && !recur->skips;
+    if (walk)
+    {
+        recur->budget = RECUR_MAX_WALK;
+    }
+    if (!nextCalRecur(recur,first,&end))
+    {
+        freeCalRecur(recur);
+        return(0);
+    }
+    *last = (end.t > first->t) ? end : *first;
+    if (walk)
+    {
+        while (nextCalRecur(recur,&start,&end))
+        {
+            *last = (end.t > last->t) ? end : *last;
+            *last = (start.t > last->t) ? start : *last;
+        }
+        freeCalRecur(recur);
+        return(1);
+    }
+    freeCalRecur(recur);
+
+    //Otherwise the latest end is the latest instant whose window still holds an occurrence;
+    //nothing ends after hi, so each window stops there
+    lo = last->t;
+    hi = CAL_RECUR_LAST;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo + 1)/2;
+        recur = InitializeCalRecur(comp,zones,mid,hi);
+        if (nextCalRecur(recur,&start,&end))
+        {
+            lo = mid;
+            *last = (end.t > start.t) ? end : start;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+        freeCalRecur(recur);
+    }
+    return(1);
+}
+
+int isCalRecurBounded( const CalRecur *recur )
+{
+    return(!recur->forever);
+}
+
+void freeCalRecur( CalRecur *recur )
+{
+    if (recur == NULL)
+    {
+        return;
+    }
+    free(recur->dates);
+    free(recur->excl);
+    free(recur->exclDays);
+    free(recur);
+}
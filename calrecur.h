@@ -0,0 +1,103 @@
+/********
+* calrecur.h -- Public interface for the recurrence functions in calrecur.c
+*
+* Expands the RRULE, RDATE and EXDATE properties of a component into the occurrences
+* that fall inside a window of time, one at a time.
+*
+********/
+
+#ifndef CALRECUR_H
+#define CALRECUR_H
+
+#include "calutil.h"
+#include "caltz.h"
+
+#define CAL_RECUR_FIRST ((time_t)-62135596800) // 0001-01-01T00:00:00Z, the earliest start of a window
+#define CAL_RECUR_LAST ((time_t)253402300799)  // 9999-12-31T23:59:59Z, the latest end of a window
+
+/* Iterator over the occurrences of a component in a window.
+   Defined in calrecur.c; create with InitializeCalRecur or InitializeCalRecurRule. */
+typedef struct CalRecur CalRecur;
+
+/*isCalRecurring
+*
+* Purpose: To find whether a component has more than one occurrence, i.e. an RRULE or RDATE.
+*
+* Arguments: The component (const CalComp*)
+*
+* Returns: 1 if it has, 0 otherwise
+********************************************************************************************/
+int isCalRecurring( const CalComp *comp );
+
+/*InitializeCalRecur
+*
+* Purpose: To start iterating over the occurrences of a component (RFC 5545 3.8.5): its
+*          DTSTART, the dates of its RRULE and RDATEs, less its EXDATEs. Only the occurrences
+*          that overlap the window are generated, and a window far from DTSTART is reached
+*          without stepping through the series, so the cost is proportional to the number
+*          of occurrences inside the window (but see the note on COUNT in calrecur.c).
+*          Occurrences are in DTSTART's timezone; a second RRULE is not followed.
+*
+* Arguments: The component (const CalComp*), the timezones of its calendar (CalTzCache*;
+*            NULL reads TZID-qualified times as local time), and the window: the first and
+*            last instant an occurrence may touch (time_t, see CAL_RECUR_FIRST/CAL_RECUR_LAST)
+*
+* Returns: The iterator (free with freeCalRecur), or NULL if the component has no DTSTART
+********************************************************************************************/
+CalRecur *InitializeCalRecur( const CalComp *comp, CalTzCache *zones, time_t from, time_t to );
+
+/*InitializeCalRecurRule
+*
+* Purpose: To start iterating over the dates of a bare RRULE whose DTSTART is at a fixed
+*          offset from UTC, such as the onsets of a VTIMEZONE observance.
+*
+* Arguments: The rule (const char*), DTSTART (const CalTime*), its offset in seconds east of
+*            UTC (long), and the window (time_t, time_t)
+*
+* Returns: The iterator (free with freeCalRecur)
+********************************************************************************************/
+CalRecur *InitializeCalRecurRule( const char *rrule, const CalTime *dtstart, long offset, time_t from, time_t to );
+
+/*nextCalRecur
+*
+* Purpose: To step to the next occurrence, in order of start.
+*
+* Arguments: The iterator (CalRecur*), and the addresses of the start and end of the
+*            occurrence to set (CalTime*; end may be NULL). The end is the start plus the
+*            component's DTEND, DUE or DURATION, or the start if it has none.
+*
+* Returns: 1 if there was another occurrence, 0 at the end of the window or the series
+********************************************************************************************/
+int nextCalRecur( CalRecur *recur, CalTime *start, CalTime *end );
+
+/*spanCalRecur
+*
+* Purpose: To find when a series that ends by itself begins and ends: the start of its first
+*          occurrence and the latest end of one. The last is found by a binary search over
+*          windows, each reached by arithmetic, rather than by stepping through the series;
+*          a rule with COUNT whose periods differ in size is stepped through, but no further
+*          than RECUR_MAX_WALK periods (see calrecur.c), which gives the last one found.
+*
+* Arguments: The component and the timezones of its calendar, as for InitializeCalRecur, and
+*            the addresses of the first and last instant to set (CalTime*, CalTime*)
+*
+* Returns: 1 if they were set, 0 if the component has no DTSTART, no occurrence, or an RRULE
+*          that repeats forever
+********************************************************************************************/
+int spanCalRecur( const CalComp *comp, CalTzCache *zones, CalTime *first, CalTime *last );
+
+/*isCalRecurBounded
+*
+* Purpose: To find whether a series ends by itself: it has no RRULE, or one with COUNT or UNTIL.
+*
+* Returns: 1 if it ends, 0 if its RRULE repeats forever
+********************************************************************************************/
+int isCalRecurBounded( const CalRecur *recur );
+
+/*freeCalRecur
+*
+* Purpose: To free an iterator returned by InitializeCalRecur or InitializeCalRecurRule.
+********************************************************************************************/
+void freeCalRecur( CalRecur *recur );
+
+#endif
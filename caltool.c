@@ -8,23 +8,101 @@
 *
 ********/
 #include "caltool.h"
-
-/*findCalNumbers
-*
-* Purpose: To search through a populated CalComp, find the number of components, the number
-*          of events, todos and 'other' components that make up the CalComp's components, and
-*          and total number of subcomponents.
-*
-*
-* Arguments:   - A CalStatus struct (Calstatus).
-*              - An initalized CalInfo Struct (CalInfo)
-*
-*
-* Post-Conditions: - The information from the CalComp struct will be counted and the totals
-*                    will be stored in the CalInfo Struct.
+#include "calrecur.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#define CAL_EVENT_SLOTS 16  // smallest array of events allocated (see eventSlots)
+#define CAL_RADIX_MIN 256   // fewest events sortEvents sorts by radix rather than with qsort
+#define CAL_MAX_OCCURRENCES 100000  // most occurrences of one recurring event listed (see addEvent)
+#define CAL_COPY_SIZE 65536  // bytes copyOutput moves at a time
+
+/* An event and its sort key, for the radix sort of sortEvents */
+typedef struct CalEventKey {
+    uint64_t key;       // start, with the sign bit flipped so keys sort as unsigned
+    CalEvent *event;
+} CalEventKey;
+
+typedef struct CalIndexPoint {  // date of a top level component
+    time_t t;
+    int comp;           // no. of the component in the calendar
+} CalIndexPoint;
+
+typedef struct CalIndexRecur {  // recurring top level component, or subcomponent of one
+    int comp;
+    const CalComp *sub;
+} CalIndexRecur;
+
+struct CalIndex {
+    const CalComp *cal;
+    CalTzCache *zones;      // for the occurrences of recurring components
+    int npoints[2];         // events [0] and to-dos [1]
+    CalIndexPoint *points[2];   // sorted by instant
+    int nrecur[2];
+    CalIndexRecur *recur[2];
+    char *found;            // scratch: 1 for each component already found by a query
+    char *dated;            // 1 for each component with a date property, parsed or not
+};
+
+/* Distinct strings (organizer or X-property names), each copied once however often it is
+   added: an open addressing hash table with linear probing */
+typedef struct CalStringSet {
+    int count;          // no. of strings
+    int size;           // no. of slots, a power of two (0 before the first string)
+    char **slot;        // the strings, or NULL for an empty slot
+    unsigned *hash;     // hash of each slot's string
+} CalStringSet;
+
+/* A top level event or to-do being added to a CalIndex (see indexSubComp) */
+typedef struct CalIndexWalk {
+    CalIndex *index;
+    int kind;           // 0 for events, 1 for to-dos
+    int n;              // no. of the component in the calendar
+} CalIndexWalk;
+
+/* State of calFilterStream between components */
+typedef struct CalFilterStream {
+    FILE *icsfile;
+    CalCompKind kind;       // COMP_VEVENT or COMP_VTODO
+    time_t from, to;        // range of dates (see filterRange)
+    int anyDate;            // no range: any date property keeps a component
+    CalTzCache *zones;      // for the occurrences of recurring components
+    int nkept;              // no. of components written
+    CalProp *lastProp;      // last property of the VCALENDAR written (NULL before the first component)
+    CalStatus stat;         // of the writes
+} CalFilterStream;
+
+/* State of calExtractStream between components */
+typedef struct CalExtractStream {
+    CalOpt kind;
+    CalTzCache *zones;
+    CalInfo top;            // events of top level VEVENTs, or the X-property names found
+    CalStringSet xprops;    // X-property names found so far
+    CalInfo nested;         // events of VEVENTs inside other components
+    CalInfo dates;          // earliest and latest dates so far
+    int ndeferred;          // no. of components listed at the end
+    CalComp **deferred;     // components with a VEVENT that recurs forever
+    int *topAt, *nestedAt;  // where the events of each belong in top and nested
+} CalExtractStream;
+
+/*findCalInfo
+*
+* Purpose: To gather what calInfo reports in one walk over a populated CalComp: the number
+*          of components and of the events, todos and 'other' components among them, the
+*          total number of their subcomponents, the number of properties, the earliest and
+*          latest dates (as findEarlyAndLateTimes finds them) and the organizers' common names.
+*
+* Arguments:   - A populated CalComp (const CalComp *)
+*              - An initalized CalInfo Struct (CalInfo *)
+*              - The timezones of the calendar (CalTzCache *)
+*              - The set to add the organizers' common names to (CalStringSet *)
+*
+* Post-Conditions: - The totals and dates will be stored in the CalInfo struct, and the
+*                    common names added to the set.
 *
 ********************************************************************************************/
-static void findCalNumbers(const CalComp *comp,CalInfo *info);
+static void findCalInfo(const CalComp *comp,CalInfo *info,CalTzCache *zones,CalStringSet *orgs);
 
 /*findEarlyAndLateTimes
 *
@@ -34,34 +112,47 @@ static void findCalNumbers(const CalComp *comp,CalInfo *info);
 *
 * Arguments:   - A CalStatus struct (Calstatus).
 *              - An initalized CalInfo Struct (CalInfo)
+*              - The timezones of the calendar (CalTzCache *)
 *
 *
 * Post-Conditions: - The earliest and latest dates will be stored in the
-*                    provided CalInfo struct
+*                    provided CalInfo struct. Every occurrence of an event, to-do or
+*                    journal entry whose recurrence ends (COUNT or UNTIL) counts.
 *                  - If no times are found, the contents of info will be unchanged. 
 *
 ********************************************************************************************/
-static void findEarlyAndLateTimes(const CalComp *comp,CalInfo *info);
+static void findEarlyAndLateTimes(const CalComp *comp,CalInfo *info,CalTzCache *zones);
 
-/*findOrganizers
+/*noteDate
 *
-* Purpose: To search through a populated CalComp, find all of the Organizers,
-*          and populates the 'orgs' field of a CalInfo struct with an array of
-*          the organizer's common names and the 'norgs' field with the number
-*          of common names stored.
+* Purpose: To update the earliest and latest dates of a CalInfo with a date; the first
+*          date found is kept if two are at the same instant.
 *
+* Arguments:   - An initalized CalInfo Struct (CalInfo *)
+*              - The date (const CalTime *)
+********************************************************************************************/
+static void noteDate(CalInfo *info,const CalTime *date);
+
+/*noteRecurrence
 *
-* Arguments:   - A CalStatus struct (Calstatus).
-*              - An initalized CalInfo Struct (CalInfo)
+* Purpose: To update the earliest and latest dates of a CalInfo with the first and last
+*          occurrence of an event, to-do or journal entry whose recurrence ends (COUNT or
+*          UNTIL), as spanCalRecur finds them.
 *
+* Arguments:   - The component (const CalComp *)
+*              - An initalized CalInfo Struct (CalInfo *)
+*              - The timezones of the calendar (CalTzCache *)
+********************************************************************************************/
+static void noteRecurrence(const CalComp *comp,CalInfo *info,CalTzCache *zones);
+
+/*noteOrganizer
 *
-* Post-Conditions: - The array of the organizer's common names will be stored in
-*                    the 'orgs' field of the CalInfo struct and the 'norgs' field will
-*                    store the number of common names in the 'orgs' array.
-*                  - If no organizers are found, the contents of info will be unchanged. 
+* Purpose: To add the common names (CN) of an ORGANIZER property to a set.
 *
+* Arguments:   - The property (const CalProp *)
+*              - The set (CalStringSet *)
 ********************************************************************************************/
-static void findOrganizers(const CalComp *comp,CalInfo *info);
+static void noteOrganizer(const CalProp *prop,CalStringSet *orgs);
 
 /*findEvents
 *
@@ -72,86 +163,117 @@ static void findOrganizers(const CalComp *comp,CalInfo *info);
 *
 * Arguments:   - A CalStatus struct (Calstatus).
 *              - An initalized CalInfo Struct (CalInfo)
+*              - The timezones of the calendar (CalTzCache *)
+*              - The last instant to list the occurrences of a never-ending recurrence to (time_t)
 *
 *
 * Post-Conditions: - An array of CalEvents will be stored in the 'events' field
 *                    of the CalInfo struct and the 'nevents' field will store the number 
-*                    of events in the 'events' array.
+*                    of events in the 'events' array. A recurring event is stored once
+*                    for each of its occurrences.
 *                  - If no events are found, the contents of info will be unchanged. 
 *
 ********************************************************************************************/
-static void findEvents(const CalComp *comp,CalInfo *info);
+static void findEvents(const CalComp *comp,CalInfo *info,CalTzCache *zones,time_t horizon);
 
 /*findXprops
 *
-* Purpose: To search through a populated CalComp, find all of it's X-properties,
-*          populates the 'xprops' field of a CalInfo struct and the 'nxprops'
-*          field with the number of xprops stored.
-*
+* Purpose: To search through a populated CalComp and add the name of each of its
+*          X-properties, and of those of its subcomponents, to a set.
 *
-* Arguments:   - A CalStatus struct (Calstatus).
-*              - An initalized CalInfo Struct (CalInfo)
 *
-*
-* Post-Conditions: - The 'xprops' field of the CalInfo will be populated and the 'nxprops'
-*                    field will hold the number of xprops found.
-*                  - If no xprops are found, the contents of info will be unchanged. 
+* Arguments:   - A populated CalComp (const CalComp *)
+*              - The set (CalStringSet *)
 *
 ********************************************************************************************/
-static void findXprops(const CalComp *comp,CalInfo *info);
+static void findXprops(const CalComp *comp,CalStringSet *xprops);
 
-/*expandStringArray
-*
-* Purpose: To add a string to an array of strings.
+/*InitializeCalStringSet
 *
-* Arguments: - An array of strings (char **).
-*            - An allocated string to add to the array (char *).
-*            - the address of an integer the size of the string array (int*).
+* Purpose: To create an empty set of strings; the table is allocated with the first string.
 *
+* Returns: - The set (CalStringSet)
 *
-* Returns: - The address of an expaned String array
+********************************************************************************************/
+static CalStringSet InitializeCalStringSet();
+
+/*addString
 *
-* Post-Conditions: - A newly allocated string string will be added to the end of the array
-*                    and the integer value will be incremented. 
+* Purpose: To add a copy of a string to a set, unless the set already has it. The table
+*          doubles when it is three quarters full, so each string costs a hash and about
+*          one comparison.
 *
+* Arguments: - The set (CalStringSet *)
+*            - The string (const char *)
 *
 ********************************************************************************************/
-static char** expandStringArray(char ** arr, char *toAdd, int *arrSize);
+static void addString(CalStringSet *set, const char *str);
 
-/*removeFromStringArray
+/*takeStrings
 *
-* Purpose: To remove a string from an array of strings.
+* Purpose: To hand the strings of a set over as an array sorted as compareString orders them
+*          (strings that differ only in case in strcmp order), leaving the set empty.
 *
-* Arguments: - An array of strings (char **).
-*            - The position of the string to be removed (int).
-*            - the address of an integer the size of the string array (int*).
+* Arguments: - The set (CalStringSet *)
+*            - The address of an integer for the number of strings (int *)
 *
-* Returns: - The address of an expaned String array
+* Returns: - The array, whose strings are freed with it (freeCalInfo does), or NULL if the
+*            set is empty
 *
-* Post-Conditions: - A newly allocated string string will be added to the end of the array
-*                    and the integer value will be decremented. 
+********************************************************************************************/
+static char **takeStrings(CalStringSet *set, int *count);
+
+/*freeCalStringSet
 *
+* Purpose: To free the strings and table of a set, leaving it empty.
 *
 ********************************************************************************************/
-static char** removeFromStringArray(char ** arr, int pos, int *arrSize);
+static void freeCalStringSet(CalStringSet *set);
 
 /*expandCalEventArray
 *
-* Purpose: To add a string to an array of strings.
+* Purpose: To add a copy of an event (its start and summary) to an array of events. The
+*          array has room for eventSlots of its size and doubles when it is full, so the
+*          events already in it are neither copied nor moved.
 *
 * Arguments: - An array of CalEvents (CalEvent **).
 *            - An allocated CalEvent to add to the array (CalEvent *).
-*            - the address of an integer the size of the string array (int*).
+*            - the address of an integer the size of the event array (int*).
 *
 *
 * Returns: - The address of an expaned CalEvent array
 *
-* Post-Conditions: - A newly allocated string string will be added to the end of the array
+* Post-Conditions: - A newly allocated CalEvent will be added to the end of the array
+*                    and the integer value will be incremented.
 *
 *
 ********************************************************************************************/
 static CalEvent **expandCalEventArray(CalEvent ** arr, CalEvent *toAdd, int *arrSize);
 
+/*eventSlots
+*
+* Purpose: To find how many events an array of events has room for: CAL_EVENT_SLOTS, or
+*          the power of two its size rounds up to.
+*
+* Arguments: - The number of events in the array (int)
+*
+* Returns: - The number of events allocated (0 for an empty array)
+*
+********************************************************************************************/
+static int eventSlots(int count);
+
+/*sortEvents
+*
+* Purpose: To sort events by start, keeping events that start together in their order
+*          (as -extract e lists them). Short arrays are sorted with qsort; longer ones by
+*          radix on each event's start, a byte at a time, skipping bytes every start shares.
+*
+* Arguments: - The array of events (CalEvent **)
+*            - The number of events (int)
+*
+********************************************************************************************/
+static void sortEvents(CalEvent **events, int nevents);
+
 /*writeInfo
 *
 * Purpose: To write the contents of a CalStatus Struct not associated to 
@@ -213,6 +335,14 @@ static int writeStringPlur(FILE *const file, int num, char *singular, char *plur
 ********************************************************************************************/
 static int compareString (const void* str1, const void* str2);
 
+/*compareDistinct
+*
+* Purpose: To compare two strings as compareString does, and those that differ only in case
+*          with strcmp, so distinct strings always have one order.
+*
+********************************************************************************************/
+static int compareDistinct(const void* str1, const void* str2);
+
 /*compareDate
 *
 * Purpose: To compare two CalDates based on their starting date.
@@ -227,32 +357,186 @@ static int compareString (const void* str1, const void* str2);
 static int compareDate (const void* date1, const void* date2);
 
 
-/*filter
+/*indexSubComp
+*
+* Purpose: To add the dates of a top level event or to-do, and of its subcomponents of the
+*          same kind, to an index: DTSTART, DTEND, DUE and COMPLETED, and the component
+*          itself if it recurs.
+*
+* Arguments:   - The index (CalIndex *)
+*              - 0 for events, 1 for to-dos (int)
+*              - The number of the top level component (int)
+*              - The component, or one of its subcomponents (const CalComp *)
+*
+********************************************************************************************/
+static void indexSubComp(CalIndex *index,int kind,int n,const CalComp *comp);
+
+/*indexSubVisit / indexSubDates
+*
+* Purpose: indexSubComp's callbacks (see walkCalComp): subcomponents of another kind are
+*          skipped, and the dates of the others added once their own subcomponents' are.
+*
+********************************************************************************************/
+static CalVisit indexSubVisit(const CalComp *comp,int depth,void *data);
+static CalVisit indexSubDates(const CalComp *comp,int depth,void *data);
+
+/*comparePoint
+*
+* Purpose: To compare two dates of an index by instant, then by component (for qsort and the
+*          binary search of queryCalIndex).
+*
+* Returns: - -1, 0 or 1 as point1 comes before, with or after point2
+********************************************************************************************/
+static int comparePoint(const void *point1,const void *point2);
+
+/*compareInt
+*
+* Purpose: To compare two ints (for qsort).
+*
+* Returns: - -1, 0 or 1 as int1 is less than, equal to or greater than int2
+********************************************************************************************/
+static int compareInt(const void *int1,const void *int2);
+
+/*filterRange
+*
+* Purpose: To turn calFilter's datefrom and dateto into the first and last instant of a range:
+*          no upper bound if dateto is 0, and no bounds at all if both are 0.
+*
+* Arguments:   - The lower and upper bound dates (time_t, time_t)
+*              - The addresses of the first and last instant to set (time_t *, time_t *)
+*
+********************************************************************************************/
+static void filterRange(time_t datefrom,time_t dateto,time_t *from,time_t *to);
+
+/*occursInRange
+*
+* Purpose: To find whether a recurring component has an occurrence starting or ending in a range.
+*
+* Arguments:   - The component (const CalComp *)
+*              - The timezones of the calendar (CalTzCache *)
+*              - The first and last instant of the range (time_t, time_t)
+*
+* Returns: - 1 if it has, 0 otherwise
+********************************************************************************************/
+static int occursInRange(const CalComp *comp,CalTzCache *zones,time_t from,time_t to);
+
+/*inFilterRange
+*
+* Purpose: To decide, the way queryCalIndex does, whether calFilter keeps a top level event or
+*          to-do: a DTSTART, DTEND, DUE or COMPLETED in range, in it or its subcomponents of the
+*          same kind, or an occurrence of one of them in range. With no range, any of those
+*          properties keeps it, even one whose date could not be read.
+*
+* Arguments:   - The component (const CalComp *)
+*              - COMP_VEVENT or COMP_VTODO (CalCompKind)
+*              - The first and last instant of the range (time_t, time_t)
+*              - 1 if there is no range (int)
+*              - The timezones of the calendar (CalTzCache *)
+*
+* Returns: - 1 if it is kept, 0 otherwise
+********************************************************************************************/
+static int inFilterRange(const CalComp *comp,CalCompKind kind,time_t from,time_t to,int anyDate,CalTzCache *zones);
+
+/*filterStreamComp / filterStreamEnd
+*
+* Purpose: calFilterStream's callbacks (see CalStreamCallbacks). The VCALENDAR and its
+*          properties are written before the first component kept, and its END after the last.
+*
+********************************************************************************************/
+static CalError filterStreamComp(CalComp **const pcomp,const CalComp *cal,void *data);
+static CalError filterStreamEnd(const CalComp *cal,void *data);
+
+/*extractStreamComp / extractStreamEnd
+*
+* Purpose: calExtractStream's callbacks (see CalStreamCallbacks). Events and X-property names
+*          are collected in the order findEvents and findXprops would find them in the whole
+*          tree. A component with a VEVENT that recurs forever is kept until the end, when the
+*          calendar's latest date (the last one to list it to) is known.
+*
+********************************************************************************************/
+static CalError extractStreamComp(CalComp **const pcomp,const CalComp *cal,void *data);
+static CalError extractStreamEnd(const CalComp *cal,void *data);
+
+/*addEvent
+*
+* Purpose: To add an event to a CalInfo: once, or once for each occurrence if it recurs
+*          (up to horizon if it recurs forever). A series is cut off after CAL_MAX_OCCURRENCES
+*          occurrences, and counted in the CalInfo's cut.
+*
+* Arguments:   - The VEVENT (const CalComp *)
+*              - An initalized CalInfo Struct (CalInfo *)
+*              - The timezones of the calendar (CalTzCache *)
+*              - The last instant to list the occurrences of a never-ending recurrence to (time_t)
+*
+********************************************************************************************/
+static void addEvent(const CalComp *comp,CalInfo *info,CalTzCache *zones,time_t horizon);
+
+/*recursForever
+*
+* Purpose: To find whether a component, or any component inside it, is a VEVENT whose
+*          recurrence has no end.
+*
+* Returns: - 1 if so, 0 otherwise
+********************************************************************************************/
+static int recursForever(const CalComp *comp,CalTzCache *zones);
+
+/*moveEvents
+*
+* Purpose: To move the events of one CalInfo to another, at a position of its array (e.g.
+*          nevents for the end). The first CalInfo is left empty.
+*
+* Arguments:   - The CalInfo to move to (CalInfo *)
+*              - The position (int)
+*              - The CalInfo to move from (CalInfo *)
+*
+********************************************************************************************/
+static void moveEvents(CalInfo *into,int at,CalInfo *from);
+
+/*discardOutput
+*
+* Purpose: To take back what a stream tool wrote before an error, when the output is a file
+*          that can be truncated (a pipe keeps it).
+*
+* Arguments:   - The output (FILE *)
+*              - Its offset before the tool ran, or -1 if it cannot be truncated (off_t)
+*
+********************************************************************************************/
+static void discardOutput(FILE *file,off_t start);
+
+/*copyOutput
+*
+* Purpose: To copy what a stream tool wrote to a temporary file to its output.
+*
+* Arguments:   - The temporary file (FILE *)
+*              - The output (FILE *)
+*              - The status of the tool's writes (CalStatus)
+*
+* Returns: - That status, or with a code of IOERR if the copy failed
+********************************************************************************************/
+static CalStatus copyOutput(FILE *from,FILE *to,CalStatus stat);
+
+/*outputStart
 *
-* Purpose: To filter a CalComp structure down to only values specified by CalOpt and between
-*          datefrom and dateto.
+* Purpose: To find where a stream tool starts writing, for discardOutput.
 *
-* Arguments:   - a pointer to a CalComp (CalComp*)
-*              - A CalOpt containg either 'OEVENT' or 'OTODO'. (CalOpt)
-*              - The lower bound date. (datefrom)
-*              - The upper bound date. (dateto)
+* Arguments:   - The output (FILE *)
 *
+* Returns: - Its offset if it is a regular file, -1 otherwise
 ********************************************************************************************/
-static void filter(CalComp *comp, CalOpt opt,time_t datefrom,time_t dateto);
+static off_t outputStart(FILE *file);
 
-/*filterSubComp
+/*openCalInput
 *
-* Purpose: To Determine wether or not a CalComponent needs to be filtered based on CalOpt, dateto and datefrom.
+* Purpose: To create a parser for a calendar read from an open file descriptor (mapped if it is
+*          a regular file), whose components are allocated from arenas and written out again
+*          as they were read (CAL_SOURCE).
 *
-* Arguments:   - a pointer to a CalComp (CalComp*)
-*              - A CalOpt containg either 'OEVENT' or 'OTODO'. (CalOpt)
-*              - The lower bound date. (datefrom)
-*              - The upper bound date. (dateto)
+* Arguments:   - An open file descriptor (int)
+*              - The address of a CalStatus to set to IOERR if the file could not be mapped (CalStatus *)
 *
-* Returns: - 1 if it requires filtering
-*          - 0 if it does not require filtering
+* Returns: - The parser (free with freeCalParser), or NULL
 ********************************************************************************************/
-static int filterSubComp(CalComp *comp, CalOpt opt,time_t datefrom,time_t dateto);
+static CalParser *openCalInput(int fd,CalStatus *stat);
 
 /*writeExtractedKind
 *
@@ -277,17 +561,31 @@ static int filterSubComp(CalComp *comp, CalOpt opt,time_t datefrom,time_t dateto
 ********************************************************************************************/
 static CalStatus writeExtractedKind(FILE *file,CalInfo info,CalOpt kind);
 
+/*readCalInput
+*
+* Purpose: To read a calendar from an open file descriptor (mapped if it is a regular file),
+*          allocating the whole tree from one arena since it is freed all at once. A large
+*          regular file is parsed on one thread per processor, and its components are
+*          written out again as they were read (CAL_SOURCE).
+*
+* Arguments:   - An open file descriptor (int)
+*              - The address of a CalComp pointer to populate (CalComp **)
+*
+* Returns: - The CalStatus of the read (IOERR if the file could not be mapped)
+********************************************************************************************/
+static CalStatus readCalInput(int fd, CalComp **pcomp);
+
 int main (int argc, char *argv[])
 {
     char *flag, *fileName;
-    FILE *openFile;
+    FILE *openFile, *spool;
     CalComp *comp, *fileComp;
+    CalParser *parser;
     CalStatus inStat, stat, fileStat;
+    off_t start;
     CalOpt opt;
-    struct tm *tempTm;
-    time_t datefrom, dateto, t;
+    time_t datefrom, dateto;
     int dtErr;
-    tempTm = NULL;
     comp = NULL;
     dateto = 0;
     datefrom = 0;
@@ -311,7 +609,7 @@ int main (int argc, char *argv[])
             fprintf(stderr,"\n");
             return(EXIT_FAILURE);
         }
-        inStat = readCalFile(stdin,&comp);
+        inStat = readCalInput(fileno(stdin),&comp);
 
         if (inStat.code != OK)
         {
@@ -365,24 +663,24 @@ int main (int argc, char *argv[])
             return(EXIT_FAILURE);
         }
 
-        //read file
-        inStat = readCalFile(stdin,&comp);
-
-        if (inStat.code != OK)
+        //read the file a component at a time
+        parser = openCalInput(fileno(stdin),&inStat);
+        if (parser == NULL)
         {
             printCalError(inStat);
             return(EXIT_FAILURE);
         }
 
-        stat = calExtract(comp,opt,stdout);
+        start = outputStart(stdout);
+        stat = calExtractStream(parser,opt,stdout);
+        freeCalParser(parser);
 
         if (stat.code != OK)
         {
+            discardOutput(stdout,start);
             printCalError(stat);
-            freeCalComp(comp);
             return(EXIT_FAILURE);
         }
-        freeCalComp(comp);
     }
     //FILTER
     else if (strcmp("-filter",flag) == 0)
@@ -409,7 +707,6 @@ int main (int argc, char *argv[])
         }
 
         //Determin timeTo and From,
-        tempTm = malloc(sizeof(struct tm));
         if (argc >= 4) 
         {
             //From must come first if it exists
@@ -417,40 +714,21 @@ int main (int argc, char *argv[])
             {
                 if (argc >= 5)
                 {
-                    //check date for today
-                    if (strcmp(argv[4],"today") == 0)
+                    dtErr = getCalDate(argv[4],0,&datefrom);
+                    if (dtErr == 1)
                     {
-                        t = time(NULL);
-                        *tempTm = *localtime(&t);
-                        
+                        fprintf(stderr,"Problem with DATEMSK environment variable or template file. \n");
+                        return(EXIT_FAILURE);
                     }
-                    else
+                    if (dtErr == 2)
                     {
-                        dtErr = getdate_r(argv[4],tempTm);
-                        assert(dtErr != 6);
-                        if (dtErr >= 1 && dtErr <= 5)
-                        {
-                            fprintf(stderr,"Problem with DATEMSK environment variable or template file. \n");
-                            free(tempTm);
-                            return(EXIT_FAILURE);
-                        }
-                        if (dtErr >= 7 && dtErr <= 8)
-                        {
-                            fprintf(stderr,"The 'from' date  could be be interpreted. \n");
-                            free(tempTm);
-                            return(EXIT_FAILURE);
-                        }
+                        fprintf(stderr,"The 'from' date  could be be interpreted. \n");
+                        return(EXIT_FAILURE);
                     }
-                    tempTm->tm_sec = 0;
-                    tempTm->tm_min = 0;
-                    tempTm->tm_hour = 0;
-                    tempTm->tm_isdst = -1;
-                    datefrom = mktime(tempTm);
                 }
                 else
                 {
                     fprintf(stderr,"ERROR: invalid argument. Syntax is 'from \"date\"'\n");
-                    free(tempTm);
                     return(EXIT_FAILURE);                    
                 }
             }
@@ -458,7 +736,6 @@ int main (int argc, char *argv[])
             else
             {
                 fprintf(stderr,"ERROR: 'from \"date\"' argument must occur first\n");
-                free(tempTm);
                 return(EXIT_FAILURE);
             }
 
@@ -469,41 +746,21 @@ int main (int argc, char *argv[])
             {
                 if (argc >= 7)
                 {
-                    if (strcmp(argv[6],"today") == 0)
+                    dtErr = getCalDate(argv[6],1,&dateto);
+                    if (dtErr == 1)
                     {
-                        t = time(NULL);
-                        *tempTm = *localtime(&t);
-                        
+                        fprintf(stderr,"Problem with DATEMSK environment variable or template file. \n");
+                        return(EXIT_FAILURE);
                     }
-                    else
+                    if (dtErr == 2)
                     {
-                        dtErr = getdate_r(argv[6],tempTm);
-                        assert(dtErr != 6);    
-                        if (dtErr >= 1 && dtErr <= 5)
-                        {
-                            fprintf(stderr,"Problem with DATEMSK environment variable or template file. \n");
-                            free(tempTm);
-                            return(EXIT_FAILURE);
-                        }
-                        if (dtErr >= 7 && dtErr <= 8)
-                        {
-                            fprintf(stderr,"The 'to' date could not be interpreted. \n");
-                            free(tempTm);
-                            return(EXIT_FAILURE);
-                        
-                        }
+                        fprintf(stderr,"The 'to' date could not be interpreted. \n");
+                        return(EXIT_FAILURE);
                     }
-
-                    tempTm->tm_sec = 0;
-                    tempTm->tm_min = 59;
-                    tempTm->tm_hour = 23;
-                    tempTm->tm_isdst = -1;
-                    dateto = mktime(tempTm);   
                 }
                 else
                 {
                     fprintf(stderr,"ERROR: invalid argument. Syntax is 'to \"date\"'\n");
-                    free(tempTm);
                     return(EXIT_FAILURE);
                 }
             }
@@ -511,11 +768,9 @@ int main (int argc, char *argv[])
             else
             {
                 fprintf(stderr,"ERROR: expected 'to \"date\"' argument.\n");
-                free(tempTm);
                 return(EXIT_FAILURE);
             }
         }
-        free(tempTm);
         if (dateto != 0 && datefrom != 0)
         {
             //from is not eariler than to
@@ -526,21 +781,35 @@ int main (int argc, char *argv[])
             }
         }
 
-        inStat = readCalFile(stdin,&comp);
-        if (inStat.code != OK)
+        //read the file a component at a time; what is kept is written as it is read
+        parser = openCalInput(fileno(stdin),&inStat);
+        if (parser == NULL)
         {
             printCalError(inStat);
             return(EXIT_FAILURE);
         }
 
-        stat = calFilter(comp,opt,datefrom,dateto,stdout);
+        //Output that cannot be cut back on an error (a pipe) waits in a temporary file
+        //until the whole calendar has been read and checked
+        start = outputStart(stdout);
+        spool = (start < 0) ? tmpfile() : NULL;
+        stat = calFilterStream(parser,opt,datefrom,dateto,(spool != NULL) ? spool : stdout);
+        freeCalParser(parser);
+
+        if (spool != NULL)
+        {
+            if (stat.code == OK)
+            {
+                stat = copyOutput(spool,stdout,stat);
+            }
+            fclose(spool);
+        }
         if (stat.code != OK)
         {
+            discardOutput(stdout,start);
             printCalError(stat);
-            freeCalComp(comp);
             return(EXIT_FAILURE);
         }
-        freeCalComp(comp);
     }
     //COMBINE
     else if (strcmp("-combine",flag) == 0)
@@ -560,7 +829,7 @@ int main (int argc, char *argv[])
             return(EXIT_FAILURE);
         }
 
-        inStat = readCalFile(stdin,&comp);
+        inStat = readCalInput(fileno(stdin),&comp);
         if (inStat.code != OK)
         {
             fclose(openFile);
@@ -568,7 +837,7 @@ int main (int argc, char *argv[])
             return(EXIT_FAILURE);
         }
 
-        fileStat = readCalFile(openFile,&fileComp);
+        fileStat = readCalInput(fileno(openFile),&fileComp);
         if (fileStat.code != OK)
         {
             fclose(openFile);
@@ -590,6 +859,28 @@ int main (int argc, char *argv[])
     return(EXIT_SUCCESS);
 }
 
+static CalStatus readCalInput(int fd, CalComp **pcomp)
+{
+    CalParser *parser;
+    CalStatus stat;
+
+    *pcomp = NULL;
+    stat = InitializeCalStatus();
+
+    parser = InitializeCalParserFd(fd);
+    if (parser == NULL)
+    {
+        stat.code = IOERR;
+        return(stat);
+    }
+    setCalParserOptions(parser,CAL_ARENA | CAL_SLICES | CAL_SOURCE);
+    setCalParserThreads(parser,0);
+
+    stat = readCalFileEx(parser,pcomp);
+    freeCalParser(parser);
+    return(stat);
+}
+
 CalInfo InitializeCalInfo()
 {
     CalInfo info;
@@ -600,13 +891,13 @@ CalInfo InitializeCalInfo()
     info.subcomps = 0;
     info.todos = 0;
     info.other = 0;
-    info.early = NULL;
-    info.late = NULL;
+    info.dated = 0;
     info.props = 0;
     info.norgs = 0;
     info.orgs = NULL;
     info.nevents = 0;
     info.events = NULL;
+    info.cut = 0;
     info.nxprops = 0;
     info.xprops = NULL;
 
@@ -618,6 +909,7 @@ CalEvent *InitializeCalEvent()
     assert(event != NULL);
 
     event->dateStart = NULL;
+    event->start = 0;
     event->summary = NULL;
     event->org = NULL;
     event->location = NULL;
@@ -648,11 +940,7 @@ CalOrganizer *InitializeCalOrganizer()
 void freeCalInfo(CalInfo *info)
 {
 
-    free(info->early);
-    free(info->late);
-
-    info->early = NULL;
-    info->late = NULL;
+    info->dated = 0;
     //Free Organizers
     for (int i = 0; i < info->norgs; i++)
     {
@@ -703,436 +991,484 @@ void freeCalOrganizer(CalOrganizer *org)
     free(org->contact);
     free(org);
 }
-static void findCalNumbers(const CalComp *comp,CalInfo *info)
+static void findCalInfo(const CalComp *comp,CalInfo *info,CalTzCache *zones,CalStringSet *orgs)
 {
-    CalInfo subInfo;
-    char *name;
-
-    subInfo = InitializeCalInfo();
+    const CalComp *sub;
+    CalProp *tempProp;
+    CalIter iter;
 
-    info->props = comp->nprops;
+    info->props = 0;
     info->comps = comp->ncomps;
 
-    //Loop Through components
-    for (int i = 0; i < comp->ncomps; i++)
+    //Each component before its subcomponents, so the first of equal dates is kept
+    initCalIter(&iter,comp);
+    while ((sub = nextCalComp(&iter)) != NULL)
     {
-        name = comp->comp[i]->name;
-        /*count events, todos and others. These will be 
-          subcomponents in the recursive call*/
-        if (strcmp(name, "VEVENT") == 0)
+        //components are counted by kind at the top level, and in total one level down
+        if (iter.depth == 1)
         {
-            info->nCompEvents += 1;
-        }
-        else if (strcmp(name, "VTODO") == 0)
-        {
-            info->todos += 1;
+            switch (sub->kind)
+            {
+                case COMP_VEVENT:
+                    info->nCompEvents += 1;
+                    break;
+                case COMP_VTODO:
+                    info->todos += 1;
+                    break;
+                default:
+                    info->other += 1;
+            }
+            info->subcomps += sub->ncomps;
         }
-        else
+
+        info->props += sub->nprops;
+        tempProp = sub->prop;
+        while (tempProp != NULL)
         {
-            info->other += 1;
+            switch (tempProp->kind)
+            {
+                //Times (decoded when the file was read)
+                case PROP_DTSTART: case PROP_DTEND: case PROP_DUE: case PROP_COMPLETED:
+                case PROP_LAST_MODIFIED: case PROP_CREATED: case PROP_DTSTAMP:
+                    if (tempProp->date != NULL)
+                    {
+                        noteDate(info,tempProp->date);
+                    }
+                    break;
+                case PROP_ORGANIZER:
+                    noteOrganizer(tempProp,orgs);
+                    break;
+                default:
+                    break;
+            }
+            tempProp = tempProp->next;
         }
-        findCalNumbers(comp->comp[i],&subInfo);
-        info->subcomps += subInfo.comps;
-        info->props += subInfo.props;
+        noteRecurrence(sub,info,zones);
     }
-
-    freeCalInfo(&subInfo);
     return;
 }
-static void findEarlyAndLateTimes(const CalComp *comp,CalInfo *info)
+static void findEarlyAndLateTimes(const CalComp *comp,CalInfo *info,CalTzCache *zones)
 {
-    CalInfo subInfo;
+    const CalComp *sub;
     CalProp *tempProp;
-    char *propName;
+    CalIter iter;
 
-    struct tm tempTm;
-    time_t t, early, late;
+    //Each component's dates before those of its subcomponents, so the first of equal dates is kept
+    initCalIter(&iter,comp);
+    while ((sub = nextCalComp(&iter)) != NULL)
+    {
+        //Go through properties
+        tempProp = sub->prop;
+        while(tempProp != NULL)
+        {
+            switch (tempProp->kind)
+            {
+                //Find Times (decoded when the file was read)
+                case PROP_DTSTART: case PROP_DTEND: case PROP_DUE: case PROP_COMPLETED:
+                case PROP_LAST_MODIFIED: case PROP_CREATED: case PROP_DTSTAMP:
+                    if (tempProp->date != NULL)
+                    {
+                        noteDate(info,tempProp->date);
+                    }
+                    break;
+                default:
+                    break;
+            }
 
-    tempProp = NULL;
-    subInfo = InitializeCalInfo();
+            tempProp = tempProp->next;
+        }
 
+        noteRecurrence(sub,info,zones);
+    }
+    return;
+}
 
-    //Loop Through components
-    for (int i = 0; i < comp->ncomps; i++)
+static void noteDate(CalInfo *info,const CalTime *date)
+{
+    if (!info->dated || date->t < info->early.t)
     {
-        findEarlyAndLateTimes(comp->comp[i],&subInfo);
+        info->early = *date;
     }
-
-    //Go through properties
-    tempProp = comp->prop;
-    while(tempProp != NULL)
+    if (!info->dated || date->t > info->late.t)
     {
-        propName = tempProp->name;
+        info->late = *date;
+    }
+    info->dated = 1;
+}
 
-        //Find Times
-        if (strcmp(propName,"DTSTART") == 0 || strcmp(propName,"DTEND") == 0 ||
-            strcmp(propName,"DUE") == 0 || strcmp(propName,"COMPLETED") == 0 ||
-            strcmp(propName,"LAST-MODIFIED") == 0 || strcmp(propName,"CREATED") == 0 ||
-            strcmp(propName,"DTSTAMP") == 0 )
-        {
-            strptime(tempProp->value,"%Y%m%dT%H%M%S",&tempTm);
-            tempTm.tm_isdst = -1;
+static void noteRecurrence(const CalComp *comp,CalInfo *info,CalTzCache *zones)
+{
+    CalTime first, last;
 
-            t = mktime(&tempTm);
+    if ((comp->kind != COMP_VEVENT && comp->kind != COMP_VTODO && comp->kind != COMP_VJOURNAL) ||
+        !isCalRecurring(comp))
+    {
+        return;
+    }
+    //the first and last occurrence, found without stepping through the series
+    if (spanCalRecur(comp,zones,&first,&last))
+    {
+        noteDate(info,&first);
+        noteDate(info,&last);
+    }
+}
+static void noteOrganizer(const CalProp *prop,CalStringSet *orgs)
+{
+    CalParam *tempParam;
 
-            if(info->early == NULL)
-            {
-                info->early = malloc(sizeof(struct tm));
-                *(info->early) = tempTm;
-            }
-            else
-            {
-                early = mktime(info->early);
-                if (t < early)
-                {
-                    *(info->early) = tempTm;
-                }  
-            }
-            if(info->late == NULL)
+    //Look through Parameters for the organizer's common name
+    tempParam = prop->param;
+    while(tempParam != NULL)
+    {
+        if (strcmp(tempParam->name,"CN") == 0)
+        {
+            for (int j = 0; j < tempParam->nvalues; j++)
             {
-                info->late = malloc(sizeof(struct tm));
-                *(info->late) = tempTm;
+                addString(orgs,tempParam->value[j]);
             }
-            else
+        }
+        tempParam = tempParam->next;
+    }
+}
+
+static void findEvents(const CalComp *comp,CalInfo *info,CalTzCache *zones,time_t horizon)
+{
+    const CalComp *sub;
+    CalIter iter;
+
+    //The events directly inside each component, before those further down
+    initCalIter(&iter,comp);
+    while ((sub = nextCalComp(&iter)) != NULL)
+    {
+        for (int i = 0; i < sub->ncomps; i++)
+        {
+            //extract the comp, if it is an event
+            if (sub->comp[i]->kind == COMP_VEVENT)
             {
-                late = mktime(info->late);
-                if (t > late)
-                {
-                    *(info->late) = tempTm;
-                } 
+                addEvent(sub->comp[i],info,zones,horizon);
             }
         }
-
-        tempProp = tempProp->next;
     }
+    return;
+}
+static void addEvent(const CalComp *comp,CalInfo *info,CalTzCache *zones,time_t horizon)
+{
+    CalEvent *cEvent;
+    CalRecur *recur;
+    CalTime start;
+    int n;
 
-    //update time from recursive call
-    if (subInfo.early != NULL)
-    { 
-        t = mktime(subInfo.early);
-        if(info->early == NULL)
+    cEvent = extractEvent(comp);
+    if (cEvent == NULL)
+    {
+        return;
+    }
+    recur = NULL;
+    if (isCalRecurring(comp))
+    {
+        recur = InitializeCalRecur(comp,zones,CAL_RECUR_FIRST,CAL_RECUR_LAST);
+    }
+    if (recur != NULL)
+    {
+        //One entry for each occurrence; a series that never ends is listed up to horizon
+        if (!isCalRecurBounded(recur))
         {
-
-            info->early = malloc(sizeof(struct tm));
-            *(info->early) = *(subInfo.early);
+            freeCalRecur(recur);
+            recur = InitializeCalRecur(comp,zones,CAL_RECUR_FIRST,horizon);
         }
-        else
+        n = 0;
+        while (nextCalRecur(recur,&start,NULL))
         {
-            early = mktime(info->early);
-            if (t < early)
+            if (n == CAL_MAX_OCCURRENCES)
             {
-                *(info->early) = *(subInfo.early);
-            }  
+                info->cut += 1;
+                break;
+            }
+            calTimeToTm(&start,cEvent->dateStart);
+            cEvent->start = start.t;
+            info->events = expandCalEventArray(info->events,cEvent,&(info->nevents));
+            n += 1;
         }
+        freeCalRecur(recur);
+    }
+    else
+    {
+        info->events = expandCalEventArray(info->events,cEvent,&(info->nevents));
     }
-    if (subInfo.late != NULL)
-    {     
-        t = mktime(subInfo.late);
-        if(info->late == NULL)
+    freeCalEvent(cEvent);
+}
+static int recursForever(const CalComp *comp,CalTzCache *zones)
+{
+    const CalComp *sub;
+    CalRecur *recur;
+    CalIter iter;
+    int forever;
+
+    forever = 0;
+    initCalIter(&iter,comp);
+    while (!forever && (sub = nextCalComp(&iter)) != NULL)
+    {
+        if (sub->kind == COMP_VEVENT && isCalRecurring(sub))
         {
-            info->late = malloc(sizeof(struct tm));
-            *(info->late) = *(subInfo.late);
+            recur = InitializeCalRecur(sub,zones,CAL_RECUR_FIRST,CAL_RECUR_LAST);
+            forever = recur != NULL && !isCalRecurBounded(recur);
+            freeCalRecur(recur);
         }
-        else
+    }
+    endCalIter(&iter);
+    return(forever);
+}
+static void findXprops(const CalComp *comp,CalStringSet *xprops)
+{
+    CalProp *tempProp;
+    CalIter iter;
+
+    //Go through the properties of every component
+    initCalIter(&iter,comp);
+    while((tempProp = nextCalProp(&iter)) != NULL)
+    {
+        //if its an X-property
+        if (tempProp->kind == PROP_X)
         {
-            late = mktime(info->late);
-            if (t > late)
-            {
-                *(info->late) = *(subInfo.late);
-            } 
+            addString(xprops,tempProp->name);
         }
     }
-
-    freeCalInfo(&subInfo);
     return;
 }
-
-static void findOrganizers(const CalComp *comp,CalInfo *info)
+static CalStringSet InitializeCalStringSet()
 {
-    CalInfo subInfo;
-    CalProp *tempProp;
-    CalParam *tempParam;
-    char  *propName, *paramName, *orgName;
+    CalStringSet set;
 
-    tempProp = NULL;
-    tempParam = NULL;
-    subInfo = InitializeCalInfo();
+    set.count = 0;
+    set.size = 0;
+    set.slot = NULL;
+    set.hash = NULL;
+    return(set);
+}
+static void addString(CalStringSet *set, const char *str)
+{
+    char **oldSlot;
+    unsigned *oldHash;
+    unsigned hash;
+    int oldSize, i;
 
-    //Loop Through components
-    for (int i = 0; i < comp->ncomps; i++)
+    //FNV-1a
+    hash = 2166136261u;
+    for (const char *c = str; *c != '\0'; c++)
     {
-        findOrganizers(comp->comp[i],&subInfo);
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
     }
 
-    //Go through properties
-    tempProp = comp->prop;
-    while(tempProp != NULL)
+    //Grow (or create) the table before it is more than three quarters full
+    if ((set->count + 1) * 4 > set->size * 3)
     {
-        propName = tempProp->name;
-
-        //Find Organizers
-        if (strcmp(propName,"ORGANIZER") == 0)
+        oldSlot = set->slot;
+        oldHash = set->hash;
+        oldSize = set->size;
+        set->size = (oldSize == 0) ? 64 : oldSize * 2;
+        set->slot = calloc(set->size,sizeof(char*));
+        set->hash = malloc(sizeof(unsigned)*set->size);
+        assert(set->slot != NULL && set->hash != NULL);
+        for (int j = 0; j < oldSize; j++)
         {
-            //Look through Parameters
-            tempParam = tempProp->param;
-            while(tempParam != NULL)
+            if (oldSlot[j] != NULL)
             {
-                for (int j = 0; j < tempParam->nvalues; j++)
+                i = oldHash[j] & (set->size - 1);
+                while (set->slot[i] != NULL)
                 {
-                    paramName = tempParam->name;
-                    //ORGANIZER's common name
-                    if (strcmp(paramName,"CN") == 0)
-                    {
-                        //Store CN
-                        orgName = malloc(sizeof(char)*strlen(tempParam->value[j]) +1);
-                        assert(orgName != NULL);
-                        strcpy(orgName,tempParam->value[j]);
-                        info->orgs = expandStringArray(info->orgs,orgName,&(info->norgs));
-                        free(orgName);
-                    }
+                    i = (i + 1) & (set->size - 1);
                 }
-             tempParam = tempParam->next;
+                set->slot[i] = oldSlot[j];
+                set->hash[i] = oldHash[j];
             }
-
         }
-        tempProp = tempProp->next;
+        free(oldSlot);
+        free(oldHash);
     }
 
-    //update organizers from recursive call
-    for (int i = 0; i < subInfo.norgs; i++)
+    i = hash & (set->size - 1);
+    while (set->slot[i] != NULL)
     {
-       info->orgs = expandStringArray(info->orgs,subInfo.orgs[i],&(info->norgs));
-
+        if (set->hash[i] == hash && strcmp(set->slot[i],str) == 0)
+        {
+            return;
+        }
+        i = (i + 1) & (set->size - 1);
     }
-
-    freeCalInfo(&subInfo);
-    return; 
+    set->slot[i] = malloc(sizeof(char)*strlen(str)+1);
+    assert(set->slot[i] != NULL);
+    strcpy(set->slot[i],str);
+    set->hash[i] = hash;
+    set->count += 1;
 }
-
-static void findEvents(const CalComp *comp,CalInfo *info)
+static int compareDistinct(const void* str1, const void* str2)
 {
-    CalInfo subInfo;
-    char *compName;
-    CalEvent *cEvent;
+    int cmp;
 
+    cmp = compareString(str1,str2);
+    if (cmp == 0)
+    {
+        cmp = strcmp(*(char**)str1,*(char**)str2);
+    }
+    return(cmp);
+}
+static char **takeStrings(CalStringSet *set, int *count)
+{
+    char **arr;
+    int n;
 
-    cEvent = NULL;
-    subInfo = InitializeCalInfo();
-
-    for (int i = 0; i < comp->ncomps; i++)
+    arr = NULL;
+    if (set->count > 0)
     {
-        compName = comp->comp[i]->name;
-        //extract the comp, if it is an event
-        if (strcmp(compName, "VEVENT") == 0)
+        arr = malloc(sizeof(char*)*set->count);
+        assert(arr != NULL);
+        n = 0;
+        for (int i = 0; i < set->size; i++)
         {
-            cEvent = extractEvent(comp->comp[i]);
-            if (cEvent != NULL)
+            if (set->slot[i] != NULL)
             {
-                info->events = expandCalEventArray(info->events,cEvent,&(info->nevents));
-                freeCalEvent(cEvent);
-                // free(cEvent->dateStart);
-                // free(cEvent->summary);
-                // free(cEvent);
+                arr[n] = set->slot[i];
+                n += 1;
             }
         }
-        findEvents(comp->comp[i],&subInfo);
+        qsort(arr,n,sizeof(char*),&compareDistinct);
     }
-    //update Events from recursive call
-    for (int i = 0; i < subInfo.nevents; i++)
+    *count = set->count;
+
+    //The strings now belong to the array
+    free(set->slot);
+    free(set->hash);
+    *set = InitializeCalStringSet();
+    return(arr);
+}
+static void freeCalStringSet(CalStringSet *set)
+{
+    for (int i = 0; i < set->size; i++)
     {
-       info->events = expandCalEventArray(info->events,subInfo.events[i],&(info->nevents));
+        free(set->slot[i]);
     }
-    freeCalInfo(&subInfo);
-    return;
+    free(set->slot);
+    free(set->hash);
+    *set = InitializeCalStringSet();
 }
-static void findXprops(const CalComp *comp,CalInfo *info)
-{
-    CalInfo subInfo;
-    CalProp *tempProp;
-    char *propName, *xpName;
-
 
-    tempProp = NULL;
-    subInfo = InitializeCalInfo();
+static CalEvent **expandCalEventArray(CalEvent ** arr, CalEvent *toAdd, int *arrSize)
+{
+    CalEvent *cpy;
 
-    //Loop Through components
-    for (int i = 0; i < comp->ncomps; i++)
+    if (*arrSize == eventSlots(*arrSize))
     {
-        findXprops(comp->comp[i],&subInfo);
+        arr = realloc(arr,sizeof(CalEvent*)*eventSlots(*arrSize + 1));
+        assert(arr != NULL);
     }
 
-    //Go through properties
-    tempProp = comp->prop;
-    while(tempProp != NULL)
+    cpy = InitializeCalEvent();
+    if(toAdd->dateStart != NULL)
     {
-        propName = tempProp->name;
-        //if its an X-property
-        if (strncmp(propName,"X-",2) == 0)
-        {
-            //Store Xprop's Name
-            xpName = malloc(sizeof(char)*strlen(tempProp->name) +1);
-            assert(xpName != NULL);
-            strcpy(xpName,tempProp->name);
-            info->xprops = expandStringArray(info->xprops,xpName,&(info->nxprops));
-            free(xpName); 
-        }
-        tempProp = tempProp->next;
+        cpy->dateStart = malloc(sizeof(struct tm));
+        assert(cpy->dateStart != NULL);
+        *(cpy->dateStart) =*(toAdd->dateStart);
     }
+    cpy->start = toAdd->start;
 
-    //update xprops from recursive call
-    for (int i = 0; i < subInfo.nxprops; i++)
-    {
-       info->xprops = expandStringArray(info->xprops,subInfo.xprops[i],&(info->nxprops));
-    }
-    freeCalInfo(&subInfo);
-    return;
-}
-static char** expandStringArray(char ** arr, char *toAdd, int *arrSize)
-{
-    char ** newArr;
-    char *cpy;
-    newArr = malloc(sizeof(char*)*((*arrSize)+1));
-    assert(newArr != NULL);
-    for (int i = 0; i < *arrSize; i++)
+    if (toAdd->summary != NULL)
     {
-        cpy = malloc(sizeof(char)*strlen(arr[i])+1);
-        assert(cpy != NULL);
-
-        strcpy(cpy,arr[i]);
-        free(arr[i]);
-
-        newArr[i] = cpy;
-        cpy = NULL;
+        cpy->summary = malloc(sizeof(char)*strlen(toAdd->summary) + 1);
+        assert(cpy->summary != NULL);
+        strcpy(cpy->summary,toAdd->summary);
     }
-    cpy = malloc(sizeof(char)*strlen(toAdd)+1);
-    assert(cpy != NULL);
+    arr[(*arrSize)] = cpy;
 
-    strcpy(cpy,toAdd);
-    newArr[*arrSize] = cpy;
     *arrSize += 1;
 
-    free(arr);
-    return(newArr);
-
-
+    return(arr);
 }
-static char** removeFromStringArray(char ** arr, int pos, int *arrSize)
+static int eventSlots(int count)
 {
-    char ** newArr;
-    char *cpy;
-    int count;
+    int slots = CAL_EVENT_SLOTS;
 
-    newArr = malloc(sizeof(char*)*((*arrSize)-1));
-    assert(newArr != NULL);
-
-    count = 0;
-    for (int i = 0; i < *arrSize; i++)
+    if (count == 0)
     {
-        if (i == pos)
-        {
-            free(arr[i]);
-        }
-        else
-        {
-            cpy = malloc(sizeof(char)*strlen(arr[i])+1);
-            assert(cpy != NULL);
-
-            strcpy(cpy,arr[i]);
-            free(arr[i]);
-
-            newArr[count] = cpy;
-            cpy = NULL;
-            count += 1;
-        }
+        return(0);
     }
-
-
-    *arrSize -= 1;
-
-    free(arr);
-    return(newArr);
+    while (slots < count)
+    {
+        slots *= 2;
+    }
+    return(slots);
 }
-
-static CalEvent **expandCalEventArray(CalEvent ** arr, CalEvent *toAdd, int *arrSize)
+static void sortEvents(CalEvent **events, int nevents)
 {
-    CalEvent ** newArr;
-    CalEvent *cpy;
-
-    newArr = malloc(sizeof(CalEvent*)*((*arrSize) +1));
-    assert(newArr != NULL);
+    CalEventKey *keys, *sorted, *swap;
+    size_t count[8][256];
+    size_t at;
+    int digit;
 
-    for (int i = 0; i < *arrSize; i++)
+    if (nevents < 2)
     {
+        //nothing to order, and an empty list may be NULL
+        return;
+    }
+    if (nevents < CAL_RADIX_MIN)
+    {
+        qsort(events,nevents,sizeof(CalEvent*),&compareDate);
+        return;
+    }
 
-        cpy = InitializeCalEvent();
+    keys = malloc(sizeof(CalEventKey)*nevents);
+    sorted = malloc(sizeof(CalEventKey)*nevents);
+    assert(keys != NULL && sorted != NULL);
 
-        if(arr[i]->dateStart != NULL)
+    //Each key once, with the counts of its bytes
+    memset(count,0,sizeof(count));
+    for (int i = 0; i < nevents; i++)
+    {
+        keys[i].key = (uint64_t)events[i]->start ^ ((uint64_t)1 << 63);
+        keys[i].event = events[i];
+        for (int b = 0; b < 8; b++)
         {
-            cpy->dateStart = malloc(sizeof(struct tm));
-            assert(cpy->dateStart != NULL);
-            *(cpy->dateStart) = *(arr[i]->dateStart);
-            free(arr[i]->dateStart);
+            count[b][(keys[i].key >> (8*b)) & 0xff] += 1;
         }
-        if (arr[i]->summary != NULL)
+    }
+
+    //Least significant byte first; each pass is stable, so equal starts keep their order
+    for (int b = 0; b < 8; b++)
+    {
+        digit = (keys[0].key >> (8*b)) & 0xff;
+        if (count[b][digit] == (size_t)nevents)
         {
-            cpy->summary = malloc(sizeof(char)*strlen(arr[i]->summary) + 1);
-            assert(cpy->summary != NULL);
-            strcpy(cpy->summary,arr[i]->summary);
-            free(arr[i]->summary);
+            continue;
         }
-        if (arr[i]->location != NULL)
+        at = 0;
+        for (int d = 0; d < 256; d++)
         {
-            cpy->location = malloc(sizeof(char)*strlen(arr[i]->location) + 1);
-            assert(cpy->location != NULL);
-            strcpy(cpy->location,arr[i]->location);
-            free(arr[i]->location);
+            size_t n = count[b][d];
+            count[b][d] = at;
+            at += n;
         }
-        if (arr[i]->org != NULL)
+        for (int i = 0; i < nevents; i++)
         {
-            cpy->org = InitializeCalOrganizer();
-            if (arr[i]->org->name != NULL)
-            {   
-                cpy->org->name = malloc(sizeof(char)*strlen(arr[i]->org->name) + 1);
-                strcpy(cpy->org->name,arr[i]->org->name);
-            }
-            if (arr[i]->org->contact != NULL)
-            {
-                cpy->org->contact = malloc(sizeof(char)*strlen(arr[i]->org->contact) + 1);
-                strcpy(cpy->org->name,arr[i]->org->contact);
-            }
-            free(arr[i]->summary);
+            digit = (keys[i].key >> (8*b)) & 0xff;
+            sorted[count[b][digit]] = keys[i];
+            count[b][digit] += 1;
         }
-        
-        newArr[i] = cpy;
-        free(arr[i]);
-        cpy = NULL;
-    }
-
-    cpy = InitializeCalEvent();
-    if(toAdd->dateStart != NULL)
-    {
-        cpy->dateStart = malloc(sizeof(struct tm));
-        assert(cpy != NULL);
-        *(cpy->dateStart) =*(toAdd->dateStart);
+        swap = keys;
+        keys = sorted;
+        sorted = swap;
     }
 
-    if (toAdd->summary != NULL)
+    for (int i = 0; i < nevents; i++)
     {
-        cpy->summary = malloc(sizeof(char)*strlen(toAdd->summary) + 1);
-        assert(cpy != NULL);
-        strcpy(cpy->summary,toAdd->summary);
+        events[i] = keys[i].event;
     }
-    newArr[(*arrSize)] = cpy;
-
-    *arrSize += 1;
-    free(arr);
-
-    return(newArr);
+    free(keys);
+    free(sorted);
 }
 static CalStatus writeInfo(FILE *const file, CalStatus stat, CalInfo info)
 {
     char t_from[100];
     char t_to[100];
+    struct tm tempTm;
 
     /* x  lines
        x component(s): y event(s), z todo(s), q other(s)
@@ -1187,7 +1523,7 @@ static CalStatus writeInfo(FILE *const file, CalStatus stat, CalInfo info)
     updateLines(&stat);
 
     //time
-    if(info.early == NULL || info.late == NULL)
+    if(!info.dated)
     {
         if(fprintf(file, "No dates\n") < 0)
         {
@@ -1197,8 +1533,10 @@ static CalStatus writeInfo(FILE *const file, CalStatus stat, CalInfo info)
     }
     else
     {
-        strftime(t_from,100,"%Y-%b-%d",info.early);
-        strftime(t_to,100,"%Y-%b-%d",info.late);
+        calTimeToTm(&info.early,&tempTm);
+        strftime(t_from,100,"%Y-%b-%d",&tempTm);
+        calTimeToTm(&info.late,&tempTm);
+        strftime(t_to,100,"%Y-%b-%d",&tempTm);
         if(fprintf(file, "From %s to %s\n",t_from,t_to) < 0)
         {
             stat.code = IOERR;
@@ -1253,59 +1591,47 @@ static CalStatus writeInfo(FILE *const file, CalStatus stat, CalInfo info)
 }
 static int compareString (const void* str1, const void* str2)
 {
-    int cmp, loopLen, len1, len2;
-    char *s1,*s2;
+    const char *s1,*s2;
     char c1,c2;
+    int i;
 
+    s1 = *(char**)str1;
+    s2 = *(char**)str2;
 
-    s1 = toUpper(*(char**)str1);
-    s2 = toUpper(*(char**)str2);
-    cmp = 0;
-
-    len1 = strlen(s1);
-    len2 = strlen(s2);
- 
-    //loop through the smaller length times
-    loopLen = len1;
-    if (loopLen > len2)
-    {
-        loopLen = len2;   
-    }
-
-    //compare each character
-    for (int i = 0; i < loopLen; i++)
+    //compare each character, as uppercase, up to the end of the shorter string
+    for (i = 0; s1[i] != '\0' && s2[i] != '\0'; i++)
     {
         c1 = s1[i];
         c2 = s2[i];
+        if (c1 >= 'a' && c1 <= 'z')
+        {
+            c1 -= 32;
+        }
+        if (c2 >= 'a' && c2 <= 'z')
+        {
+            c2 -= 32;
+        }
 
         if (c1 < c2)
         {
-            cmp = -1;
-            break;
+            return(-1);
         }
         else if(c1 > c2)
         {
-            cmp = 1;
-            break;
+            return(1);
         }
     }
-    free(s1);
-    free(s2);
+
     //if all the letters are the same so far, the smaller string comes first
-    if (cmp == 0)
+    if (s1[i] == '\0' && s2[i] != '\0')
     {
-        if (len1 < len2)
-        {
-            cmp = -1;
-        }
-        else if(len1 > len2)
-        {
-            cmp = 1;
-        } 
+        return(-1);
     }
-    return(cmp);
-
-
+    else if (s1[i] != '\0' && s2[i] == '\0')
+    {
+        return(1);
+    }
+    return(0);
 }
 static int compareDate (const void* date1, const void* date2)
 {
@@ -1321,15 +1647,15 @@ static int compareDate (const void* date1, const void* date2)
     }
     else
     {
-        t1 = mktime(event1->dateStart);
+        t1 = event1->start;
     }
     if (event2 == NULL)
     {
-        t1 = 0;
+        t2 = 0;
     }
     else
     {
-        t2 = mktime(event2->dateStart);  
+        t2 = event2->start;
     }
 
     if (t1 < t2)
@@ -1371,71 +1697,6 @@ static int writeStringPlur(FILE *const file, int num, char *singular, char *plur
 }
 
 
-static int filterSubComp(CalComp *comp, CalOpt opt,time_t datefrom,time_t dateto)
-{
-    CalProp *tempProp;
-    char *name, *propName;
-    struct tm tempTm;
-    time_t t;
-
-    int toRemove = 1;
-    //recursivly call subcomponents
-    for (int i = 0; i < comp->ncomps; i++)
-    {
-        name = comp->comp[i]->name;
-        if(strcmp(name,"VEVENT") == 0 && opt == OEVENT)
-        {
-            toRemove = filterSubComp(comp->comp[i],opt,datefrom,dateto);
-        }
-        else if (strcmp(name,"VTODO") == 0 && opt == OTODO)
-        {
-            toRemove = filterSubComp(comp->comp[i],opt,datefrom,dateto);
-        }
-        //if you dont need to filter, send value back up the recursive calls
-        if (toRemove == 0)
-        {
-            return(toRemove);
-        }
-    }
-           
-    tempProp = comp->prop;
-    while (tempProp != NULL)
-    {
-        propName = tempProp->name;
-        //Find Times. If they fall in range of datefrom to dateto, do not filter
-        if (strcmp(propName,"DTSTART") == 0 || strcmp(propName,"DTEND") == 0 ||
-            strcmp(propName,"DUE") == 0 || strcmp(propName,"COMPLETED") == 0)
-        {
-            strptime(tempProp->value,"%Y%m%dT%H%M%S",&tempTm);
-            tempTm.tm_isdst = -1;
-
-            t = mktime(&tempTm);
-            
-            if (datefrom == 0 && dateto == 0)
-            {
-                toRemove = 0;
-                return(toRemove);
-            }
-            else
-            {
-                //Don't check dateto if not set
-                if (dateto == 0 && t >= datefrom)
-                {
-                    toRemove = 0;
-                    return(toRemove);   
-                }
-                //check between both dates
-                else if( t >= datefrom && t <= dateto)
-                {
-                    toRemove = 0;
-                    return(toRemove);
-                }
-            }
-        }
-        tempProp = tempProp->next;
-    }
-    return(toRemove);
-}
 static CalStatus writeExtractedKind(FILE *file,CalInfo info,CalOpt kind)
 {
     char t[100];
@@ -1473,6 +1734,16 @@ static CalStatus writeExtractedKind(FILE *file,CalInfo info,CalOpt kind)
                 updateLines(&stat);
             }
         }
+        if (info.cut > 0)
+        {
+            if(fprintf(file, "(%d recurring event(s) listed only up to their first %d occurrences)\n",info.cut,CAL_MAX_OCCURRENCES) < 0)
+            {
+                stat.code = IOERR;
+                return(stat);
+            }
+            stat.linefrom += 1;
+            updateLines(&stat);
+        }
     }
 
     //Print X-Props
@@ -1496,43 +1767,20 @@ CalStatus calInfo( const CalComp *comp, int lines, FILE *const txtfile )
 {
     CalStatus stat;
     CalInfo info;
-    int curStrIndex, *remPos;
-    int remCount;
+    CalTzCache *zones;
+    CalStringSet orgs;
+
     info = InitializeCalInfo();
     stat = InitializeCalStatus();
+    orgs = InitializeCalStringSet();
 
-    findCalNumbers(comp,&info);
-    findEarlyAndLateTimes(comp,&info);
-    findOrganizers(comp,&info);
+    zones = InitializeCalTzCache(comp);
+    findCalInfo(comp,&info,zones,&orgs);
+    freeCalTzCache(zones);
     info.lines = lines;
 
-    // Sort and Remove Duplicate organizers
-    if(info.norgs > 0)
-    {
-        qsort(info.orgs,info.norgs,sizeof(char*),&compareString);
-        curStrIndex = 0;
-        remPos = malloc(sizeof(int)*info.norgs);
-        assert(remPos != NULL);
-        remCount = 0;
-        for(int i = 1; i < info.norgs; i++)
-        {
-            if (strcmp(info.orgs[curStrIndex],info.orgs[i]) != 0)
-            {
-                curStrIndex = i;
-            }
-            else
-            {
-                remPos[remCount] = i;
-                remCount += 1;
-            }
-        }
-        for(int i = remCount-1; i >= 0; i--)
-        {
-            info.orgs = removeFromStringArray(info.orgs,remPos[i],&(info.norgs));
-        }
-        free(remPos);
-    }
-
+    // Distinct organizers, sorted
+    info.orgs = takeStrings(&orgs,&info.norgs);
 
     stat = writeInfo(txtfile,stat,info);
 
@@ -1544,49 +1792,30 @@ CalStatus calInfo( const CalComp *comp, int lines, FILE *const txtfile )
 CalStatus calExtract( const CalComp *comp, CalOpt kind, FILE *const txtfile )
 {
     CalStatus stat;
-    CalInfo info;
-    int *remPos;
-    int remCount, curStrIndex;
+    CalInfo info, dates;
+    CalTzCache *zones;
+    CalStringSet xprops;
 
-    curStrIndex = 0;
     info = InitializeCalInfo();
     stat = InitializeCalStatus();
 
     if (kind == OEVENT)
     {
-        findEvents(comp,&info);
-        qsort(info.events,info.nevents,sizeof(CalEvent*),&compareDate);
+        //Events that recur forever are listed up to the calendar's latest date
+        zones = InitializeCalTzCache(comp);
+        dates = InitializeCalInfo();
+        findEarlyAndLateTimes(comp,&dates,zones);
+        findEvents(comp,&info,zones,dates.dated ? dates.late.t : CAL_RECUR_FIRST);
+        freeCalInfo(&dates);
+        freeCalTzCache(zones);
+        sortEvents(info.events,info.nevents);
     }
 
     else if (kind == OPROP)
     {
-        findXprops(comp,&info);
-        //Sort and Remove Duplicate xprops
-        if(info.nxprops > 0)
-        {
-            qsort(info.xprops,info.nxprops,sizeof(char*),&compareString);
-            curStrIndex = 0;
-            remPos = malloc(sizeof(int)*info.nxprops);
-            assert(remPos != NULL);
-            remCount = 0;
-            for(int i = 1; i < info.nxprops; i++)
-            {
-                if (strcmp(info.xprops[curStrIndex],info.xprops[i]) != 0)
-                {
-                    curStrIndex = i;
-                }
-                else
-                {
-                    remPos[remCount] = i;
-                    remCount += 1;
-                }
-            }
-            for(int i = remCount-1; i >= 0; i--)
-            {
-                info.xprops = removeFromStringArray(info.xprops,remPos[i],&(info.nxprops));
-            }
-            free(remPos);
-        }
+        xprops = InitializeCalStringSet();
+        findXprops(comp,&xprops);
+        info.xprops = takeStrings(&xprops,&info.nxprops);
     }
     stat = writeExtractedKind(txtfile,info,kind);
 
@@ -1596,149 +1825,832 @@ CalStatus calExtract( const CalComp *comp, CalOpt kind, FILE *const txtfile )
     return(stat);
 }
 CalStatus calFilter( const CalComp *comp, CalOpt content, time_t datefrom, time_t dateto, FILE *const icsfile )
+{
+    CalStatus stat;
+    CalIndex *index;
+
+    index = InitializeCalIndex(comp);
+    stat = calFilterIndex(index,content,datefrom,dateto,icsfile);
+    freeCalIndex(index);
+
+    return(stat);
+}
+CalStatus calFilterIndex( CalIndex *index, CalOpt content, time_t datefrom, time_t dateto, FILE *const icsfile )
 {
     CalStatus stat;
     CalComp *filComp;
+    const CalComp *comp;
+    int *found;
+    int nfound;
 
     stat = InitializeCalStatus();
+    comp = index->cal;
 
-    filComp = malloc(sizeof(CalComp)+ sizeof(CalComp)*(comp->ncomps));
-    assert(filComp != NULL);
-
-    //Make a shallow Copy of comp
-    filComp->name = comp->name;
-    filComp->nprops = comp->nprops;
-    filComp->prop = comp->prop;
-    filComp->ncomps = comp->ncomps;
+    found = queryCalIndex(index,content,datefrom,dateto,&nfound);
 
-    for (int i = 0; i < comp->ncomps; i++)
+    if(nfound == 0)
     {
-        filComp->comp[i] = comp->comp[i];
+        stat.code = NOCAL;
+        free(found);
+        return(stat);
     }
-    
-
-    filter(filComp,content,datefrom,dateto);
 
-    filComp = realloc(filComp, sizeof(CalComp)+ sizeof(CalComp)*(comp->ncomps));
+    //Make a shallow Copy of comp with the components found
+    filComp = malloc(sizeof(CalComp)+ sizeof(CalComp*)*nfound);
     assert(filComp != NULL);
+    filComp->name = comp->name;
+    filComp->kind = comp->kind;
+    filComp->nprops = comp->nprops;
+    filComp->prop = comp->prop;
+    filComp->arena = NULL;
+    filComp->text = NULL;
+    filComp->textLen = 0;
+    filComp->ncomps = nfound;
 
-    if(filComp->ncomps == 0)
+    for (int i = 0; i < nfound; i++)
     {
-        stat.code = NOCAL;
-        free(filComp); 
-        return(stat);
+        filComp->comp[i] = comp->comp[found[i]];
     }
 
-    stat = writeCalComp(icsfile,filComp);
+    stat = writeCalCompThreads(icsfile,filComp,0);
     free(filComp);
+    free(found);
 
     return(stat);
 }
-CalStatus calCombine( const CalComp *comp1, const CalComp *comp2, FILE *const icsfile )
+CalIndex *InitializeCalIndex( const CalComp *comp )
 {
-    CalStatus stat;
-    CalComp *newComp;
-    CalProp *c2Prodid, *c2Version, *propEnd,*curProp, *prevProp;
-    int pos, prodIdPos, verPos;
+    CalIndex *index;
 
-    pos = 0;
-    prodIdPos = 0;
-    verPos = 0;
+    index = malloc(sizeof(CalIndex));
+    assert(index != NULL);
+    memset(index,0,sizeof(CalIndex));
 
-    stat = InitializeCalStatus();
+    index->cal = comp;
+    index->zones = InitializeCalTzCache(comp);
+    index->found = malloc(comp->ncomps+1);
+    assert(index->found != NULL);
+    memset(index->found,0,comp->ncomps+1);
+    index->dated = malloc(comp->ncomps+1);
+    assert(index->dated != NULL);
+    memset(index->dated,0,comp->ncomps+1);
 
-    newComp = malloc(sizeof(CalComp)+ sizeof(CalComp)*((comp1->ncomps)+(comp2->ncomps)));
-    assert(newComp != NULL);
+    for (int i = 0; i < comp->ncomps; i++)
+    {
+        if (comp->comp[i]->kind == COMP_VEVENT)
+        {
+            indexSubComp(index,0,i,comp->comp[i]);
+        }
+        else if (comp->comp[i]->kind == COMP_VTODO)
+        {
+            indexSubComp(index,1,i,comp->comp[i]);
+        }
+    }
+    for (int k = 0; k < 2; k++)
+    {
+        if (index->npoints[k] > 0)
+        {
+            qsort(index->points[k],index->npoints[k],sizeof(CalIndexPoint),comparePoint);
+        }
+    }
 
-    //Make a shallow Copy of comp
-    newComp->name = comp1->name;
-    newComp->nprops = comp1->nprops;
-    newComp->prop = comp1->prop;
-    newComp->ncomps = comp1->ncomps + comp2->ncomps;
+    return(index);
+}
+int *queryCalIndex( CalIndex *index, CalOpt kind, time_t datefrom, time_t dateto, int *nfound )
+{
+    int *found;
+    CalIndexPoint *points;
+    CalIndexRecur *recur;
+    CalIndexPoint key;
+    time_t from, to;
+    int k, lo, hi, mid;
 
-    for (int i = 0; i < comp1->ncomps; i++)
+    found = malloc(sizeof(int)*(index->cal->ncomps+1));
+    assert(found != NULL);
+    *nfound = 0;
+
+    if (kind == OEVENT)
     {
-        newComp->comp[i] = comp1->comp[i];
+        k = 0;
     }
-    for (int i = 0; i < comp2->ncomps; i++)
+    else if (kind == OTODO)
     {
-        newComp->comp[i+comp1->ncomps] = comp2->comp[i]; 
+        k = 1;
     }
-
-    //Find the end of newComps Property list
-    curProp = newComp->prop;
-    while (curProp != NULL && curProp->next != NULL)
+    else
     {
-        curProp = curProp->next;
+        return(found);
     }
-    propEnd = curProp;
 
-    //Unlink comp2s ProdID and Version from new comp's properties    
-    propEnd->next = comp2->prop;
-    prevProp = propEnd;
-    curProp = comp2->prop;
-    while (curProp != NULL)
+    //No range: every component with a date property, whether or not its date could be read
+    if (datefrom == 0 && dateto == 0)
     {
-        pos += 1;
-        if (strcmp(curProp->name,"PRODID") == 0)
-        {
-            prodIdPos = pos - 1;
-            c2Prodid = curProp;
-            prevProp->next = curProp->next;
-            curProp = curProp->next;
-            c2Prodid->next = NULL;
-            continue;
-        }
-        else if (strcmp(curProp->name,"VERSION") == 0)
+        for (int i = 0; i < index->cal->ncomps; i++)
         {
-            verPos = pos - 1;
-            c2Version = curProp;
-            prevProp->next = curProp->next;
-            curProp = curProp->next;
-            c2Version->next = NULL;
-            continue;
+            if (index->dated[i] && index->cal->comp[i]->kind == ((k == 0) ? COMP_VEVENT : COMP_VTODO))
+            {
+                found[*nfound] = i;
+                *nfound += 1;
+            }
         }
-        prevProp = curProp;
-        curProp = curProp->next;
+        return(found);
     }
 
-    //Add properties 
+    filterRange(datefrom,dateto,&from,&to);
 
+    points = index->points[k];
 
-
-    stat = writeCalComp(icsfile,newComp);
-
-    propEnd->next = NULL;
-    //reLink Comp2
-    pos = 1;
-    curProp = comp2->prop;
-    while (curProp != NULL)
+    //first date at or after from
+    key.t = from;
+    key.comp = -1;
+    lo = 0;
+    hi = index->npoints[k];
+    while (lo < hi)
     {
-        if (pos == verPos)
+        mid = lo + (hi - lo)/2;
+        if (comparePoint(&points[mid],&key) < 0)
         {
-            c2Version->next = curProp->next;
-            curProp->next = c2Version;
+            lo = mid + 1;
         }
-        else if (pos == prodIdPos)
+        else
         {
-            c2Prodid->next = curProp->next;
-            curProp->next = c2Prodid;
+            hi = mid;
+        }
+    }
+    for (int i = lo; i < index->npoints[k] && points[i].t <= to; i++)
+    {
+        if (!index->found[points[i].comp])
+        {
+            index->found[points[i].comp] = 1;
+            found[*nfound] = points[i].comp;
+            *nfound += 1;
         }
-        pos += 1;
-        curProp = curProp->next;
     }
 
-    free(newComp);
-    return(stat);
-}
-
-void printCalError(CalStatus stat)
-{
+    //Recurring components whose dates did not match: look for an occurrence in range
+    recur = index->recur[k];
+    for (int i = 0; i < index->nrecur[k]; i++)
+    {
+        if (!index->found[recur[i].comp] && occursInRange(recur[i].sub,index->zones,from,to))
+        {
+            index->found[recur[i].comp] = 1;
+            found[*nfound] = recur[i].comp;
+            *nfound += 1;
+        }
+    }
 
-    //Error on one line
-    if (stat.linefrom == stat.lineto)
+    //back to calendar order, and clear the scratch marks
+    qsort(found,*nfound,sizeof(int),compareInt);
+    for (int i = 0; i < *nfound; i++)
     {
-        fprintf(stderr,"Error on line %d.\n",stat.lineto);
+        index->found[found[i]] = 0;
+    }
+
+    return(found);
+}
+void freeCalIndex( CalIndex *index )
+{
+    if (index == NULL)
+    {
+        return;
+    }
+    for (int k = 0; k < 2; k++)
+    {
+        free(index->points[k]);
+        free(index->recur[k]);
+    }
+    freeCalTzCache(index->zones);
+    free(index->found);
+    free(index->dated);
+    free(index);
+}
+CalStatus calFilterStream( CalParser *const parser, CalOpt content, time_t datefrom, time_t dateto, FILE *const icsfile )
+{
+    CalFilterStream filter;
+    CalStreamCallbacks callbacks;
+    CalStatus stat;
+
+    filter.icsfile = icsfile;
+    filter.kind = (content == OTODO) ? COMP_VTODO : COMP_VEVENT;
+    filterRange(datefrom,dateto,&filter.from,&filter.to);
+    filter.anyDate = (datefrom == 0 && dateto == 0);
+    filter.zones = NULL;
+    filter.nkept = 0;
+    filter.lastProp = NULL;
+    filter.stat = InitializeCalStatus();
+
+    callbacks.data = &filter;
+    callbacks.header = NULL;
+    callbacks.comp = filterStreamComp;
+    callbacks.end = filterStreamEnd;
+
+    stat = readCalStream(parser,&callbacks);
+    freeCalTzCache(filter.zones);
+
+    //A write error, or nothing to write (as calFilter reports it)
+    if (filter.stat.code != OK)
+    {
+        return(filter.stat);
+    }
+    if (stat.code == OK && filter.nkept == 0)
+    {
+        stat = InitializeCalStatus();
+        stat.code = NOCAL;
+    }
+    return(stat);
+}
+CalStatus calExtractStream( CalParser *const parser, CalOpt kind, FILE *const txtfile )
+{
+    CalExtractStream extract;
+    CalStreamCallbacks callbacks;
+    CalStatus stat;
+
+    extract.kind = kind;
+    extract.zones = NULL;
+    extract.top = InitializeCalInfo();
+    extract.xprops = InitializeCalStringSet();
+    extract.nested = InitializeCalInfo();
+    extract.dates = InitializeCalInfo();
+    extract.ndeferred = 0;
+    extract.deferred = NULL;
+    extract.topAt = NULL;
+    extract.nestedAt = NULL;
+
+    callbacks.data = &extract;
+    callbacks.header = NULL;
+    callbacks.comp = extractStreamComp;
+    callbacks.end = extractStreamEnd;
+
+    stat = readCalStream(parser,&callbacks);
+    if (stat.code == OK)
+    {
+        stat = writeExtractedKind(txtfile,extract.top,kind);
+    }
+
+    for (int i = 0; i < extract.ndeferred; i++)
+    {
+        if (extract.deferred[i] != NULL)
+        {
+            freeCalComp(extract.deferred[i]);
+        }
+    }
+    free(extract.deferred);
+    free(extract.topAt);
+    free(extract.nestedAt);
+    freeCalInfo(&extract.top);
+    freeCalStringSet(&extract.xprops);
+    freeCalInfo(&extract.nested);
+    freeCalInfo(&extract.dates);
+    freeCalTzCache(extract.zones);
+    return(stat);
+}
+static CalError filterStreamComp(CalComp **const pcomp,const CalComp *cal,void *data)
+{
+    CalFilterStream *filter;
+    CalProp *tempProp;
+    CalStatus stat;
+
+    filter = data;
+    if ((*pcomp)->kind != filter->kind)
+    {
+        return(OK);
+    }
+    if (filter->zones == NULL)
+    {
+        filter->zones = InitializeCalTzCache(cal);
+    }
+    updateCalTzCache(filter->zones,cal);
+    if (!inFilterRange(*pcomp,filter->kind,filter->from,filter->to,filter->anyDate,filter->zones))
+    {
+        return(OK);
+    }
+
+    //The VCALENDAR and the properties read so far come first
+    if (filter->nkept == 0)
+    {
+        stat = writeCalCompHead(filter->icsfile,cal);
+        filter->stat.linefrom += stat.linefrom;
+        for (tempProp = cal->prop; tempProp != NULL; tempProp = tempProp->next)
+        {
+            filter->lastProp = tempProp;
+        }
+        if (stat.code != OK)
+        {
+            filter->stat.code = stat.code;
+            updateLines(&filter->stat);
+            return(stat.code);
+        }
+    }
+
+    stat = writeCalComp(filter->icsfile,*pcomp);
+    filter->stat.linefrom += stat.linefrom;
+    filter->nkept += 1;
+    if (stat.code != OK)
+    {
+        filter->stat.code = stat.code;
+        updateLines(&filter->stat);
+        return(stat.code);
+    }
+    return(OK);
+}
+static CalError filterStreamEnd(const CalComp *cal,void *data)
+{
+    CalFilterStream *filter;
+    CalProp *tempProp;
+    CalStatus stat;
+
+    filter = data;
+    if (filter->nkept == 0)
+    {
+        return(OK);
+    }
+
+    //Properties of the VCALENDAR found after its components
+    tempProp = (filter->lastProp == NULL) ? cal->prop : filter->lastProp->next;
+    for (; tempProp != NULL; tempProp = tempProp->next)
+    {
+        stat = writeCalProp(filter->icsfile,tempProp);
+        filter->stat.linefrom += stat.linefrom;
+        if (stat.code != OK)
+        {
+            filter->stat.code = stat.code;
+            updateLines(&filter->stat);
+            return(stat.code);
+        }
+    }
+
+    stat = writeCalCompTail(filter->icsfile,cal);
+    filter->stat.linefrom += stat.linefrom;
+    filter->stat.code = stat.code;
+    updateLines(&filter->stat);
+    return(stat.code);
+}
+static CalError extractStreamComp(CalComp **const pcomp,const CalComp *cal,void *data)
+{
+    CalExtractStream *extract;
+    CalComp *comp;
+    CalInfo subInfo;
+    int n;
+
+    extract = data;
+    comp = *pcomp;
+    if (extract->zones == NULL)
+    {
+        extract->zones = InitializeCalTzCache(cal);
+    }
+    updateCalTzCache(extract->zones,cal);
+    subInfo = InitializeCalInfo();
+
+    if (extract->kind == OPROP)
+    {
+        findXprops(comp,&extract->xprops);
+        return(OK);
+    }
+
+    findEarlyAndLateTimes(comp,&extract->dates,extract->zones);
+
+    //Its place is kept until the calendar's latest date is known
+    if (comp->kind != COMP_VTIMEZONE && recursForever(comp,extract->zones))
+    {
+        n = extract->ndeferred;
+        extract->deferred = realloc(extract->deferred,sizeof(CalComp*)*(n+1));
+        extract->topAt = realloc(extract->topAt,sizeof(int)*(n+1));
+        extract->nestedAt = realloc(extract->nestedAt,sizeof(int)*(n+1));
+        assert(extract->deferred != NULL && extract->topAt != NULL && extract->nestedAt != NULL);
+        extract->deferred[n] = comp;
+        extract->topAt[n] = extract->top.nevents;
+        extract->nestedAt[n] = extract->nested.nevents;
+        extract->ndeferred += 1;
+        *pcomp = NULL;
+        return(OK);
+    }
+
+    if (comp->kind == COMP_VEVENT)
+    {
+        addEvent(comp,&extract->top,extract->zones,CAL_RECUR_FIRST);
+    }
+    findEvents(comp,&subInfo,extract->zones,CAL_RECUR_FIRST);
+    moveEvents(&extract->nested,extract->nested.nevents,&subInfo);
+    return(OK);
+}
+static CalError extractStreamEnd(const CalComp *cal,void *data)
+{
+    CalExtractStream *extract;
+    CalInfo subInfo;
+    CalProp *tempProp;
+    time_t horizon;
+
+    extract = data;
+    subInfo = InitializeCalInfo();
+
+    //The VCALENDAR's own X-properties, with those of its components
+    if (extract->kind == OPROP)
+    {
+        for (tempProp = cal->prop; tempProp != NULL; tempProp = tempProp->next)
+        {
+            if (tempProp->kind == PROP_X)
+            {
+                addString(&extract->xprops,tempProp->name);
+            }
+        }
+        extract->top.xprops = takeStrings(&extract->xprops,&extract->top.nxprops);
+        return(OK);
+    }
+
+    if (extract->zones == NULL)
+    {
+        extract->zones = InitializeCalTzCache(cal);
+    }
+    updateCalTzCache(extract->zones,cal);
+    for (tempProp = cal->prop; tempProp != NULL; tempProp = tempProp->next)
+    {
+        switch (tempProp->kind)
+        {
+            case PROP_DTSTART: case PROP_DTEND: case PROP_DUE: case PROP_COMPLETED:
+            case PROP_LAST_MODIFIED: case PROP_CREATED: case PROP_DTSTAMP:
+                if (tempProp->date != NULL)
+                {
+                    noteDate(&extract->dates,tempProp->date);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    horizon = extract->dates.dated ? extract->dates.late.t : CAL_RECUR_FIRST;
+
+    //Last first, so the places kept for the others do not move
+    for (int i = extract->ndeferred-1; i >= 0; i--)
+    {
+        if (extract->deferred[i]->kind == COMP_VEVENT)
+        {
+            addEvent(extract->deferred[i],&subInfo,extract->zones,horizon);
+            moveEvents(&extract->top,extract->topAt[i],&subInfo);
+        }
+        findEvents(extract->deferred[i],&subInfo,extract->zones,horizon);
+        moveEvents(&extract->nested,extract->nestedAt[i],&subInfo);
+    }
+
+    //Events inside other components come after all the others, then all are sorted
+    moveEvents(&extract->top,extract->top.nevents,&extract->nested);
+    if (extract->top.nevents > 0)
+    {
+        sortEvents(extract->top.events,extract->top.nevents);
+    }
+    return(OK);
+}
+static void filterRange(time_t datefrom,time_t dateto,time_t *from,time_t *to)
+{
+    //No dates: every dated component. Otherwise no upper bound if dateto is not set
+    *from = datefrom;
+    *to = (dateto == 0) ? CAL_RECUR_LAST : dateto;
+    if (datefrom == 0 && dateto == 0)
+    {
+        *from = CAL_RECUR_FIRST;
+    }
+}
+static int occursInRange(const CalComp *comp,CalTzCache *zones,time_t from,time_t to)
+{
+    CalRecur *recur;
+    CalTime start, end;
+    int found;
+
+    found = 0;
+    recur = InitializeCalRecur(comp,zones,from,to);
+    while (!found && recur != NULL && nextCalRecur(recur,&start,&end))
+    {
+        found = (start.t >= from && start.t <= to) || (end.t >= from && end.t <= to);
+    }
+    freeCalRecur(recur);
+    return(found);
+}
+static int inFilterRange(const CalComp *comp,CalCompKind kind,time_t from,time_t to,int anyDate,CalTzCache *zones)
+{
+    const CalComp *sub;
+    CalProp *tempProp;
+    CalIter iter;
+
+    initCalIter(&iter,comp);
+    while ((sub = nextCalComp(&iter)) != NULL)
+    {
+        //subcomponents of the same kind count as the top level component
+        if (iter.depth > 0 && sub->kind != kind)
+        {
+            skipCalIter(&iter);
+            continue;
+        }
+
+        tempProp = sub->prop;
+        while (tempProp != NULL)
+        {
+            switch (tempProp->kind)
+            {
+                case PROP_DTSTART: case PROP_DTEND: case PROP_DUE: case PROP_COMPLETED:
+                    if (anyDate || (tempProp->date != NULL && tempProp->date->t >= from && tempProp->date->t <= to))
+                    {
+                        endCalIter(&iter);
+                        return(1);
+                    }
+                    break;
+                default:
+                    break;
+            }
+            tempProp = tempProp->next;
+        }
+        if (!anyDate && isCalRecurring(sub) && occursInRange(sub,zones,from,to))
+        {
+            endCalIter(&iter);
+            return(1);
+        }
+    }
+    return(0);
+}
+static void moveEvents(CalInfo *into,int at,CalInfo *from)
+{
+    into->cut += from->cut;
+    from->cut = 0;
+    if (from->nevents == 0)
+    {
+        return;
+    }
+    into->events = realloc(into->events,sizeof(CalEvent*)*eventSlots(into->nevents + from->nevents));
+    assert(into->events != NULL);
+    memmove(&into->events[at + from->nevents],&into->events[at],sizeof(CalEvent*)*(into->nevents - at));
+    memcpy(&into->events[at],from->events,sizeof(CalEvent*)*from->nevents);
+    into->nevents += from->nevents;
+
+    free(from->events);
+    from->events = NULL;
+    from->nevents = 0;
+}
+static off_t outputStart(FILE *file)
+{
+    struct stat st;
+
+    if (fstat(fileno(file),&st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return(-1);
+    }
+    return(ftello(file));
+}
+static CalStatus copyOutput(FILE *from,FILE *to,CalStatus stat)
+{
+    char buff[CAL_COPY_SIZE];
+    size_t n;
+
+    if (fflush(from) != 0 || fseeko(from,0,SEEK_SET) != 0)
+    {
+        stat.code = IOERR;
+        return(stat);
+    }
+    while ((n = fread(buff,1,sizeof(buff),from)) > 0)
+    {
+        if (fwrite(buff,1,n,to) != n)
+        {
+            stat.code = IOERR;
+            return(stat);
+        }
+    }
+    if (ferror(from))
+    {
+        stat.code = IOERR;
+    }
+    return(stat);
+}
+static CalParser *openCalInput(int fd,CalStatus *stat)
+{
+    CalParser *parser;
+
+    *stat = InitializeCalStatus();
+    parser = InitializeCalParserFd(fd);
+    if (parser == NULL)
+    {
+        stat->code = IOERR;
+        return(NULL);
+    }
+    setCalParserOptions(parser,CAL_ARENA | CAL_SOURCE);
+    return(parser);
+}
+static void discardOutput(FILE *file,off_t start)
+{
+    if (start < 0)
+    {
+        return;
+    }
+    fflush(file);
+    if (ftruncate(fileno(file),start) == 0)
+    {
+        fseeko(file,start,SEEK_SET);
+    }
+}
+static CalVisit indexSubVisit(const CalComp *comp,int depth,void *data)
+{
+    CalIndexWalk *walk = data;
+
+    //subcomponents of the same kind count as the top level component
+    if (depth > 0 && comp->kind != ((walk->kind == 0) ? COMP_VEVENT : COMP_VTODO))
+    {
+        return(CAL_SKIP);
+    }
+    return(CAL_VISIT);
+}
+static CalVisit indexSubDates(const CalComp *comp,int depth,void *data)
+{
+    CalIndexWalk *walk = data;
+    CalIndex *index = walk->index;
+    CalProp *tempProp;
+    int kind, n;
+
+    //a subcomponent of another kind was skipped
+    if (indexSubVisit(comp,depth,data) == CAL_SKIP)
+    {
+        return(CAL_VISIT);
+    }
+    kind = walk->kind;
+    n = walk->n;
+
+    tempProp = comp->prop;
+    while (tempProp != NULL)
+    {
+        switch (tempProp->kind)
+        {
+            case PROP_DTSTART: case PROP_DTEND: case PROP_DUE: case PROP_COMPLETED:
+                index->dated[n] = 1;
+                if (tempProp->date == NULL)
+                {
+                    break;
+                }
+                //grow by doubling when the count reaches a power of two
+                if ((index->npoints[kind] & (index->npoints[kind] - 1)) == 0)
+                {
+                    index->points[kind] = realloc(index->points[kind],
+                        sizeof(CalIndexPoint)*(index->npoints[kind] == 0 ? 16 : index->npoints[kind]*2));
+                    assert(index->points[kind] != NULL);
+                }
+                index->points[kind][index->npoints[kind]].t = tempProp->date->t;
+                index->points[kind][index->npoints[kind]].comp = n;
+                index->npoints[kind] += 1;
+                break;
+            default:
+                break;
+        }
+        tempProp = tempProp->next;
+    }
+
+    if (isCalRecurring(comp))
+    {
+        index->recur[kind] = realloc(index->recur[kind],sizeof(CalIndexRecur)*(index->nrecur[kind]+1));
+        assert(index->recur[kind] != NULL);
+        index->recur[kind][index->nrecur[kind]].comp = n;
+        index->recur[kind][index->nrecur[kind]].sub = comp;
+        index->nrecur[kind] += 1;
+    }
+    return(CAL_VISIT);
+}
+static void indexSubComp(CalIndex *index,int kind,int n,const CalComp *comp)
+{
+    CalIndexWalk walk = { index, kind, n };
+    CalVisitor visitor = { &walk, indexSubVisit, indexSubDates };
+
+    //subcomponents' dates are added before the component's own
+    walkCalComp(comp,&visitor);
+}
+static int comparePoint(const void *point1,const void *point2)
+{
+    const CalIndexPoint *p1, *p2;
+
+    p1 = point1;
+    p2 = point2;
+    if (p1->t != p2->t)
+    {
+        return((p1->t < p2->t) ? -1 : 1);
+    }
+    return((p1->comp > p2->comp) - (p1->comp < p2->comp));
+}
+static int compareInt(const void *int1,const void *int2)
+{
+    int i1, i2;
+
+    i1 = *(const int*)int1;
+    i2 = *(const int*)int2;
+    return((i1 > i2) - (i1 < i2));
+}
+CalStatus calCombine( const CalComp *comp1, const CalComp *comp2, FILE *const icsfile )
+{
+    CalStatus stat;
+    CalComp *newComp;
+
+    newComp = combineCalComps(comp1,comp2);
+    stat = writeCalCompThreads(icsfile,newComp,0);
+    free(newComp);
+    return(stat);
+}
+CalComp *combineCalComps( const CalComp *comp1, const CalComp *comp2 )
+{
+    CalComp *newComp;
+    CalProp *props;
+    const CalProp *curProp;
+    int nprops;
+
+    //comp1's properties, then comp2's without its PRODID and VERSION; the properties are
+    //copied and linked anew, so neither calendar's list is changed (they may be written again)
+    nprops = 0;
+    for (curProp = comp1->prop; curProp != NULL; curProp = curProp->next)
+    {
+        nprops += 1;
+    }
+    for (curProp = comp2->prop; curProp != NULL; curProp = curProp->next)
+    {
+        nprops += 1;
+    }
+
+    //The copies of the properties follow the subcomponents, so the whole is freed at once
+    newComp = malloc(sizeof(CalComp)+ sizeof(CalComp*)*((comp1->ncomps)+(comp2->ncomps)) + sizeof(CalProp)*nprops);
+    assert(newComp != NULL);
+    props = (CalProp*)&newComp->comp[comp1->ncomps + comp2->ncomps];
+
+    //Make a shallow Copy of comp
+    newComp->name = comp1->name;
+    newComp->kind = comp1->kind;
+    newComp->arena = NULL;
+    newComp->text = NULL;
+    newComp->textLen = 0;
+    newComp->ncomps = comp1->ncomps + comp2->ncomps;
+
+    for (int i = 0; i < comp1->ncomps; i++)
+    {
+        newComp->comp[i] = comp1->comp[i];
+    }
+    for (int i = 0; i < comp2->ncomps; i++)
+    {
+        newComp->comp[i+comp1->ncomps] = comp2->comp[i]; 
+    }
+
+    nprops = 0;
+    for (curProp = comp1->prop; curProp != NULL; curProp = curProp->next)
+    {
+        props[nprops] = *curProp;
+        nprops += 1;
+    }
+    for (curProp = comp2->prop; curProp != NULL; curProp = curProp->next)
+    {
+        if (curProp->kind != PROP_PRODID && curProp->kind != PROP_VERSION)
+        {
+            props[nprops] = *curProp;
+            nprops += 1;
+        }
+    }
+    for (int i = 0; i < nprops; i++)
+    {
+        props[i].next = (i+1 < nprops) ? &props[i+1] : NULL;
+    }
+    newComp->nprops = nprops;
+    newComp->prop = (nprops > 0) ? props : NULL;
+
+    return(newComp);
+}
+
+int getCalDate( const char *str, int endOfDay, time_t *date )
+{
+    struct tm tm;
+    time_t t;
+    int dtErr;
+
+    if (strcmp(str,"today") == 0)
+    {
+        t = time(NULL);
+        tm = *localtime(&t);
+    }
+    else
+    {
+        dtErr = getdate_r(str,&tm);
+        assert(dtErr != 6);
+        if (dtErr >= 1 && dtErr <= 5)
+        {
+            return(1);
+        }
+        if (dtErr >= 7 && dtErr <= 8)
+        {
+            return(2);
+        }
+    }
+
+    //The start or the end of the day
+    tm.tm_sec = 0;
+    tm.tm_min = endOfDay ? 59 : 0;
+    tm.tm_hour = endOfDay ? 23 : 0;
+    tm.tm_isdst = -1;
+    *date = mktime(&tm);
+    return(0);
+}
+
+void printCalError(CalStatus stat)
+{
+
+    //Error on one line
+    if (stat.linefrom == stat.lineto)
+    {
+        fprintf(stderr,"Error on line %d.\n",stat.lineto);
     }
     //Error spanning multipal lines
     else
@@ -1789,7 +2701,7 @@ CalEvent *extractEvent(CalComp const *comp)
 {
     CalProp *tempProp;
     CalEvent *cEvent;
-    char *propName;
+    const char *value;  // decoded by calPropValue
 
     cEvent = NULL;
 
@@ -1798,33 +2710,34 @@ CalEvent *extractEvent(CalComp const *comp)
     tempProp = comp->prop;
     while (tempProp != NULL)
     {
-        propName = tempProp->name;
         //Store startdate in CalEvent
-        if (strcmp(propName,"DTSTART") == 0 && cEvent->dateStart == NULL)
+        if (tempProp->kind == PROP_DTSTART && tempProp->date != NULL && cEvent->dateStart == NULL)
         {
             cEvent->dateStart = malloc(sizeof(struct tm));
             assert(cEvent->dateStart!=NULL);
-            strptime(tempProp->value,"%Y%m%dT%H%M%S",cEvent->dateStart);
-            cEvent->dateStart->tm_isdst = -1; 
+            calTimeToTm(tempProp->date,cEvent->dateStart);
+            cEvent->start = tempProp->date->t;
         } 
 
         //Store Summary in CalEvent
-        else if (strcmp(propName,"SUMMARY") == 0 && cEvent->summary == NULL)
+        else if (tempProp->kind == PROP_SUMMARY && cEvent->summary == NULL)
         {
-            cEvent->summary = malloc(sizeof(char)*strlen(tempProp->value)+1);
+            value = calPropValue(comp,tempProp);
+            cEvent->summary = malloc(sizeof(char)*strlen(value)+1);
             assert(cEvent->summary!=NULL);
-            strcpy(cEvent->summary,tempProp->value);
+            strcpy(cEvent->summary,value);
         }
-        else if (strcmp(propName,"LOCATION") == 0 && cEvent->location == NULL)
+        else if (tempProp->kind == PROP_LOCATION && cEvent->location == NULL)
         {
-            cEvent->location = malloc(sizeof(char)*strlen(tempProp->value)+1);
+            value = calPropValue(comp,tempProp);
+            cEvent->location = malloc(sizeof(char)*strlen(value)+1);
             assert(cEvent->location!=NULL);
-            strcpy(cEvent->location,tempProp->value);
+            strcpy(cEvent->location,value);
         }
-        else if (strcmp(propName,"ORGANIZER") == 0 && cEvent->org == NULL)
+        else if (tempProp->kind == PROP_ORGANIZER && cEvent->org == NULL)
         {
             cEvent->org = InitializeCalOrganizer();
-            populateOrganizer(tempProp,cEvent->org);
+            populateOrganizer(comp,tempProp,cEvent->org);
         }
 
     tempProp = tempProp->next;
@@ -1844,7 +2757,7 @@ CalTodo *extractTodo(CalComp const *comp)
 {
     CalProp *tempProp;
     CalTodo *cTodo;
-    char *propName;
+    const char *value;  // decoded by calPropValue
 
     cTodo = NULL;
 
@@ -1854,23 +2767,24 @@ CalTodo *extractTodo(CalComp const *comp)
     tempProp = comp->prop;
     while (tempProp != NULL)
     {
-        propName = tempProp->name;
-        if(strcmp(propName,"SUMMARY") == 0 && cTodo->summary == NULL)
+        if(tempProp->kind == PROP_SUMMARY && cTodo->summary == NULL)
         {
-            cTodo->summary = malloc(sizeof(char)*strlen(tempProp->value)+1);
+            value = calPropValue(comp,tempProp);
+            cTodo->summary = malloc(sizeof(char)*strlen(value)+1);
             assert(cTodo->summary!=NULL);
-            strcpy(cTodo->summary,tempProp->value);
+            strcpy(cTodo->summary,value);
         }
-        else if(strcmp(propName,"PRIORITY") == 0 && cTodo->priority == 0)
+        else if(tempProp->kind == PROP_PRIORITY && cTodo->priority == 0)
         {
-            cTodo->priority = malloc(sizeof(char)*strlen(tempProp->value)+1);
+            value = calPropValue(comp,tempProp);
+            cTodo->priority = malloc(sizeof(char)*strlen(value)+1);
             assert(cTodo->priority!=NULL);
-            strcpy(cTodo->priority,tempProp->value);
+            strcpy(cTodo->priority,value);
         }
-        else if (strcmp(propName,"ORGANIZER") == 0 && cTodo->org == NULL)
+        else if (tempProp->kind == PROP_ORGANIZER && cTodo->org == NULL)
         {
             cTodo->org = InitializeCalOrganizer();
-            populateOrganizer(tempProp,cTodo->org);
+            populateOrganizer(comp,tempProp,cTodo->org);
         }
         tempProp = tempProp->next;
     }
@@ -1879,91 +2793,34 @@ CalTodo *extractTodo(CalComp const *comp)
     
 }
 
-static void filter(CalComp *comp, CalOpt opt,time_t datefrom,time_t dateto)
-{
-    CalComp *swap;
-    char* name;
-    int *remPos;
-    int remCount;
-    int toRemove;
-    remCount = 0;
-
-    remPos = malloc(sizeof(int)*comp->ncomps);
-    assert(remPos != NULL);
-
-    for (int i = 0; i < comp->ncomps; i++)
-    {
-        toRemove = 0;
-        name = comp->comp[i]->name;
-        if(strcmp(name,"VEVENT") == 0 && opt == OEVENT)
-        {
-            toRemove = filterSubComp(comp->comp[i],opt,datefrom,dateto);
-        }
-        else if (strcmp(name,"VTODO") == 0 && opt == OTODO)
-        {
-            toRemove = filterSubComp(comp->comp[i],opt,datefrom,dateto);
-        }
-        else
-        {
-            toRemove = 1;
-        }
-        if (toRemove == 1)
-        {
-            remPos[remCount] = i;
-            remCount += 1;
-        }
-    }
-    //Set remove positions to NULL
-    for (int i = 0; i < remCount; i++)
-    {
-        comp->comp[remPos[i]] = NULL;
-    }
-    //Shift elements to far left positions .
-    for (int i = 0; i < comp->ncomps; i++)
-    {
-        if (comp->comp[i] == NULL)
-        {
-            for (int j = i; j < comp->ncomps; j++)
-            {
-                if (comp->comp[j] != NULL)
-                {
-                    swap = comp->comp[j];
-                    comp->comp[j] = NULL;
-                    comp->comp[i] = swap;
-                    break;
-                }
-            }
-        }
-    }
-    comp->ncomps -= remCount;
-    free(remPos);
-
-}
 
-void populateOrganizer (CalProp *orgProp, CalOrganizer *org)
+void populateOrganizer (CalComp const *comp, CalProp *orgProp, CalOrganizer *org)
 {
     CalParam *tempParam;
     char *paramName;
+    const char *value;  // decoded by calPropValue
     tempParam = NULL;
     
+    tempParam = orgProp->param;
     for (int i = 0; i < orgProp->nparams; i++)
     {
-        tempParam = orgProp->param;
         paramName = tempParam->name;
 
         for (int j = 0; j < tempParam->nvalues; j++)
         {
-            // Store common name
-            if (strcmp(paramName,"CN") == 0)
+            // Store common name (the first one given)
+            if (strcmp(paramName,"CN") == 0 && org->name == NULL)
             {
                 org->name = malloc(sizeof(char)* strlen(tempParam->value[j]) + 1);
                 assert(org->name != NULL);
                 strcpy(org->name,tempParam->value[j]);
             }
         }
+        tempParam = tempParam->next;
     }
-    org->contact = malloc(sizeof(char)* strlen(orgProp->value) + 1);
+    value = calPropValue(comp,orgProp);
+    org->contact = malloc(sizeof(char)* strlen(value) + 1);
     assert(org->contact != NULL);
-    strcpy(org->contact,orgProp->value);
+    strcpy(org->contact,value);
 
 }
\ No newline at end of file
@@ -28,6 +28,7 @@ typedef struct CalEvent
     char *summary;
     char *location;
     struct tm *dateStart;
+    time_t start;       // dateStart as seconds since the epoch (for sorting)
     CalOrganizer *org;
 }CalEvent;
 
@@ -47,13 +48,15 @@ typedef struct CalInfo
     int subcomps;
     int todos;
     int other;
-    struct tm *early;
-    struct tm *late;
+    int dated;          // 1 if early and late are set
+    CalTime early;      // earliest and latest dates, in the CalComp's properties and
+    CalTime late;       // the occurrences of its recurring components
     int props;
     int norgs;
     char **orgs;
     int nevents;
     CalEvent **events;
+    int cut;            // no. of recurring events with too many occurrences to list them all
     int nxprops;
     char **xprops;
 }CalInfo;
@@ -65,6 +68,10 @@ typedef enum {
     OTODO,      // to-do items
 } CalOpt;
 
+/* Index of the dates of a calendar's top level events and to-dos, built once and queried for
+   any number of date ranges. Defined in caltool.c; create with InitializeCalIndex. */
+typedef struct CalIndex CalIndex;
+
 /* iCalendar tool functions */
 
 CalStatus calInfo( const CalComp *comp, int lines, FILE *const txtfile );
@@ -72,8 +79,106 @@ CalStatus calExtract( const CalComp *comp, CalOpt kind, FILE *const txtfile );
 CalStatus calFilter( const CalComp *comp, CalOpt content, time_t datefrom, time_t dateto, FILE *const icsfile );
 CalStatus calCombine( const CalComp *comp1, const CalComp *comp2, FILE *const icsfile );
 
+/*combineCalComps
+*
+* Purpose: To make the calendar calCombine writes: comp1's properties and subcomponents,
+*          then comp2's subcomponents and its properties but PRODID and VERSION.
+*
+* Arguments: - The two calendars (const CalComp *, const CalComp *)
+*
+* Returns:   - A shallow copy that shares their subcomponents and copies of their properties
+*              (their lists are left as they are). It is one block: free it with free, before
+*              either calendar is freed.
+*
+********************************************************************************************/
+CalComp *combineCalComps( const CalComp *comp1, const CalComp *comp2 );
+
+/*calFilterStream / calExtractStream
+*
+* Purpose: To do what calFilter and calExtract do, reading the calendar with readCalStream
+*          instead of as a whole tree: each component is judged, written or collected as soon
+*          as it is read, and then freed, so memory does not grow with the size of the file.
+*          (calExtractStream keeps the events it lists, to sort them, and the components with
+*          an event that recurs forever, until the calendar's latest date is known.)
+*
+* Arguments: - A parser for the calendar (CalParser *)
+*            - The rest as for calFilter or calExtract
+*
+* Returns:   - The status of the read, or of the tool as for calFilter or calExtract. On an error
+*              part of the output may have been written already.
+*
+********************************************************************************************/
+CalStatus calFilterStream( CalParser *const parser, CalOpt content, time_t datefrom, time_t dateto, FILE *const icsfile );
+CalStatus calExtractStream( CalParser *const parser, CalOpt kind, FILE *const txtfile );
+
+/*calFilterIndex
+*
+* Purpose: To do what calFilter does, with the dates looked up in an index of the calendar
+*          instead of read from every component.
+*
+* Arguments: - The index of the calendar (CalIndex *)
+*            - The rest as for calFilter
+*
+********************************************************************************************/
+CalStatus calFilterIndex( CalIndex *index, CalOpt content, time_t datefrom, time_t dateto, FILE *const icsfile );
+
+/*InitializeCalIndex
+*
+* Purpose: To index a calendar's top level events and to-dos by their DTSTART, DTEND, DUE and
+*          COMPLETED dates (and those of their subcomponents of the same kind), kept sorted so
+*          that a range of dates is found by binary search. Recurring components are listed
+*          apart, and only their occurrences inside the range asked for are generated.
+*
+* Arguments: - The VCALENDAR (const CalComp *), which must outlive the index
+*
+* Returns:   - The index (free with freeCalIndex)
+*
+********************************************************************************************/
+CalIndex *InitializeCalIndex( const CalComp *comp );
+
+/*queryCalIndex
+*
+* Purpose: To find the components calFilter keeps: the events or to-dos with a date, or an
+*          occurrence starting or ending, between datefrom and dateto. The cost is the binary
+*          search plus the number of dates found.
+*
+* Arguments: - The index (CalIndex *)
+*            - OEVENT or OTODO (CalOpt)
+*            - The lower and upper bound dates; 0 for no upper bound, and both 0 for every
+*              component with a DTSTART, DTEND, DUE or COMPLETED, read or not (time_t, time_t)
+*            - The address to store the number of components found (int *)
+*
+* Returns:   - An array of the numbers of the components found, in ascending order (free it)
+*
+********************************************************************************************/
+int *queryCalIndex( CalIndex *index, CalOpt kind, time_t datefrom, time_t dateto, int *nfound );
+
+/*freeCalIndex
+*
+* Purpose: To free an index returned by InitializeCalIndex.
+*
+********************************************************************************************/
+void freeCalIndex( CalIndex *index );
+
 /*Helper Functions*/
 
+/*getCalDate
+*
+* Purpose: To read a date the way -filter does: "today", or a date in one of the formats of
+*          the DATEMSK template file (see getdate), taken at the start (00:00) or the end
+*          (23:59) of its day in local time.
+*
+* Arguments: - The date (const char *)
+*            - 1 for the end of the day, 0 for its start (int)
+*            - Where to store the date, as seconds since the epoch (time_t *)
+*
+* Returns:   - 0 on success
+*            - 1 if the DATEMSK environment variable or its template file is at fault
+*            - 2 if the date could not be interpreted
+*
+********************************************************************************************/
+int getCalDate( const char *str, int endOfDay, time_t *date );
+
 /*printCalError
 *
 * Purpose: To output an error message on stderr based on an error code stored in a 
@@ -137,5 +242,5 @@ void freeCalOrganizer(CalOrganizer *org);
 ********************************************************************************************/
 CalEvent *extractEvent(CalComp const *comp);
 CalTodo *extractTodo(CalComp const *comp);
-void populateOrganizer (CalProp *orgProp, CalOrganizer *org);
+void populateOrganizer (CalComp const *comp, CalProp *orgProp, CalOrganizer *org);
 #endif
@@ -0,0 +1,918 @@
+/* caltz.c
+*
+*  These functions compile the VTIMEZONE components of a calendar, or the zones of
+*  the system's timezone database, into tables of offset changes, and use them to
+*  place the UTC and TZID-qualified DATE-TIME values of a calendar in time.
+*
+********************************************************************************************/
+
+#include "caltz.h"
+#include "calrecur.h"
+
+/* Zones compiled for one calendar (see findCalTz) */
+struct CalTzCache {
+    const CalComp *cal;     // calendar whose VTIMEZONEs are searched
+    int toYear;             // last year a table covers unless more is asked for
+    int nzones;             // no. of tables compiled
+    char **tzid;            // names asked for
+    int *year;              // last year each table covers
+    CalTz **zone;           // their zones (NULL if unknown)
+};
+
+/* Rule of a POSIX TZ string for the start or end of daylight time ("M3.2.0/2") */
+typedef struct PosixRule {
+    char form;              // 'M' (month.week.day), 'J' (Julian day 1..365) or 'N' (day 0..365)
+    int mon, week, wday;    // for 'M'; week 5 is the last
+    int day;                // for 'J' and 'N'
+    long time;              // seconds after local midnight
+} PosixRule;
+
+/*addTrans
+*
+* Purpose: To add an offset change to a timezone's table (in any order; see sortTrans).
+*
+* Arguments: The timezone (CalTz*), the address of the allocated size of its table (int*),
+*            and the instant of the change and offsets before and after it (time_t, long, long)
+********************************************************************************************/
+static void addTrans(CalTz *tz, int *size, time_t at, long before, long after)
+{
+    if (tz->ntrans == *size)
+    {
+        *size = *size == 0 ? 16 : *size * 2;
+        tz->trans = realloc(tz->trans,sizeof(CalTzTrans)*(*size));
+        assert(tz->trans != NULL);
+    }
+    tz->trans[tz->ntrans].at = at;
+    tz->trans[tz->ntrans].before = before;
+    tz->trans[tz->ntrans].after = after;
+    tz->ntrans += 1;
+}
+
+/*compareTrans
+*
+* Purpose: To order offset changes by instant (qsort comparator).
+********************************************************************************************/
+static int compareTrans(const void *trans1, const void *trans2)
+{
+    const CalTzTrans *t1 = trans1;
+    const CalTzTrans *t2 = trans2;
+
+    if (t1->at < t2->at)
+    {
+        return(-1);
+    }
+    return(t1->at > t2->at);
+}
+
+/*sortTrans
+*
+* Purpose: To sort a timezone's offset changes by instant, keeping one change per instant.
+*
+* Arguments: The timezone (CalTz*)
+********************************************************************************************/
+static void sortTrans(CalTz *tz)
+{
+    int kept;
+
+    if (tz->ntrans == 0)
+    {
+        return;
+    }
+    qsort(tz->trans,tz->ntrans,sizeof(CalTzTrans),compareTrans);
+
+    kept = 1;
+    for (int i = 1; i < tz->ntrans; i++)
+    {
+        if (tz->trans[i].at == tz->trans[kept-1].at)
+        {
+            tz->trans[kept-1] = tz->trans[i];
+        }
+        else
+        {
+            tz->trans[kept] = tz->trans[i];
+            kept += 1;
+        }
+    }
+    tz->ntrans = kept;
+}
+
+/*nthWeekday
+*
+* Purpose: To find the n-th given weekday of a month, e.g. the second Sunday of March (n = 2)
+*          or the last Sunday of October (n = -1).
+*
+* Arguments: The year and month (int), n (int, non-zero; negative counts from the end of
+*            the month), and the weekday (int, 0 = Sunday)
+*
+* Returns: The day counted from 1970-01-01, or -1 and *found = 0 if the month has no such day
+********************************************************************************************/
+static long nthWeekday(int year, int mon, int n, int wday, int *found)
+{
+    long first, last, day;
+
+    first = calDaysFromCivil(year,mon,1);
+    last = first + calDaysInMonth(year,mon) - 1;
+    *found = 1;
+    if (n > 0)
+    {
+        day = first + (wday - calWeekday(first) + 7) % 7 + (n - 1) * 7;
+        if (day <= last)
+        {
+            return(day);
+        }
+    }
+    else
+    {
+        day = last - (calWeekday(last) - wday + 7) % 7 - (-n - 1) * 7;
+        if (day >= first)
+        {
+            return(day);
+        }
+    }
+    *found = 0;
+    return(-1);
+}
+
+/*nextItem
+*
+* Purpose: To step to the next item of a comma separated list ("2SU,-1SU").
+*
+* Arguments: The current item (const char*), and the end of the list or NULL if it ends
+*            with the string (const char*)
+*
+* Returns: The next item, or NULL after the last one
+********************************************************************************************/
+static const char *nextItem(const char *item, const char *end)
+{
+    item = strchr(item,',');
+    if (item == NULL || (end != NULL && item >= end))
+    {
+        return(NULL);
+    }
+    return(item + 1);
+}
+
+CalTz *compileCalTimezone( const CalComp *vtimezone, int toYear )
+{
+    CalTz *tz;
+    CalProp *prop;
+    CalComp *obs;
+    CalTime *dtstart;
+    CalTime rdate, onset;
+    CalRecur *recur;
+    const char *tzid, *rrule, *value;
+    long from, to, start;
+    int size, haveFrom, haveTo, haveObs;
+    time_t firstAt;
+
+    tzid = NULL;
+    for (prop = vtimezone->prop; prop != NULL; prop = prop->next)
+    {
+        if (prop->kind == PROP_TZID)
+        {
+            tzid = prop->value;
+        }
+    }
+    if (tzid == NULL)
+    {
+        return(NULL);
+    }
+
+    tz = malloc(sizeof(CalTz));
+    assert(tz != NULL);
+    tz->tzid = malloc(strlen(tzid)+1);
+    assert(tz->tzid != NULL);
+    strcpy(tz->tzid,tzid);
+    tz->initial = 0;
+    tz->ntrans = 0;
+    tz->trans = NULL;
+    size = 0;
+    haveObs = 0;
+    firstAt = 0;
+
+    for (int i = 0; i < vtimezone->ncomps; i++)
+    {
+        obs = vtimezone->comp[i];
+        if (obs->kind != COMP_STANDARD && obs->kind != COMP_DAYLIGHT)
+        {
+            continue;
+        }
+
+        dtstart = NULL;
+        rrule = NULL;
+        haveFrom = 0;
+        haveTo = 0;
+        for (prop = obs->prop; prop != NULL; prop = prop->next)
+        {
+            switch (prop->kind)
+            {
+                case PROP_DTSTART:
+                    dtstart = prop->date;
+                    break;
+                case PROP_TZOFFSETFROM:
+                    haveFrom = parseCalUtcOffset(prop->value,&from) == OK;
+                    break;
+                case PROP_TZOFFSETTO:
+                    haveTo = parseCalUtcOffset(prop->value,&to) == OK;
+                    break;
+                case PROP_RRULE:
+                    rrule = prop->value;
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (dtstart == NULL || !haveFrom || !haveTo)
+        {
+            continue;
+        }
+
+        //Onset of the observance (DTSTART is local time, in the offset before it)
+        start = calWallSeconds(dtstart);
+        addTrans(tz,&size,start - from,from,to);
+        if (!haveObs || start - from < firstAt)
+        {
+            firstAt = start - from;
+            tz->initial = from;
+        }
+        haveObs = 1;
+
+        //More onsets: RDATE lists and the yearly rule
+        for (prop = obs->prop; prop != NULL; prop = prop->next)
+        {
+            if (prop->kind != PROP_RDATE)
+            {
+                continue;
+            }
+            for (value = prop->value; value != NULL; value = nextItem(value,NULL))
+            {
+                if (parseCalTime(value,&rdate) == OK)
+                {
+                    addTrans(tz,&size,calWallSeconds(&rdate) - from,from,to);
+                }
+            }
+        }
+        if (rrule != NULL)
+        {
+            recur = InitializeCalRecurRule(rrule,dtstart,from,start - from,
+                                           calDaysFromCivil(toYear+1,1,1)*86400 - 1);
+            while (nextCalRecur(recur,&onset,NULL))
+            {
+                addTrans(tz,&size,onset.t,from,to);
+            }
+            freeCalRecur(recur);
+        }
+    }
+
+    if (!haveObs)
+    {
+        freeCalTz(tz);
+        return(NULL);
+    }
+    sortTrans(tz);
+    return(tz);
+}
+
+/*readBigEndian
+*
+* Purpose: To read a signed big-endian integer of a TZif file.
+*
+* Arguments: The bytes (const unsigned char*) and their number, 4 or 8 (int)
+*
+* Returns: The integer
+********************************************************************************************/
+static long long readBigEndian(const unsigned char *bytes, int n)
+{
+    unsigned long long value;
+
+    value = 0;
+    for (int i = 0; i < n; i++)
+    {
+        value = (value << 8) | bytes[i];
+    }
+    if (n == 4)
+    {
+        return((long long)(int)(unsigned int)value);
+    }
+    return((long long)value);
+}
+
+/*posixName / posixOffset
+*
+* Purpose: To read the zone name ("EST" or "<+0330>") and the offset ("5", "-3:30") of a POSIX TZ string.
+*          POSIX offsets are west of UTC; the offset returned is east of UTC.
+*
+* Returns: The text after them, or NULL if they are malformed
+********************************************************************************************/
+static const char *posixName(const char *text)
+{
+    const char *start = text;
+
+    if (*text == '<')
+    {
+        text = strchr(text,'>');
+        return(text == NULL ? NULL : text + 1);
+    }
+    while ((*text >= 'A' && *text <= 'Z') || (*text >= 'a' && *text <= 'z'))
+    {
+        text += 1;
+    }
+    return(text - start < 3 ? NULL : text);
+}
+
+static const char *posixOffset(const char *text, long *offset)
+{
+    long sign, part;
+    char *end;
+
+    sign = 1;
+    if (*text == '+' || *text == '-')
+    {
+        sign = *text == '-' ? -1 : 1;
+        text += 1;
+    }
+    if (*text < '0' || *text > '9')
+    {
+        return(NULL);
+    }
+    *offset = strtol(text,&end,10) * 3600;
+    for (int i = 0; i < 2 && *end == ':'; i++)
+    {
+        part = strtol(end+1,&end,10);
+        *offset += i == 0 ? part * 60 : part;
+    }
+    *offset *= -sign;
+    return(end);
+}
+
+/*posixRule
+*
+* Purpose: To read the start or end rule of a POSIX TZ string ("M3.2.0", "J60/3", "300/-1").
+*
+* Arguments: The text after its comma (const char*) and the rule to fill (PosixRule*)
+*
+* Returns: The text after the rule, or NULL if it is malformed
+********************************************************************************************/
+static const char *posixRule(const char *text, PosixRule *rule)
+{
+    char *end;
+    long time;
+
+    if (*text == 'M')
+    {
+        rule->form = 'M';
+        rule->mon = strtol(text+1,&end,10);
+        if (*end != '.')
+        {
+            return(NULL);
+        }
+        rule->week = strtol(end+1,&end,10);
+        if (*end != '.')
+        {
+            return(NULL);
+        }
+        rule->wday = strtol(end+1,&end,10);
+        if (rule->mon < 1 || rule->mon > 12 || rule->week < 1 || rule->week > 5 ||
+            rule->wday < 0 || rule->wday > 6)
+        {
+            return(NULL);
+        }
+    }
+    else
+    {
+        rule->form = *text == 'J' ? 'J' : 'N';
+        if (*text == 'J')
+        {
+            text += 1;
+        }
+        if (*text < '0' || *text > '9')
+        {
+            return(NULL);
+        }
+        rule->day = strtol(text,&end,10);
+    }
+
+    rule->time = 7200;
+    text = end;
+    if (*text == '/')
+    {
+        //The time is an offset east of local midnight; posixOffset negates it
+        text = posixOffset(text+1,&time);
+        rule->time = -time;
+    }
+    return(text);
+}
+
+/*posixRuleDay
+*
+* Purpose: To find the day a POSIX TZ rule falls on in a year.
+*
+* Returns: The day counted from 1970-01-01
+********************************************************************************************/
+static long posixRuleDay(const PosixRule *rule, int year)
+{
+    long jan1;
+    int leap, found;
+
+    jan1 = calDaysFromCivil(year,1,1);
+    if (rule->form == 'M')
+    {
+        return(nthWeekday(year,rule->mon,rule->week == 5 ? -1 : rule->week,rule->wday,&found));
+    }
+    if (rule->form == 'J')
+    {
+        leap = calDaysInMonth(year,2) == 29;
+        return(jan1 + rule->day - 1 + (leap && rule->day >= 60));
+    }
+    return(jan1 + rule->day);
+}
+
+/*extendPosix
+*
+* Purpose: To add the offset changes of a POSIX TZ string (the footer of a TZif file, e.g.
+*          "EST5EDT,M3.2.0,M11.1.0") for the years after a zone's last listed change.
+*
+* Arguments: The timezone and the allocated size of its table (CalTz*, int*), the TZ string
+*            (const char*), the first and last years to add (int)
+********************************************************************************************/
+static void extendPosix(CalTz *tz, int *size, const char *posix, int fromYear, int toYear)
+{
+    PosixRule start, end;
+    long std, dst;
+    time_t last, startAt, endAt;
+
+    posix = posixName(posix);
+    if (posix == NULL || (posix = posixOffset(posix,&std)) == NULL || *posix == '\0')
+    {
+        return;
+    }
+    posix = posixName(posix);
+    if (posix == NULL)
+    {
+        return;
+    }
+    dst = std + 3600;
+    if (*posix != ',' && *posix != '\0')
+    {
+        posix = posixOffset(posix,&dst);
+        if (posix == NULL)
+        {
+            return;
+        }
+    }
+    if (*posix != ',' || (posix = posixRule(posix+1,&start)) == NULL ||
+        *posix != ',' || posixRule(posix+1,&end) == NULL)
+    {
+        return;
+    }
+
+    last = tz->ntrans > 0 ? tz->trans[tz->ntrans-1].at : 0;
+    for (int year = fromYear; year <= toYear; year++)
+    {
+        startAt = posixRuleDay(&start,year) * 86400 + start.time - std;
+        endAt = posixRuleDay(&end,year) * 86400 + end.time - dst;
+        if (startAt > last)
+        {
+            addTrans(tz,size,startAt,std,dst);
+        }
+        if (endAt > last)
+        {
+            addTrans(tz,size,endAt,dst,std);
+        }
+    }
+}
+
+/*parseTzif
+*
+* Purpose: To compile the contents of a TZif file (RFC 8536, versions 1 to 4) into a timezone.
+*
+* Arguments: The timezone to fill (CalTz*), the file's bytes and their number (const unsigned char*,
+*            size_t), and the last year the table must cover (int)
+*
+* Returns: 1 on success, 0 if the file is malformed
+********************************************************************************************/
+static int parseTzif(CalTz *tz, const unsigned char *data, size_t len, int toYear)
+{
+    size_t pos, timecnt, typecnt, charcnt, leapcnt, isstdcnt, isutcnt, timeSize, blockSize;
+    const unsigned char *times, *index, *types, *footer;
+    long offset, prev;
+    int size, year, mon, mday;
+    char posix[256];
+
+    if (len < 44 || memcmp(data,"TZif",4) != 0)
+    {
+        return(0);
+    }
+    pos = 0;
+    timeSize = 4;
+    for (;;)
+    {
+        isutcnt = readBigEndian(data+pos+20,4);
+        isstdcnt = readBigEndian(data+pos+24,4);
+        leapcnt = readBigEndian(data+pos+28,4);
+        timecnt = readBigEndian(data+pos+32,4);
+        typecnt = readBigEndian(data+pos+36,4);
+        charcnt = readBigEndian(data+pos+40,4);
+        blockSize = timecnt*(timeSize+1) + typecnt*6 + charcnt + leapcnt*(timeSize+4) + isstdcnt + isutcnt;
+        if (timecnt > len || typecnt == 0 || typecnt > 256 || pos + 44 + blockSize > len)
+        {
+            return(0);
+        }
+
+        //Version 2 and later repeat the data with 64-bit times; use that
+        if (timeSize == 4 && data[4] >= '2')
+        {
+            pos += 44 + blockSize;
+            if (pos + 44 > len || memcmp(data+pos,"TZif",4) != 0)
+            {
+                return(0);
+            }
+            timeSize = 8;
+            continue;
+        }
+        break;
+    }
+
+    times = data + pos + 44;
+    index = times + timecnt*timeSize;
+    types = index + timecnt;
+
+    //Type 0 is in use before the first change
+    tz->initial = readBigEndian(types,4);
+    prev = tz->initial;
+    size = 0;
+    for (size_t i = 0; i < timecnt; i++)
+    {
+        if (index[i] >= typecnt)
+        {
+            return(0);
+        }
+        offset = readBigEndian(types + index[i]*6,4);
+        if (offset != prev)
+        {
+            addTrans(tz,&size,readBigEndian(times + i*timeSize,timeSize),prev,offset);
+            prev = offset;
+        }
+    }
+
+    //Footer: newline, POSIX TZ string, newline
+    footer = data + pos + 44 + blockSize;
+    if (timeSize == 8 && footer < data + len && *footer == '\n')
+    {
+        size_t n = 0;
+        footer += 1;
+        while (footer + n < data + len && footer[n] != '\n' && n < sizeof(posix) - 1)
+        {
+            posix[n] = footer[n];
+            n += 1;
+        }
+        posix[n] = '\0';
+
+        year = 1970;
+        if (tz->ntrans > 0)
+        {
+            calCivilFromDays(tz->trans[tz->ntrans-1].at / 86400,&year,&mon,&mday);
+        }
+        extendPosix(tz,&size,posix,year,toYear);
+    }
+    sortTrans(tz);
+    return(1);
+}
+
+CalTz *loadCalZoneinfo( const char *tzid, int toYear )
+{
+    CalTz *tz;
+    FILE *file;
+    const char *dir;
+    char *path;
+    unsigned char *data;
+    size_t len;
+
+    //Only names inside the database
+    if (tzid == NULL || tzid[0] == '\0' || tzid[0] == '/' || strstr(tzid,"..") != NULL)
+    {
+        return(NULL);
+    }
+    dir = getenv("TZDIR");
+    if (dir == NULL || dir[0] == '\0')
+    {
+        dir = ZONEINFO_DIR;
+    }
+
+    path = malloc(strlen(dir)+strlen(tzid)+2);
+    assert(path != NULL);
+    strcpy(path,dir);
+    strcat(path,"/");
+    strcat(path,tzid);
+    file = fopen(path,"rb");
+    free(path);
+    if (file == NULL)
+    {
+        return(NULL);
+    }
+
+    data = malloc(ZONEINFO_MAX);
+    assert(data != NULL);
+    len = fread(data,1,ZONEINFO_MAX,file);
+    fclose(file);
+
+    tz = malloc(sizeof(CalTz));
+    assert(tz != NULL);
+    tz->tzid = malloc(strlen(tzid)+1);
+    assert(tz->tzid != NULL);
+    strcpy(tz->tzid,tzid);
+    tz->initial = 0;
+    tz->ntrans = 0;
+    tz->trans = NULL;
+
+    if (!parseTzif(tz,data,len,toYear))
+    {
+        freeCalTz(tz);
+        tz = NULL;
+    }
+    free(data);
+    return(tz);
+}
+
+time_t calTzToUtc( const CalTz *tz, long wall )
+{
+    const CalTzTrans *prev;
+    int low, high, mid;
+
+    //First change whose wall time (on the clock before it) is after the time
+    low = 0;
+    high = tz->ntrans;
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+        if (wall < tz->trans[mid].at + tz->trans[mid].before)
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+
+    if (low == 0)
+    {
+        return(wall - (tz->ntrans > 0 ? tz->trans[0].before : tz->initial));
+    }
+    prev = &tz->trans[low-1];
+    //Skipped by the change before it
+    if (wall < prev->at + prev->after)
+    {
+        return(wall - prev->before);
+    }
+    return(wall - prev->after);
+}
+
+long calTzOffset( const CalTz *tz, time_t t )
+{
+    int low, high, mid;
+
+    //First change after t
+    low = 0;
+    high = tz->ntrans;
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+        if (t < tz->trans[mid].at)
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+    return(low == 0 ? tz->initial : tz->trans[low-1].after);
+}
+
+void freeCalTz( CalTz *tz )
+{
+    if (tz == NULL)
+    {
+        return;
+    }
+    free(tz->tzid);
+    free(tz->trans);
+    free(tz);
+}
+
+/*latestYear
+*
+* Purpose: To find the latest year of any date in a component and its subcomponents.
+*
+* Arguments: The component (const CalComp*) and the latest year found so far (int)
+*
+* Returns: The latest year
+********************************************************************************************/
+static int latestYear(const CalComp *comp, int year)
+{
+    CalIter iter;
+    CalProp *prop;
+
+    initCalIter(&iter,comp);
+    while ((prop = nextCalProp(&iter)) != NULL)
+    {
+        if (prop->date != NULL && prop->date->year > year)
+        {
+            year = prop->date->year;
+        }
+    }
+    return(year);
+}
+
+/*compileZone
+*
+* Purpose: To compile the timezone of a TZID: from the calendar's VTIMEZONE with that TZID,
+*          or else from the system's zoneinfo.
+*
+* Arguments: The calendar (const CalComp*), the TZID (const char*) and the last year the
+*            table must cover (int)
+*
+* Returns: The timezone, or NULL if the TZID is unknown
+********************************************************************************************/
+static CalTz *compileZone(const CalComp *cal, const char *tzid, int toYear)
+{
+    const CalComp *vtimezone;
+
+    for (int i = 0; i < cal->ncomps; i++)
+    {
+        vtimezone = cal->comp[i];
+        if (vtimezone->kind != COMP_VTIMEZONE)
+        {
+            continue;
+        }
+        for (CalProp *prop = vtimezone->prop; prop != NULL; prop = prop->next)
+        {
+            if (prop->kind == PROP_TZID && strcmp(prop->value,tzid) == 0)
+            {
+                return(compileCalTimezone(vtimezone,toYear));
+            }
+        }
+    }
+    return(loadCalZoneinfo(tzid,toYear));
+}
+
+/*resolveComp
+*
+* Purpose: To set the instant of the UTC and TZID-qualified dates of a component and its subcomponents.
+*
+* Arguments: The component (CalComp*), the zones of its calendar (CalTzCache*) and the last
+*            year their tables must cover (int; 0 for the cache's default)
+********************************************************************************************/
+static void resolveComp(CalComp *comp, CalTzCache *zones, int toYear)
+{
+    const CalTz *tz;
+    char tzid[CAL_TZID_MAX];
+    CalIter iter;
+    CalProp *prop;
+
+    initCalIter(&iter,comp);
+    while ((prop = nextCalProp(&iter)) != NULL)
+    {
+        if (prop->date == NULL || prop->date->zone == CAL_FLOATING)
+        {
+            continue;
+        }
+        if (prop->date->zone == CAL_UTC)
+        {
+            prop->date->t = calWallSeconds(prop->date);
+            continue;
+        }
+
+        if (!getCalPropTzid(prop,tzid,sizeof(tzid)))
+        {
+            continue;
+        }
+        tz = findCalTz(zones,tzid,toYear);
+        if (tz != NULL)
+        {
+            prop->date->t = calTzToUtc(tz,calWallSeconds(prop->date));
+        }
+    }
+}
+
+int getCalPropTzid( const CalProp *prop, char *tzid, size_t size )
+{
+    const char *value;
+    size_t len;
+
+    for (CalParam *param = prop->param; param != NULL; param = param->next)
+    {
+        if (strcmp(param->name,"TZID") != 0 || param->nvalues == 0)
+        {
+            continue;
+        }
+
+        //The name may be quoted
+        value = param->value[0];
+        len = strlen(value);
+        if (len >= 2 && value[0] == '"' && value[len-1] == '"')
+        {
+            value += 1;
+            len -= 2;
+        }
+        if (len >= size)
+        {
+            return(0);
+        }
+        memcpy(tzid,value,len);
+        tzid[len] = '\0';
+        return(1);
+    }
+    return(0);
+}
+
+CalTzCache *InitializeCalTzCache( const CalComp *cal )
+{
+    CalTzCache *zones;
+
+    zones = malloc(sizeof(CalTzCache));
+    assert(zones != NULL);
+    zones->cal = cal;
+    zones->toYear = latestYear(cal,1970) + 1;
+    if (zones->toYear > 9999)
+    {
+        zones->toYear = 9999;
+    }
+    zones->nzones = 0;
+    zones->tzid = NULL;
+    zones->year = NULL;
+    zones->zone = NULL;
+    return(zones);
+}
+
+void updateCalTzCache( CalTzCache *zones, const CalComp *cal )
+{
+    zones->cal = cal;
+}
+
+const CalTz *findCalTz( CalTzCache *zones, const char *tzid, int toYear )
+{
+    int n;
+
+    if (toYear < zones->toYear)
+    {
+        toYear = zones->toYear;
+    }
+    if (toYear > 9999)
+    {
+        toYear = 9999;
+    }
+    for (int i = 0; i < zones->nzones; i++)
+    {
+        if (strcmp(zones->tzid[i],tzid) == 0 && (zones->year[i] >= toYear || zones->zone[i] == NULL))
+        {
+            return(zones->zone[i]);
+        }
+    }
+
+    //First use of the name, or its table must reach further; older tables stay valid
+    n = zones->nzones;
+    zones->tzid = realloc(zones->tzid,sizeof(char*)*(n+1));
+    zones->year = realloc(zones->year,sizeof(int)*(n+1));
+    zones->zone = realloc(zones->zone,sizeof(CalTz*)*(n+1));
+    assert(zones->tzid != NULL && zones->year != NULL && zones->zone != NULL);
+    zones->tzid[n] = malloc(strlen(tzid)+1);
+    assert(zones->tzid[n] != NULL);
+    strcpy(zones->tzid[n],tzid);
+    zones->year[n] = toYear;
+    zones->zone[n] = compileZone(zones->cal,tzid,toYear);
+    zones->nzones += 1;
+    return(zones->zone[n]);
+}
+
+void freeCalTzCache( CalTzCache *zones )
+{
+    if (zones == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < zones->nzones; i++)
+    {
+        free(zones->tzid[i]);
+        freeCalTz(zones->zone[i]);
+    }
+    free(zones->tzid);
+    free(zones->year);
+    free(zones->zone);
+    free(zones);
+}
+
+void resolveCalTimes( CalComp *const comp )
+{
+    CalTzCache *zones;
+
+    zones = InitializeCalTzCache(comp);
+    resolveComp(comp,zones,0);
+    freeCalTzCache(zones);
+}
+
+void resolveCalCompTimes( CalComp *const comp, CalTzCache *zones )
+{
+    resolveComp(comp,zones,latestYear(comp,1970) + 1);
+}
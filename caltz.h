@@ -0,0 +1,161 @@
+/********
+* caltz.h -- Public interface for the timezone functions in caltz.c
+*
+* Resolves UTC and TZID-qualified DATE-TIME values of a calendar to seconds since
+* the epoch, using the calendar's VTIMEZONE components or the system's zoneinfo.
+*
+********/
+
+#ifndef CALTZ_H
+#define CALTZ_H
+
+#include "calutil.h"
+
+#define ZONEINFO_DIR "/usr/share/zoneinfo" // system timezone database (the TZDIR environment variable overrides)
+#define ZONEINFO_MAX 1048576 // largest zoneinfo file read
+#define CAL_TZID_MAX 256     // longest TZID looked up, with its terminating null
+
+typedef struct CalTzTrans {  // change of a timezone's offset from UTC
+    time_t at;          // UTC instant of the change
+    long before;        // offset from UTC (seconds east) before the change
+    long after;         // offset from UTC from the change on
+} CalTzTrans;
+
+typedef struct CalTz {       // timezone compiled to a table of offset changes
+    char *tzid;
+    long initial;       // offset before the first change (or always, if there is none)
+    int ntrans;         // no. of changes
+    CalTzTrans *trans;  // changes sorted by instant
+} CalTz;
+
+/* Timezones compiled for one calendar, each the first time its TZID is asked for.
+   Defined in caltz.c; create with InitializeCalTzCache. */
+typedef struct CalTzCache CalTzCache;
+
+/*compileCalTimezone
+*
+* Purpose: To compile a VTIMEZONE component into a table of offset changes. Every
+*          STANDARD and DAYLIGHT observance contributes its DTSTART, its RDATEs and the
+*          onsets of its RRULE (see InitializeCalRecurRule).
+*
+* Arguments: The VTIMEZONE (const CalComp*), and the last year the table must cover (int)
+*
+* Returns: The timezone (free with freeCalTz), or NULL if the component has no TZID or
+*          no usable observance
+********************************************************************************************/
+CalTz *compileCalTimezone( const CalComp *vtimezone, int toYear );
+
+/*loadCalZoneinfo
+*
+* Purpose: To compile a zone of the system's timezone database (a TZif file, such as
+*          /usr/share/zoneinfo/America/Toronto) into a table of offset changes. Years after
+*          the file's last change are generated from its POSIX TZ rule.
+*
+* Arguments: The zone's name (const char*), and the last year the table must cover (int)
+*
+* Returns: The timezone (free with freeCalTz), or NULL if there is no such zone
+********************************************************************************************/
+CalTz *loadCalZoneinfo( const char *tzid, int toYear );
+
+/*calTzToUtc
+*
+* Purpose: To find the instant of a wall time in a timezone by binary search of its changes.
+*          As RFC 5545 requires, a repeated time is the first occurrence and a time skipped
+*          by a change is read with the offset from before the change.
+*
+* Arguments: The timezone (const CalTz*), and the wall time as seconds from 1970-01-01 00:00
+*            as if it were UTC (long, see calWallSeconds)
+*
+* Returns: Seconds since the epoch
+********************************************************************************************/
+time_t calTzToUtc( const CalTz *tz, long wall );
+
+/*calTzOffset
+*
+* Purpose: To find a timezone's offset from UTC at an instant.
+*
+* Arguments: The timezone (const CalTz*) and seconds since the epoch (time_t)
+*
+* Returns: The offset in seconds east of UTC
+********************************************************************************************/
+long calTzOffset( const CalTz *tz, time_t t );
+
+/*freeCalTz
+*
+* Purpose: To free a timezone returned by compileCalTimezone or loadCalZoneinfo.
+********************************************************************************************/
+void freeCalTz( CalTz *tz );
+
+/*getCalPropTzid
+*
+* Purpose: To find the TZID parameter of a property, without the quotes it may have.
+*
+* Arguments: The property (const CalProp*), and the buffer to copy the TZID to and its size (char*, size_t)
+*
+* Returns: 1 if the property has a TZID that fits, 0 otherwise
+********************************************************************************************/
+int getCalPropTzid( const CalProp *prop, char *tzid, size_t size );
+
+/*InitializeCalTzCache
+*
+* Purpose: To create an empty cache of the timezones of a calendar. Tables cover the years
+*          up to the year after the calendar's latest date, unless findCalTz asks for more.
+*
+* Arguments: The VCALENDAR (const CalComp*), which must outlive the cache
+*
+* Returns: The cache (free with freeCalTzCache)
+********************************************************************************************/
+CalTzCache *InitializeCalTzCache( const CalComp *cal );
+
+/*findCalTz
+*
+* Purpose: To find the timezone of a TZID, compiling it the first time it is asked for (or
+*          again, if its table must cover later years): from the calendar's VTIMEZONE of that
+*          name, or else from the system's zoneinfo.
+*
+* Arguments: The cache (CalTzCache*), the TZID (const char*), and the last year the table
+*            must cover (int; 0 for the cache's default)
+*
+* Returns: The timezone, valid until the cache is freed, or NULL if the TZID is unknown
+********************************************************************************************/
+const CalTz *findCalTz( CalTzCache *zones, const char *tzid, int toYear );
+
+/*updateCalTzCache
+*
+* Purpose: To point a cache at its calendar again after the calendar has moved or gained
+*          VTIMEZONEs (e.g. while it is read a component at a time). Zones already compiled,
+*          or already found to be unknown, are kept.
+*
+* Arguments: The cache (CalTzCache*) and the calendar (const CalComp*)
+********************************************************************************************/
+void updateCalTzCache( CalTzCache *zones, const CalComp *cal );
+
+/*freeCalTzCache
+*
+* Purpose: To free a cache and every timezone compiled for it.
+********************************************************************************************/
+void freeCalTzCache( CalTzCache *zones );
+
+/*resolveCalTimes
+*
+* Purpose: To set the instant (t) of every UTC and TZID-qualified date in a calendar.
+*          Each TZID is compiled once, from the calendar's VTIMEZONE of that name or else
+*          from the system's zoneinfo; dates with an unknown TZID stay in local time.
+*          readCalFile calls this after a successful read.
+*
+* Arguments: The VCALENDAR (CalComp*)
+********************************************************************************************/
+void resolveCalTimes( CalComp *const comp );
+
+/*resolveCalCompTimes
+*
+* Purpose: To set the instant of every UTC and TZID-qualified date in one component of a
+*          calendar (and its subcomponents), with the zones of a cache whose calendar has the
+*          VTIMEZONEs. Tables are made to cover the component's latest date. readCalStream
+*          calls this for each component it reads.
+*
+* Arguments: The component (CalComp*) and the cache (CalTzCache*)
+********************************************************************************************/
+void resolveCalCompTimes( CalComp *const comp, CalTzCache *zones );
+
+#endif
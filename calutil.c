@@ -13,6 +13,218 @@
 
 
 #include "calutil.h"
+#include "caltz.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+//scanLineText and countLines compare 32 characters at a time where SSE2 is available (all of x86-64)
+#if defined(__SSE2__) && defined(__GNUC__)
+#define CAL_SCAN_SSE2 1
+#include <emmintrin.h>
+#else
+#define CAL_SCAN_SSE2 0
+#endif
+
+/* Source of calendar text for the readers: either a whole regular file mapped into
+   memory, or a block buffer refilled from a descriptor (pipe) or a FILE stream.
+   Also holds the state readCalLine used to keep in static variables. */
+typedef struct CalInput {
+    FILE *file;         // FILE stream source (readCalFile shim) or NULL
+    int fd;             // descriptor source or -1
+    char *data;         // mapped file or block buffer
+    size_t len;         // no. of valid bytes in data
+    size_t pos;         // next unread byte in data
+    int mapped;         // 1 if data is a mapping of the file
+    int eof;            // 1 once the source has no more blocks
+
+    char *line;         // unfolded contentline being read (null terminated)
+    size_t lineLen;     // length of line
+    size_t lineSize;    // allocated size of line
+    int endR;           // a '\r' was read and a '\n' is expected
+    int buffUsed;       // chars read since the last READ_BUFF_SIZE-1 boundary or line end
+    int carry;          // 1 if carryCh (read while checking for folding) starts the next line
+    char carryCh;
+    size_t lineStart;   // offset in a mapped file of the first character of the line
+    size_t lineEnd;     // offset of the '\r' that ended the line (0 if it did not end with CRLF)
+    int folds;          // no. of folds taken out of the line
+    CalStatus stat;     // line numbers of the last line read
+} CalInput;
+
+/* Everything needed to read one calendar. Parsers share no state, so separate
+   calendars can be read at the same time (e.g. on different threads). */
+struct CalParser {
+    CalInput in;        // source and line state
+    int depth;          // nesting depth of the component being read
+    int options;        // CAL_ARENA ...
+    const CalStreamCallbacks *stream;   // readCalStream's callbacks (NULL when reading a tree)
+    CalTzCache *zones;  // zones of the calendar being streamed
+    int vComponent;     // 1 once a streamed component's name starts with 'V'
+    int streamed;       // no. of components streamed
+    CalArena *spare;    // arena of a streamed component, emptied for the next one (or NULL)
+    int threads;        // most threads reading a mapped calendar (setCalParserThreads)
+    int ranOut;         // 1 once readCalCompEx has stopped at the end of the input
+};
+
+/* Memory for a calendar tree, handed out from large blocks and freed all at once */
+typedef struct CalArenaBlock CalArenaBlock;
+struct CalArenaBlock {
+    CalArenaBlock *next;    // blocks filled earlier
+    size_t size;            // bytes in data
+    size_t used;            // bytes of data handed out
+    char data[];
+};
+
+struct CalArena {
+    CalArenaBlock *block;   // block being filled (-> older blocks)
+    CalComp *root;          // component whose freeCalComp frees the arena
+    size_t used;            // bytes handed out and still part of the tree
+    size_t wasted;          // bytes dropped, lost to alignment or left at the end of full blocks
+    char *map;              // mapped file the raw values of the tree point into (or NULL)
+    size_t mapLen;          // length of map
+};
+
+/* A run of top level components of a mapped calendar, parsed on its own (see readChunks) */
+typedef struct CalChunk {
+    size_t from, to;    // bytes of the mapped file
+    CalComp *cal;       // VCALENDAR holding the run's components and properties (NULL if it failed)
+    int lines;          // no. of lines in the run
+} CalChunk;
+
+/* The runs shared by the threads of readChunks; each thread takes the next run not yet taken */
+typedef struct CalChunkWork {
+    const char *data;   // mapped file
+    int options;        // options of the calendar's parser (CAL_ARENA ...)
+    CalChunk *chunks;
+    int nchunks;
+    atomic_int next;    // index of the next run to parse
+} CalChunkWork;
+
+/* Text on its way to a stream: writeCalComp and the functions that write part of a calendar
+   gather their lines here and hand them to the stream CAL_WRITE_FLUSH bytes at a time */
+typedef struct CalWriter {
+    FILE *ics;          // stream the text goes to, or NULL to keep all of it (writeCalCompToBuffer)
+    char *buff;         // text not yet handed to the stream (local, or allocated once it outgrows it)
+    size_t len;         // bytes in buff
+    size_t size;        // bytes buff has room for
+    int lines;          // lines ended so far, whether handed to the stream or not
+    int written;        // lines the stream has taken
+    int col;            // characters on the physical line being written
+    int folded;         // whether that line was just folded (it goes on after a space)
+    CalError code;      // IOERR once the stream has refused text
+    char local[CAL_WRITE_LOCAL];
+} CalWriter;
+
+/* What writeCalComp would write for a component, added up by calCompLength and calCompLines */
+typedef struct CalLength {
+    size_t bytes;       // bytes of text
+    int lines;          // lines of text (if counting)
+    int counting;       // whether to count lines: copied text (CAL_SOURCE) is scanned for them
+} CalLength;
+
+/* A run of the subcomponents of a calendar written to memory on its own (see writeCalCompThreads),
+   or the calendar's head or tail */
+typedef struct CalWriteRange {
+    int from, to;       // subcomponents comp[from..to-1] of the calendar
+    char *text;         // text they come to (malloced)
+    size_t len;         // bytes of text
+    int lines;          // lines of text
+} CalWriteRange;
+
+/* The runs shared by the threads of writeCalCompThreads; each thread takes the next run not yet taken */
+typedef struct CalWriteWork {
+    const CalComp *comp;    // calendar being written
+    CalWriteRange *ranges;
+    int nranges;
+    atomic_int next;        // index of the next run to write
+} CalWriteWork;
+
+/* Perfect-hash tables of the RFC 5545 property and component names. The hash of every
+   name below is distinct, so a name is identified by one hash and one strcmp. */
+typedef struct CalKindName {
+    const char *name;
+    int kind;
+} CalKindName;
+
+#define PROP_HASH_SIZE 128 // slots in propKinds (power of 2)
+#define COMP_HASH_SIZE 16  // slots in compKinds (power of 2)
+
+static const CalKindName propKinds[PROP_HASH_SIZE] = {
+    [2] = {"RELATED-TO", PROP_RELATED_TO},
+    [4] = {"TZOFFSETTO", PROP_TZOFFSETTO},
+    [17] = {"METHOD", PROP_METHOD},
+    [18] = {"TZNAME", PROP_TZNAME},
+    [23] = {"DTEND", PROP_DTEND},
+    [27] = {"TZURL", PROP_TZURL},
+    [28] = {"URL", PROP_URL},
+    [29] = {"DTSTAMP", PROP_DTSTAMP},
+    [30] = {"REPEAT", PROP_REPEAT},
+    [31] = {"RECURRENCE-ID", PROP_RECURRENCE_ID},
+    [36] = {"END", PROP_END},
+    [38] = {"CLASS", PROP_CLASS},
+    [39] = {"STATUS", PROP_STATUS},
+    [40] = {"FREEBUSY", PROP_FREEBUSY},
+    [42] = {"PRIORITY", PROP_PRIORITY},
+    [43] = {"DUE", PROP_DUE},
+    [47] = {"VERSION", PROP_VERSION},
+    [52] = {"PRODID", PROP_PRODID},
+    [54] = {"ORGANIZER", PROP_ORGANIZER},
+    [57] = {"ACTION", PROP_ACTION},
+    [59] = {"EXDATE", PROP_EXDATE},
+    [60] = {"REQUEST-STATUS", PROP_REQUEST_STATUS},
+    [61] = {"DTSTART", PROP_DTSTART},
+    [63] = {"DESCRIPTION", PROP_DESCRIPTION},
+    [65] = {"LAST-MODIFIED", PROP_LAST_MODIFIED},
+    [66] = {"COMMENT", PROP_COMMENT},
+    [68] = {"COMPLETED", PROP_COMPLETED},
+    [71] = {"SEQUENCE", PROP_SEQUENCE},
+    [74] = {"GEO", PROP_GEO},
+    [75] = {"CATEGORIES", PROP_CATEGORIES},
+    [78] = {"SUMMARY", PROP_SUMMARY},
+    [79] = {"BEGIN", PROP_BEGIN},
+    [85] = {"RDATE", PROP_RDATE},
+    [96] = {"CONTACT", PROP_CONTACT},
+    [97] = {"ATTENDEE", PROP_ATTENDEE},
+    [105] = {"CALSCALE", PROP_CALSCALE},
+    [106] = {"PERCENT-COMPLETE", PROP_PERCENT_COMPLETE},
+    [110] = {"UID", PROP_UID},
+    [112] = {"LOCATION", PROP_LOCATION},
+    [113] = {"RRULE", PROP_RRULE},
+    [114] = {"TZID", PROP_TZID},
+    [115] = {"RESOURCES", PROP_RESOURCES},
+    [116] = {"TRANSP", PROP_TRANSP},
+    [117] = {"TRIGGER", PROP_TRIGGER},
+    [118] = {"TZOFFSETFROM", PROP_TZOFFSETFROM},
+    [119] = {"ATTACH", PROP_ATTACH},
+    [124] = {"CREATED", PROP_CREATED},
+    [126] = {"DURATION", PROP_DURATION},
+};
+
+static const CalKindName compKinds[COMP_HASH_SIZE] = {
+    [1] = {"VCALENDAR", COMP_VCALENDAR},
+    [4] = {"VALARM", COMP_VALARM},
+    [5] = {"VTODO", COMP_VTODO},
+    [6] = {"DAYLIGHT", COMP_DAYLIGHT},
+    [9] = {"VFREEBUSY", COMP_VFREEBUSY},
+    [10] = {"VJOURNAL", COMP_VJOURNAL},
+    [11] = {"STANDARD", COMP_STANDARD},
+    [13] = {"VTIMEZONE", COMP_VTIMEZONE},
+    [14] = {"VEVENT", COMP_VEVENT},
+};
+
+static CalError parseProp(CalArena *arena, char *const buff, CalProp *const prop, const CalInput *in);
+
+/* parser used by the FILE* readCalComp and readCalLine functions */
+static CalParser fileShim;
 
 /*FreeCalParams
 *
@@ -24,25 +236,23 @@
 ********************************************************************************************/
 static void freeCalParams(CalParam *param)
 {
-    if (param == NULL)
-    {
-        return;
-    }
-    if (param->next != NULL)
-    {
-        freeCalParams(param->next);
-    }
-    free(param->name);
-    param->name = NULL;
+    CalParam *next;
 
-    for (int i = 0; i < param->nvalues; i++)
+    //one parameter at a time, so a long list takes no stack
+    while (param != NULL)
     {
-        free(param->value[i]);
-        param->value[i] = NULL;
+        next = param->next;
+        free(param->name);
+        param->name = NULL;
+
+        for (int i = 0; i < param->nvalues; i++)
+        {
+            free(param->value[i]);
+            param->value[i] = NULL;
+        }
+        free(param);
+        param = next;
     }
-    free(param);
-    param = NULL;
-    
 }
 
 /*FreeCalProps
@@ -55,84 +265,64 @@ static void freeCalParams(CalParam *param)
 ********************************************************************************************/
 static void freeCalProps(CalProp *prop)
 {
-    if(prop == NULL)
-    {
-        return;
-    }
-    if (prop->next != NULL)
-    {
-        freeCalProps(prop->next);
-    }
-    free(prop->name);
-    free(prop->value);
-    prop->name = NULL;
-    prop->value = NULL;
+    CalProp *next;
 
-    if (prop->nparams > 0)
+    //one property at a time, so a long list takes no stack
+    while (prop != NULL)
     {
-        freeCalParams(prop->param);
-    }
+        next = prop->next;
+        free(prop->name);
+        free(prop->value);
+        free(prop->date);
+        prop->name = NULL;
+        prop->value = NULL;
+        prop->date = NULL;
+
+        if (prop->nparams > 0)
+        {
+            freeCalParams(prop->param);
+        }
 
-    free(prop);
-    prop = NULL;
+        free(prop);
+        prop = next;
+    }
 }
 
-/*FreeCalComps
-*
-* Purpose: to free any allocated memory stoerd in a CalComp.
+/*freeCompVisit
 *
-* Arguments: A pointer to a CalComponent (CalComp*)
-*
-* PostCondtions: all memory stroed in the CalComp is freed
+* Purpose: To free a component and its properties once walkCalComp is done with its
+*          subcomponents (the post callback of freeCalComps).
 ********************************************************************************************/
-static void freeCalComps(CalComp *comp)
+static CalVisit freeCompVisit(const CalComp *visited, int depth, void *data)
 {
+    CalComp *comp = (CalComp *)visited;
+
     free(comp->name);
     comp->name = NULL;
     if (comp->nprops > 0)
     {
         freeCalProps(comp->prop);
     }
-
-    for (int i = 0; i < comp->ncomps; i++)
-    {
-        freeCalComps(comp->comp[i]);
-        
-    }
     free(comp);
-    comp = NULL;
-
+    return(CAL_VISIT);
 }
 
-/*expandString
+/*FreeCalComps
 *
-* Purpose: To dynamically increase the size of desired string by concatinating another string to it
+* Purpose: to free any allocated memory stoerd in a CalComp.
 *
-* Preconditions: addition is a null terminated String and is not NULL.
-
-* Arguments: A pointer to the string wished to be expaned (char **) and a pointer to the string 
-*            that it will be concatenated with (char *)
+* Arguments: A pointer to a CalComponent (CalComp*)
 *
-* Postconditions: The string will be concatinated with the addition string and will be the size of the added string
-*                  plus it's old size;
+* PostCondtions: all memory stroed in the CalComp is freed
 ********************************************************************************************/
-static void expandString(char **const string, char *addition)
+static void freeCalComps(CalComp *comp)
 {
-    if (*string == NULL)
-    {
-        *string = malloc(sizeof(char)*strlen(addition) + 1);
-        assert(*string != NULL);
-
-        strcpy(*string, addition);
-    }
-    else
-    {
-        *string = realloc(*string,strlen(*string) + strlen(addition) + 2);
-        assert(*string != NULL);
+    CalVisitor visitor = { NULL, NULL, freeCompVisit };
 
-        strcat(*string,addition);
-    }
+    //subcomponents are freed before the component that holds them
+    walkCalComp(comp,&visitor);
 }
+
 /*isEmpty
 *
 * Purpose: to determine is a string is made up of only Blank characters
@@ -155,39 +345,6 @@ static int isEmpty(char *string)
 }
 
 
-/*EndOfFileHandle
-*
-* Purpose: To expand a dynamic buffer based off a static buffer 
-*          or it will free and assign the dynamic buffer a status of NULL.
-*          Called when the EOF character is found while reading in lines from readCalLine.
-* Arguments: A pointer to the address of a dynamic string buffer (char **), a CalStatus, A pointer to 
-*            the static buffer (char*) and the amount of the static buffer used (int);
-* Returns: The CalStatus with potentially updated lines 
-********************************************************************************************/
-static CalStatus EndOfFileHandle(char **const pbuff, CalStatus stat, int *buffUsed, char buffer[READ_BUFF_SIZE])
-{
-    if (pbuff == NULL)
-    {
-        return(stat);
-    }
-
-    //If EOF and nothing is in the buffer
-    else if (*buffUsed == 0)
-    {
-        free(*pbuff);
-        *pbuff = NULL;
-        updateLines(&stat);
-    }
-
-    // If something is in the buffer
-    else if (!isEmpty(buffer))
-    {
-        buffer[*buffUsed] = '\0';
-        expandString(pbuff,buffer);
-        *buffUsed = 0;
-    }
-    return (stat);
-}
 /*VersionIdCheck
 *
 * Purpose: To look through a CalComp Scture and ensure it only has
@@ -207,7 +364,7 @@ static CalStatus VersionIDCheck(CalComp **pcomp, CalStatus stat)
     propNode = (*pcomp)->prop;
     while (propNode != NULL)
     {
-         if(strcmp(propNode->name,"VERSION") == 0)
+         if(propNode->kind == PROP_VERSION)
         {
             //Version numbers don't match: ERROR
             if (strcmp(propNode->value,VCAL_VER) != 0)
@@ -221,7 +378,7 @@ static CalStatus VersionIDCheck(CalComp **pcomp, CalStatus stat)
             }
 
         }
-        else if(strcmp(propNode->name,"PRODID") == 0)
+        else if(propNode->kind == PROP_PRODID)
         {
             idCount += 1;
         }
@@ -242,805 +399,3843 @@ static CalStatus VersionIDCheck(CalComp **pcomp, CalStatus stat)
     return(stat);
 }
 
-/*createParamLine
+/*initWriter
 *
-* Purpose: To create a string containg the information in a CalParam in the
-*          format: ';name=value1,value2,value3'
-* PreConditions: The ics files already open.
+* Purpose: To start gathering text for a stream in a CalWriter.
 *
-* Arguments: - The address to a CalParam containg information (calParam*).
-*
-* Returns:   - An allocated string containg the CalParam's information
-*              in the RFC format.
+* Arguments: The writer (CalWriter*) and the stream (FILE*)
+********************************************************************************************/
+static void initWriter(CalWriter *w, FILE *const ics)
+{
+    w->ics = ics;
+    w->buff = w->local;
+    w->len = 0;
+    w->size = CAL_WRITE_LOCAL;
+    w->lines = 0;
+    w->written = 0;
+    w->col = 0;
+    w->folded = 0;
+    w->code = (ics == NULL) ? IOERR : OK;
+}
+
+/*initMemoryWriter
 *
+* Purpose: To start gathering text in a CalWriter that keeps all of it, in an allocation
+*          (not its local buffer) that doubles as needed.
 *
+* Arguments: The writer (CalWriter*) and the bytes to allocate to start with (size_t, > 0)
 ********************************************************************************************/
-static char *createParamLine(CalParam *param)
+static void initMemoryWriter(CalWriter *w, size_t size)
 {
+    initWriter(w,NULL);
+    w->code = OK;
+    w->buff = malloc(size);
+    assert(w->buff != NULL);
+    w->size = size;
+}
 
-    /*NOTE: what if something is NULL/empty?*/
-    char *paramLine, *value;
-
-    paramLine = NULL;
-    //FORMAT: ';name=value1,value2,value3'
-
-    expandString(&paramLine,";\0");
-    //Add name to paramLine
-    expandString(&paramLine,param->name);
-
-    expandString(&paramLine,"=\0");
+/*flushWriter
+*
+* Purpose: To hand the text of a CalWriter to its stream. If the stream takes only part of it,
+*          the lines it did take are counted and the writer fails (IOERR); later text is dropped.
+*
+* Arguments: The writer (CalWriter*)
+********************************************************************************************/
+static void flushWriter(CalWriter *w)
+{
+    size_t done;
 
-    //paramLine is ';name='
-    for (int i = 0; i < param->nvalues; i++)
+    if (w->code == OK && w->len > 0)
     {
-        value = param->value[i];
-        expandString(&paramLine,value);
-
-        if(i != param->nvalues - 1)
+        done = fwrite(w->buff,1,w->len,w->ics);
+        if (done == w->len)
         {
-            expandString(&paramLine,",\0");
-        }      
+            w->written = w->lines;
+        }
+        else
+        {
+            for (size_t i = 0; i < done; i++)
+            {
+                w->written += (w->buff[i] == '\n');
+            }
+            w->code = IOERR;
+        }
     }
-    return(paramLine);
+    w->len = 0;
 }
 
-/*createPropertyLine
-*
-* Purpose: To create a string containg the information in a CalProp variable to be written 
-*          in the format: 'propName:propValue' or 
-*          'propName;paramName=paramValue1,paramValue2;paramName=paramValue:PropValue'
-*
-* PreConditions: The ics files already open.
+/*reserveWriter
 *
-* Arguments: - The address to a CalProperty containg information (calProp*).
+* Purpose: To make room for more text in a CalWriter: its text goes to the stream once there
+*          are CAL_WRITE_FLUSH bytes of it, and until then the buffer doubles as needed.
 *
-* Returns:   - An allocated string containg the CalProperty's information
-*              in the RFC format.
+* Arguments: The writer (CalWriter*) and the number of bytes to add (size_t)
 *
-********************************************************************************************/  
-
-static char *createPropertyLine(CalProp *prop)
+* Returns: Where to put them
+********************************************************************************************/
+static char *reserveWriter(CalWriter *w, size_t n)
 {
-    CalParam *writeParam;
-    char *propLine, *paramLine;
-
-    propLine = NULL;
-    paramLine = NULL;
-    writeParam = NULL;
-
-    //NAME:VALUE or
-    //NAME; pName=pValue,pValue,Pvalue; pName=pValue:Value
-
-    //name
-    expandString(&propLine,prop->name);
-    
-    //Parameters
-    writeParam = prop->param;
-    while (writeParam != NULL)
-    {
-        paramLine = createParamLine(writeParam);
+    char *buff;
 
-        //Concatinate parameter line to propline
-        expandString(&propLine,paramLine);
-        free(paramLine);
-        paramLine = NULL;
-
-        writeParam = writeParam->next;
-    }
-    //No parameters
-    if (paramLine != NULL)
+    if (w->len + n > w->size)
     {
-        expandString(&propLine,paramLine);
-        free(paramLine);
-        paramLine = NULL;
+        if (w->len >= CAL_WRITE_FLUSH && w->ics != NULL)
+        {
+            flushWriter(w);
+        }
+        if (w->len + n > w->size)
+        {
+            while (w->len + n > w->size)
+            {
+                w->size *= 2;
+            }
+            if (w->buff == w->local)
+            {
+                buff = malloc(w->size);
+                assert(buff != NULL);
+                memcpy(buff,w->local,w->len);
+            }
+            else
+            {
+                buff = realloc(w->buff,w->size);
+                assert(buff != NULL);
+            }
+            w->buff = buff;
+        }
     }
-    expandString(&propLine,":\0");
-    expandString(&propLine,prop->value);
-    
-    free(paramLine);
-    return(propLine);
-    
+    return(w->buff + w->len);
 }
-/*writeLine
-*
-* Purpose: To write a string to an ics file. Will write the string to the file
-*          in multipal lines (if necessary) no more than FOLD_LEN characters.
-*          All lines written after the frist line will begin with a space.
-*
-* PreConditions: The ics files already open.
+
+/*endWriter
 *
-* Arguments: - A pointer to and ics file (FILE*).
-*            - A String (char *).
+* Purpose: To hand the rest of a CalWriter's text to its stream and free its buffer.
 *
-* Returns:   - A CalStatus variable that contains the number of lines written in its 
-*              lineto and linefrom variables
+* Arguments: The writer (CalWriter*)
 *
-* PostConditions: - The string will be written to the file and a CalStatus var
+* Returns: The CalStatus of the write: the number of lines the stream took, and IOERR if it
+*          did not take them all
 ********************************************************************************************/
-static void writeLine(FILE *const ics, char *string, CalStatus *stat)
+static CalStatus endWriter(CalWriter *w)
 {
-    int writeCount;
-    int len;
+    CalStatus stat;
 
-    if (string == NULL || ics == NULL || stat == NULL)
+    flushWriter(w);
+    if (w->buff != w->local)
     {
-        return;
+        free(w->buff);
     }
+    w->buff = w->local;
+    w->size = CAL_WRITE_LOCAL;
+
+    stat = InitializeCalStatus();
+    stat.code = w->code;
+    stat.linefrom = w->written;
+    updateLines(&stat);
+    return(stat);
+}
 
-    writeCount = 0;
-    len = strlen(string);
+/*writeFolded
+*
+* Purpose: To add text to the line being written, folding it after every FOLD_LEN characters.
+*          The text is copied a span at a time; a fold's leading space is only added once
+*          there is more text after it.
+*
+* Arguments: The writer (CalWriter*) and the text and its length (const char*, size_t)
+********************************************************************************************/
+static void writeFolded(CalWriter *w, const char *text, size_t n)
+{
+    char *out;
+    size_t take;
 
-    for(int i = 0; i < len; i++)
+    while (n > 0)
     {
-        //ERROR on EOF
-        if(fputc(string[i],ics) == EOF)
+        //A folded line goes on after a space
+        if (w->folded)
         {
-            updateLines(stat);
-            stat->code = IOERR;
-            return;
+            *reserveWriter(w,1) = ' ';
+            w->len += 1;
+            w->folded = 0;
+            w->col = 1;
         }
-        writeCount += 1;
 
-        //Fold line
-        if (writeCount == FOLD_LEN)
+        take = FOLD_LEN - w->col;
+        if (take > n)
         {
-            //Write EOL chars
-            //ERROR on EOF
-            if(fputc('\r',ics) == EOF || fputc('\n',ics) == EOF)
-            {
-                updateLines(stat);
-                stat->code = IOERR;
-                return;
-            }
+            take = n;
+        }
+        out = reserveWriter(w,take + 2);
+        memcpy(out,text,take);
+        w->len += take;
+        w->col += take;
+        text += take;
+        n -= take;
 
-            stat->linefrom += 1;
-            fflush(ics);
-            writeCount = 0;
-            
-            //If there is at least 1 more character to write
-            if (i != len-1)
-            {
-                //ERROR on EOF
-                if (fputc(' ',ics) == EOF)
-                {
-                    updateLines(stat);
-                    stat->code = IOERR;
-                    return;
-                }
-                writeCount += 1;
-            }
+        //Fold line
+        if (w->col == FOLD_LEN)
+        {
+            w->buff[w->len] = '\r';
+            w->buff[w->len+1] = '\n';
+            w->len += 2;
+            w->lines += 1;
+            w->col = 0;
+            w->folded = 1;
         }
     }
-    if (writeCount != 0)
+}
+
+/*writeUnfolded
+*
+* Purpose: To add a raw value (see CAL_SLICES) to the line being written, straight from where
+*          it is kept. Its folds (CRLF and a space or tab) are left out, so it is folded again
+*          exactly as if it had been copied.
+*
+* Arguments: The writer (CalWriter*) and the raw value and its length (const char*, size_t)
+********************************************************************************************/
+static void writeUnfolded(CalWriter *w, const char *raw, size_t n)
+{
+    const char *fold, *end;
+
+    end = raw + n;
+    while (raw < end)
     {
-        //Write EOL chars and ERROR on EOF
-        if(fputc('\r',ics) == EOF || fputc('\n',ics) == EOF)
+        fold = memchr(raw,'\r',end - raw);
+        if (fold == NULL)
         {
-            updateLines(stat);
-            stat->code = IOERR;
-            return;
+            fold = end;
         }
-
-        stat->linefrom += 1;
-        fflush(ics);
+        writeFolded(w,raw,fold - raw);
+        raw = (end - fold > 3) ? fold + 3 : end;
     }
-    updateLines(stat);
+}
 
+/*endLine
+*
+* Purpose: To end the line being written with CRLF, unless a fold has just ended it.
+*
+* Arguments: The writer (CalWriter*)
+********************************************************************************************/
+static void endLine(CalWriter *w)
+{
+    if (w->col != 0)
+    {
+        reserveWriter(w,2);
+        w->buff[w->len] = '\r';
+        w->buff[w->len+1] = '\n';
+        w->len += 2;
+        w->lines += 1;
+    }
+    w->col = 0;
+    w->folded = 0;
 }
 
-CalStatus readCalFile( FILE *const ics, CalComp **const pcomp )
+/*reserveLine
+*
+* Purpose: To make room in a CalWriter for a whole line of text before it is written, so it
+*          is copied without checking for room again and the text goes to the stream a whole
+*          line at a time.
+*
+* Arguments: The writer (CalWriter*) and the length of the line before folding (size_t)
+********************************************************************************************/
+static void reserveLine(CalWriter *w, size_t n)
 {
+    //Every fold adds CRLF and a space, at least FOLD_LEN-1 characters apart
+    reserveWriter(w,n + (n / (FOLD_LEN - 1) + 1) * 3 + 2);
+}
 
-    CalStatus stat;
-    int vComponent = 0;
-    char *string;
-    string = NULL;
-    
-    stat = readCalLine(NULL,NULL);
+/*unfoldedLength
+*
+* Purpose: To find the length of a raw value (see CAL_SLICES) less its folds, as writeUnfolded
+*          writes it.
+*
+* Arguments: The raw value and its length (const char*, size_t)
+*
+* Returns: The length (size_t)
+********************************************************************************************/
+static size_t unfoldedLength(const char *raw, size_t n)
+{
+    const char *fold, *end;
+    size_t len;
 
-    *pcomp =InitializeCalComp();
+    len = 0;
+    end = raw + n;
+    while (raw < end)
+    {
+        fold = memchr(raw,'\r',end - raw);
+        if (fold == NULL)
+        {
+            fold = end;
+        }
+        len += fold - raw;
+        raw = (end - fold > 3) ? fold + 3 : end;
+    }
+    return(len);
+}
 
-    //Read in the CalFile
-    stat = readCalComp(ics,pcomp);
+/*foldedLength
+*
+* Purpose: To find the bytes a line takes once it is folded the way writeFolded folds it: the
+*          first FOLD_LEN characters, then a space and FOLD_LEN-1 more on each line after, each
+*          line ending with CRLF.
+*
+* Arguments: The length of the line before folding (size_t)
+*
+* Returns: The length (size_t); 0 for an empty line, which is not written
+********************************************************************************************/
+static size_t foldedLength(size_t n)
+{
+    size_t more;
 
-    if (stat.code != OK)
+    if (n == 0)
     {
-        freeCalComp(*pcomp);
-        return(stat);
+        return(0);
     }
+    //lines after the first, rounded up
+    more = (n > FOLD_LEN) ? (n - FOLD_LEN + (FOLD_LEN - 2)) / (FOLD_LEN - 1) : 0;
+    return(n + 2 + more * 3);
+}
 
-    // Check for the letter V in component's name
-    for (int i = 0; i < (*pcomp)->ncomps; i++)
+/*foldedLines
+*
+* Purpose: To find the lines a line takes once it is folded the way writeFolded folds it.
+*
+* Arguments: The length of the line before folding (size_t)
+*
+* Returns: The number of lines; 0 for an empty line, which is not written
+********************************************************************************************/
+static int foldedLines(size_t n)
+{
+    if (n == 0)
     {
+        return(0);
+    }
+    return(1 + ((n > FOLD_LEN) ? (n - FOLD_LEN + (FOLD_LEN - 2)) / (FOLD_LEN - 1) : 0));
+}
 
-        if((*pcomp)->comp[i]->name[0] == 'V')
+/*propertyLength
+*
+* Purpose: To find the length of a property's line before it is folded:
+*          'NAME;PARAM=VALUE1,VALUE2:VALUE'.
+*
+* Arguments: - The property (const CalProp*).
+*
+* Returns: The length (size_t)
+********************************************************************************************/
+static size_t propertyLength(const CalProp *prop)
+{
+    const CalParam *param;
+    size_t n;
+
+    n = strlen(prop->name) + 1;
+    n += (prop->value != NULL) ? strlen(prop->value) : unfoldedLength(prop->raw,prop->rawLen);
+    for (param = prop->param; param != NULL; param = param->next)
+    {
+        //';' and '=', and a ',' between values
+        n += strlen(param->name) + 2;
+        for (int i = 0; i < param->nvalues; i++)
         {
-            vComponent = 1;
-            break;
+            n += strlen(param->value[i]) + (i > 0);
         }
-
     }
-    //No components with the letter V and/or no components exist
-    if (vComponent != 1)
+    return(n);
+}
+
+/*writePropertyLine
+*
+* Purpose: To write a property to an ics file in the format: 'NAME:VALUE' or
+*          'NAME;PARAM=VALUE1,VALUE2;PARAM=VALUE:VALUE'. Each part is folded into the writer
+*          where it is kept, and the value is its raw value as it was read if it has no
+*          other (see CAL_SLICES).
+*
+* Arguments: - The writer (CalWriter*).
+*            - The property (const CalProp*).
+*
+* PostConditions: - The line is added to the writer's text, and counted in its lines
+********************************************************************************************/
+static void writePropertyLine(CalWriter *w, const CalProp *prop)
+{
+    const CalParam *param;
+    const char *value;
+
+    if (w->code != OK)
     {
-        stat.code = NOCAL;
-        freeCalComp(*pcomp);
-        return (stat);
+        return;
     }
 
-    stat = VersionIDCheck(pcomp,stat);
-    if (stat.code != OK)
+    reserveLine(w,propertyLength(prop));
+    writeFolded(w,prop->name,strlen(prop->name));
+    for (param = prop->param; param != NULL; param = param->next)
     {
-        freeCalComp(*pcomp);
-        return(stat);
+        writeFolded(w,";",1);
+        writeFolded(w,param->name,strlen(param->name));
+        writeFolded(w,"=",1);
+        for (int i = 0; i < param->nvalues; i++)
+        {
+            if (i > 0)
+            {
+                writeFolded(w,",",1);
+            }
+            value = param->value[i];
+            writeFolded(w,value,strlen(value));
+        }
     }
+    writeFolded(w,":",1);
 
-    //Check if there is something past 'END: VCALENDAR'
-    stat = readCalLine(ics,&string);
-    if (string != NULL)
+    if (prop->value != NULL)
     {
-        stat.code = AFTEND;
-        free(string);
-        freeCalComp(*pcomp);
-        return(stat);
+        writeFolded(w,prop->value,strlen(prop->value));
     }
-    return(stat);
+    else
+    {
+        writeUnfolded(w,prop->raw,prop->rawLen);
+    }
+    endLine(w);
 }
 
-CalStatus readCalComp( FILE *const ics, CalComp **const pcomp )
+/*countLines
+*
+* Purpose: To count the lines of a text by its '\n's, 32 characters at a time with SSE2.
+*
+* Arguments: The text and its length (const char*, size_t)
+*
+* Returns: The number of '\n's
+********************************************************************************************/
+static int countLines(const char *text, size_t n)
 {
+    size_t i;
+    int lines;
 
-    static int depth = 0; //depth become 0 at run time
-    CalStatus stat;
-    char *propLine, *upperName, *upperValue;
-    CalProp *property;
-    CalComp *newCalComp;
-
-    propLine = NULL;
-    property = NULL;
-    
-    //Read Line
-    stat = readCalLine(ics,&propLine);
+    i = 0;
+    lines = 0;
+#if CAL_SCAN_SSE2
+    const __m128i lf = _mm_set1_epi8('\n');
+    __m128i low, high;
 
-    if (stat.code != OK)
+    while (i + 32 <= n)
     {
-        free(propLine);
-        return(stat);
+        low = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(text+i)),lf);
+        high = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(text+i+16)),lf);
+        lines += __builtin_popcount((unsigned int)_mm_movemask_epi8(low) | ((unsigned int)_mm_movemask_epi8(high) << 16));
+        i += 32;
     }
-    while(propLine != NULL)
+#endif
+    for (; i < n; i++)
     {
-        
-        property = InitializeCalProp();
-
-        //Parse Line
-
-        stat.code = parseCalProp(propLine,property);
+        lines += (text[i] == '\n');
+    }
+    return(lines);
+}
 
-        free(propLine);
-        propLine = NULL;
-        if (stat.code != OK)
+/*writeSource
+*
+* Purpose: To copy a component's lines as they were read (CAL_SOURCE). A short text is added to
+*          the writer's; a long one goes to the stream straight from where it is, after the
+*          writer's text (unless the writer keeps its text). Its lines are counted as it is copied.
+*
+* Arguments: The writer (CalWriter*) and the text and its length (const char*, size_t)
+********************************************************************************************/
+static void writeSource(CalWriter *w, const char *text, size_t n)
+{
+    size_t done;
+    int lines;
+
+    lines = countLines(text,n);
+    if (n < CAL_WRITE_FLUSH || w->ics == NULL)
+    {
+        memcpy(reserveWriter(w,n),text,n);
+        w->len += n;
+        w->lines += lines;
+        return;
+    }
+
+    flushWriter(w);
+    if (w->code != OK)
+    {
+        return;
+    }
+    done = fwrite(text,1,n,w->ics);
+    w->lines += lines;
+    if (done == n)
+    {
+        w->written = w->lines;
+    }
+    else
+    {
+        w->written += countLines(text,done);
+        w->code = IOERR;
+    }
+}
+
+/*writeNameLine
+*
+* Purpose: To write a component's BEGIN or END line: the tag, then the component's name.
+*
+* Arguments: The writer (CalWriter*), the tag ("BEGIN:" or "END:") and the name (const char*)
+********************************************************************************************/
+static void writeNameLine(CalWriter *w, const char *tag, const char *name)
+{
+    size_t tagLen, nameLen;
+
+    if (w->code != OK)
+    {
+        return;
+    }
+
+    tagLen = strlen(tag);
+    nameLen = strlen(name);
+    reserveLine(w,tagLen + nameLen);
+    writeFolded(w,tag,tagLen);
+    writeFolded(w,name,nameLen);
+    endLine(w);
+}
+
+/*initInput
+*
+* Purpose: To set up a CalInput structure with no source.
+*
+* Arguments: A pointer to a CalInput (CalInput*)
+*
+* PostConditions: All of the input's variables are set to 0/NULL and its line numbers are reset.
+********************************************************************************************/
+static void initInput(CalInput *in)
+{
+    in->file = NULL;
+    in->fd = -1;
+    in->data = NULL;
+    in->len = 0;
+    in->pos = 0;
+    in->mapped = 0;
+    in->eof = 0;
+
+    in->line = NULL;
+    in->lineLen = 0;
+    in->lineSize = 0;
+    in->endR = 0;
+    in->buffUsed = 0;
+    in->carry = 0;
+    in->carryCh = '\0';
+    in->lineStart = 0;
+    in->lineEnd = 0;
+    in->folds = 0;
+    in->stat = InitializeCalStatus();
+}
+
+/*openInputFd
+*
+* Purpose: To attach a file descriptor to a CalInput. Regular files are mapped into memory
+*          in one piece (starting at the descriptor's current offset); anything else (pipes,
+*          terminals) is read in blocks of READ_BLOCK_SIZE bytes by refillInput.
+*
+* Arguments: A pointer to an initialized CalInput (CalInput*), and a descriptor open for reading (int)
+*
+* Returns: OK, or IOERR if the descriptor could not be examined or mapped.
+********************************************************************************************/
+static CalError openInputFd(CalInput *in, int fd)
+{
+    struct stat info;
+    off_t offset;
+    void *map;
+
+    in->fd = fd;
+    if (fstat(fd,&info) != 0)
+    {
+        return(IOERR);
+    }
+
+    offset = lseek(fd,0,SEEK_CUR);
+    if (S_ISREG(info.st_mode) && offset >= 0 && info.st_size > offset)
+    {
+        //map from the start of the file since mmap offsets must be page aligned
+        map = mmap(NULL,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+        if (map == MAP_FAILED)
         {
-            freeCalProps(property);
-            depth = 0;
-            return(stat);
+            return(IOERR);
         }
+        posix_madvise(map,info.st_size,POSIX_MADV_SEQUENTIAL);
 
-        //Malloc is inside toUpper()
-        upperName = toUpper(property->name);
-        upperValue = toUpper(property->value);
+        in->data = map;
+        in->len = info.st_size;
+        in->pos = offset;
+        in->mapped = 1;
+        in->eof = 1;
+    }
+    return(OK);
+}
 
-        if (strcmp(upperName,"BEGIN") == 0)
-        {
+/*closeInput
+*
+* Purpose: To release the memory held by a CalInput (the file mapping or block buffer, and the line buffer).
+*          The source file or descriptor itself is not closed.
+*
+* Arguments: A pointer to a CalInput (CalInput*)
+********************************************************************************************/
+static void closeInput(CalInput *in)
+{
+    if (in->mapped)
+    {
+        munmap(in->data,in->len);
+    }
+    else
+    {
+        free(in->data);
+    }
+    free(in->line);
+    initInput(in);
+}
 
-            if(depth != 0)
-            {
-                //Exceeds Nesting
-                if (depth == 3)
-                {
-                    stat.code = SUBCOM;
-                    free(upperName);
-                    free(upperValue);
-                    freeCalProps(property);
-                    depth = 0;
-                    return(stat);
-                }
-                depth += 1;
+/*initParser
+*
+* Purpose: To set up a CalParser with no source, at nesting depth 0.
+*
+* Arguments: A pointer to a CalParser (CalParser*)
+********************************************************************************************/
+static void initParser(CalParser *parser)
+{
+    initInput(&parser->in);
+    parser->depth = 0;
+    parser->options = 0;
+    parser->stream = NULL;
+    parser->zones = NULL;
+    parser->vComponent = 0;
+    parser->streamed = 0;
+    parser->spare = NULL;
+    parser->threads = 1;
+    parser->ranOut = 0;
+}
 
-                //Create a new comp and give it an UPPERCASE value
-                newCalComp = InitializeCalComp();
+/*seekInput
+*
+* Purpose: To make a mapped CalInput read from the start of a line up to a given offset, with
+*          its line numbers counted on from a given line (e.g. to read part of a file on
+*          another thread).
+*
+* Arguments: A pointer to a CalInput whose file is mapped (CalInput*), the offsets of the first
+*            byte to read and of the byte after the last (size_t), and the no. of lines before
+*            the first (int)
+********************************************************************************************/
+static void seekInput(CalInput *in, size_t from, size_t to, int lines)
+{
+    in->pos = from;
+    in->len = to;
+    in->lineLen = 0;
+    in->endR = 0;
+    in->buffUsed = 0;
+    in->carry = 0;
+    in->stat = InitializeCalStatus();
+    in->stat.linefrom = lines;
+    in->stat.lineto = lines;
+}
 
-                //memory is malloced in toUpper
-                newCalComp->name = upperValue;
-                upperValue = NULL;
+/*refillInput
+*
+* Purpose: To read the next block of the source into the input's block buffer once every byte
+*          of the previous block has been used.
+*
+* Arguments: A pointer to a CalInput (CalInput*)
+*
+* Returns: The number of new bytes available; 0 at the end of the source (or on a read error).
+********************************************************************************************/
+static size_t refillInput(CalInput *in)
+{
+    ssize_t got;
 
-                free(upperName);
-                free(upperValue);
-                freeCalProps(property);
-             
-                stat = readCalComp(ics,&newCalComp);
+    if (in->eof)
+    {
+        return(0);
+    }
+    if (in->data == NULL)
+    {
+        in->data = malloc(sizeof(char)*READ_BLOCK_SIZE);
+        assert(in->data != NULL);
+    }
 
-                expandCalComp(pcomp,newCalComp);
-                if (stat.code != OK)
-                {
-                    depth = 0;
-                    return(stat);
-                }
+    in->pos = 0;
+    in->len = 0;
+    if (in->file != NULL)
+    {
+        in->len = fread(in->data,sizeof(char),READ_BLOCK_SIZE,in->file);
+    }
+    else
+    {
+        do
+        {
+            got = read(in->fd,in->data,READ_BLOCK_SIZE);
+        } while (got < 0 && errno == EINTR);
 
-            }
-            //If the first card is being parsed
-            else if ((*pcomp)->name == NULL && strcmp(upperValue,"VCALENDAR") == 0)
-            {
-                (*pcomp)->name = upperValue;
-                upperValue = NULL;
-                depth = 1;
-                free(upperName);
-                free(upperValue);
-                freeCalProps(property);
-            }
-            else
-            {
-                stat.code = NOCAL;
-                free(upperName);
-                free(upperValue);
-                freeCalProps(property);
-                depth = 0;
-                return(stat);
-            }
-        }
-        else if(strcmp(upperName,"END") == 0)
+        if (got > 0)
         {
+            in->len = got;
+        }
+    }
 
-            //Error if NoData
-            if ((*pcomp)->nprops == 0 && (*pcomp)->ncomps == 0)
-            {
-                stat.code = NODATA;
-            }
-            //Error if BEGIN:x Does not match with END:x
-            else if (strcmp(upperValue,(*pcomp)->name) != 0)
-            {
-                stat.code = BEGEND;
-            }
+    if (in->len == 0)
+    {
+        in->eof = 1;
+    }
+    return(in->len);
+}
 
-            free(upperName);
-            free(upperValue);
-            freeCalProps(property);
-            
-            if (stat.code == OK)
-            {
-                depth -= 1;             
-            }
+/*nextInputChar
+*
+* Purpose: To take the next character from a CalInput, refilling its block buffer if needed.
+*
+* Arguments: A pointer to a CalInput (CalInput*)
+*
+* Returns: The character read, or EOF at the end of the source.
+********************************************************************************************/
+static int nextInputChar(CalInput *in)
+{
+    if (in->pos == in->len && refillInput(in) == 0)
+    {
+        return(EOF);
+    }
+    in->pos += 1;
 
-            return(stat);
+    //0xFF has always been read as EOF (fgetc into a char)
+    if (in->data[in->pos-1] == (char)EOF)
+    {
+        return(EOF);
+    }
+    return((unsigned char)in->data[in->pos-1]);
+}
+
+/*appendLine
+*
+* Purpose: To append characters to the line being built by readInputLine. The line buffer grows
+*          geometrically, so building a long (folded) line does not realloc per character.
+*
+* Arguments: A pointer to a CalInput (CalInput*), the characters to add (const char*) and
+*            the number of characters to add (size_t)
+*
+* PostConditions: The characters are added to the input's line, which stays null terminated.
+********************************************************************************************/
+static void appendLine(CalInput *in, const char *chars, size_t count)
+{
+    size_t newSize;
+
+    if (in->lineLen + count + 1 > in->lineSize)
+    {
+        newSize = in->lineSize == 0 ? READ_BUFF_SIZE+1 : in->lineSize;
+        while (in->lineLen + count + 1 > newSize)
+        {
+            newSize *= 2;
         }
-        //Regular property
-        else
+        in->line = realloc(in->line,newSize);
+        assert(in->line != NULL);
+        in->lineSize = newSize;
+    }
+    memcpy(in->line+in->lineLen,chars,count);
+    in->lineLen += count;
+    in->line[in->lineLen] = '\0';
+}
+
+/*scanLineText
+*
+* Purpose: To find the length of a run of characters that contains no '\r' or '\n'.
+*          With SSE2 (every x86-64 CPU) the run is compared 32 characters at a time and the
+*          first stop found from a bit mask; the tail, and other CPUs, go one character at a time.
+*
+* Arguments: The start of the run (const char*) and the number of characters available (size_t)
+*
+* Returns: The number of characters before the first '\r', '\n' or 0xFF, or the amount
+*          available if none of them occur.
+********************************************************************************************/
+static size_t scanLineText(const char *text, size_t avail)
+{
+    size_t i;
+
+    i = 0;
+#if CAL_SCAN_SSE2
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i ff = _mm_set1_epi8((char)EOF);
+    __m128i low, high;
+    unsigned int stops;
+
+    while (i + 32 <= avail)
+    {
+        low = _mm_loadu_si128((const __m128i *)(text+i));
+        high = _mm_loadu_si128((const __m128i *)(text+i+16));
+        low = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(low,cr),_mm_cmpeq_epi8(low,lf)),_mm_cmpeq_epi8(low,ff));
+        high = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(high,cr),_mm_cmpeq_epi8(high,lf)),_mm_cmpeq_epi8(high,ff));
+
+        //one bit per character, set where the run stops
+        stops = (unsigned int)_mm_movemask_epi8(low) | ((unsigned int)_mm_movemask_epi8(high) << 16);
+        if (stops != 0)
         {
-            free(upperName);
-            free(upperValue);
-            //Name should only be NULL if BEGIN:VACALENDAR is expected
-            if ((*pcomp)->name == NULL)
-            {
-                stat.code = NOCAL;
-                freeCalProps(property);
-                depth = 0;
-                return(stat);
-            }
-            insertProperty(pcomp,property);
+            return(i + __builtin_ctz(stops));
         }
-        
-        //Read Line
-        stat = readCalLine(ics,&propLine);
-        if (stat.code != OK)
+        i += 32;
+    }
+#endif
+    for (; i < avail; i++)
+    {
+        if (text[i] == '\r' || text[i] == '\n' || text[i] == (char)EOF)
         {
-            free(propLine);
-            depth = 0;
-            return(stat);
+            break;
         }
     }
-    if (depth != 0)
+    return(i);
+}
+
+/*EndOfInputHandle
+*
+* Purpose: To finish the line being read when the end of the input is found.
+*          Characters not yet committed to the line (see buffUsed) are kept unless they are
+*          all blank; if nothing is left, no line is returned.
+* Arguments: A pointer to a CalInput (CalInput*), the address of the line pointer to set (char **)
+*            and whether part of the line was already committed (int)
+* Returns: The CalStatus with potentially updated lines 
+********************************************************************************************/
+static CalStatus EndOfInputHandle(CalInput *in, char **const pbuff, int committed)
+{
+    //If EOF and nothing is in the buffer
+    if (in->buffUsed == 0)
+    {
+        *pbuff = NULL;
+        updateLines(&in->stat);
+    }
+    // If something is in the buffer
+    else if (!isEmpty(in->line+in->lineLen-in->buffUsed))
     {
-        stat.code = BEGEND;
+        *pbuff = in->line;
+        in->buffUsed = 0;
     }
-    return(stat);
+    else
+    {
+        in->lineLen -= in->buffUsed;
+        in->line[in->lineLen] = '\0';
+        if (committed)
+        {
+            *pbuff = in->line;
+        }
+    }
+    return(in->stat);
 }
 
-CalStatus readCalLine( FILE *const ics, char **const pbuff )
+/*readInputLine
+*
+* Purpose: To read one unfolded contentline from a CalInput. This follows the rules of
+*          readCalLine exactly (line numbers, folding, blank lines and NOCRNL), but copies
+*          whole runs of ordinary characters out of the mapped file or block buffer at once.
+*
+* Arguments: A pointer to a CalInput (CalInput*), and the address of a string pointer (char **)
+*
+* Returns: The status of the read. *pbuff points into the input's line buffer (valid until the
+*          next read) or is NULL at the end of the input or on error.
+********************************************************************************************/
+static CalStatus readInputLine(CalInput *in, char **const pbuff)
 {
-    static char buffer[READ_BUFF_SIZE];
-    static int endR = 0;
-    static int buffUsed = 0;
-    
-    static CalStatus stat;
-    
     int lineEnd = 0;
     int folded = 0;
     int incremented = 0;
-    char charIn;
+    int committed = 0;
+    int charIn;
+    size_t run;
 
-    if (ics == NULL)
+    *pbuff = NULL;
+    in->lineLen = 0;
+    appendLine(in,"",0);
+
+    //where the line is in a mapped file, for values left there (CAL_SLICES)
+    in->lineStart = in->carry ? in->pos-1 : in->pos;
+    in->lineEnd = 0;
+    in->folds = 0;
+
+    //a character read while checking the last line for folding starts this one
+    if (in->carry)
     {
-        endR = 0;
-        buffUsed = 0;
-        stat = InitializeCalStatus();
-        return(stat);
+        appendLine(in,&in->carryCh,1);
+        in->carry = 0;
     }
 
-    *pbuff = NULL;
-
-    updateLines(&stat);
+    updateLines(&in->stat);
     while (lineEnd == 0)
     {
-         
-        charIn = fgetc(ics);
+        charIn = nextInputChar(in);
         //End of File
         if (charIn == EOF)
         {
-            stat = EndOfFileHandle(pbuff,stat,&buffUsed,buffer);
-            return(stat);
+            in->lineEnd = 0;
+            return(EndOfInputHandle(in,pbuff,committed));
         }
 
         //Increment lines at the start when we know the file is not empty
         if (incremented == 0)
         {
-            stat.linefrom += 1;
-            stat.lineto += 1;
+            in->stat.linefrom += 1;
+            in->stat.lineto += 1;
             incremented = 1;
         }
 
-        //if not an ending character, add it to the buffer
+        //if not an ending character, add it and the rest of its run to the line
         if (charIn != '\r' && charIn != '\n')
         {
-            buffer[buffUsed] = charIn;
-            buffUsed += 1;
+            run = scanLineText(in->data+in->pos,in->len-in->pos);
+            appendLine(in,in->data+in->pos-1,run+1);
+            in->pos += run;
 
-            //copy buffer to pbuff if it is full
-            if (buffUsed == READ_BUFF_SIZE-1)
+            //buffUsed wraps the way readCalLine's static buffer was flushed
+            if (in->buffUsed + run + 1 >= READ_BUFF_SIZE-1)
             {
-                buffer[buffUsed] = '\0';
-                expandString(pbuff,buffer);
-                buffUsed = 0;
+                committed = 1;
             }
-            
+            in->buffUsed = (in->buffUsed + run + 1) % (READ_BUFF_SIZE-1);
         }
         //Set flag to mark that '\r' has occured once
-        else if(charIn == '\r' && endR == 0)
+        else if (charIn == '\r' && in->endR == 0)
         {
-            endR = 1;
+            in->endR = 1;
         }
-        else
+        //Line is over
+        else if (charIn == '\n' && in->endR == 1)
         {
-            //Line is over, copy buffer into pbuff
-            if (charIn == '\n' && endR == 1)
+            lineEnd = 1;
+            committed = 1;
+            in->buffUsed = 0;
+            in->endR = 0;
+            in->lineEnd = in->pos-2;
+
+            //Read in next char to check for folding
+            charIn = nextInputChar(in);
+            if (charIn == EOF)
             {
-                buffer[buffUsed] = '\0';
-                expandString(pbuff,buffer);
-                lineEnd = 1;
-
-                buffUsed = 0;
-                endR = 0;
-
-                //Read in next char to check for folding
-                charIn = fgetc(ics);
-
-                //don't want to store EOF in buffer
-                //EOF
-                if (charIn == EOF)
-                {
-                    stat = EndOfFileHandle(NULL,stat,&buffUsed,buffer);
-                    return(stat);
-                }
-                //Folding required
-                if (charIn == ' ' || charIn == '\t')
-                {
-                    stat.lineto += 1;
-                    lineEnd = 0;
-                    folded = 1;
-                }
-                //Flag the CR if it appears
-                else if (charIn == '\r')
-                {
-                    endR = 1;
-                }
+                *pbuff = in->line;
+                return(in->stat);
+            }
+            //Folding required
+            if (charIn == ' ' || charIn == '\t')
+            {
+                in->stat.lineto += 1;
+                lineEnd = 0;
+                folded = 1;
+                in->folds += 1;
+            }
+            //Flag the CR if it appears
+            else if (charIn == '\r')
+            {
+                in->endR = 1;
+            }
+            //New line would be occuring before a CR, Violates the spec
+            else if (charIn == '\n')
+            {
+                in->stat.linefrom += 1;
+                in->stat.lineto += 1;
+                in->stat.code = NOCRNL;
+                return(in->stat);
+            }
+            else
+            {
+                in->carry = 1;
+                in->carryCh = charIn;
+                in->buffUsed = 1;
+            }
 
-                //New line would be occuring before a CR, Violates the spec
-                else if (charIn == '\n')
+            //Skip blank lines
+            if (isEmpty(in->line))
+            {
+                if(!folded)
                 {
-                    free(*pbuff);
-                    *pbuff = NULL;
-                    stat.linefrom += 1;
-                    stat.lineto  += 1;
-                    stat.code = NOCRNL;
-                    return(stat);
+                    in->stat.linefrom += 1;
+                    in->stat.lineto += 1;
                 }
                 else
                 {
-                    buffer[buffUsed] = charIn;
-                    buffUsed += 1;
+                    in->stat.lineto += 1;
                 }
-                if (isEmpty(*pbuff))
-                {
-                    if(!folded)
-                    {
-                        stat.linefrom += 1;
-                        stat.lineto += 1;
-                    }
-                    else
-                    {
-                        stat.lineto += 1;
+                lineEnd = 0;
+            }
 
-                    }
-                    lineEnd = 0;
-                }
-            } 
-            //Occurs if 2 CR occur in a row or a NL occure before a CR
-            else
+            if (lineEnd == 0 && in->carry)
             {
-                free(*pbuff);
-                *pbuff = NULL;
-                stat.code = NOCRNL;
-                return(stat);
+                appendLine(in,&in->carryCh,1);
+                in->carry = 0;
             }
         }
+        //Occurs if 2 CR occur in a row or a NL occure before a CR
+        else
+        {
+            in->stat.code = NOCRNL;
+            return(in->stat);
+        }
+    }
+    *pbuff = in->line;
+    return(in->stat);
+}
+
+
+/*newArena
+*
+* Purpose: To create an empty CalArena. Its first block is allocated on first use.
+*
+* Returns: A malloced CalArena
+********************************************************************************************/
+static CalArena *newArena(void)
+{
+    CalArena *arena;
+
+    arena = malloc(sizeof(CalArena));
+    assert(arena != NULL);
+
+    arena->block = NULL;
+    arena->root = NULL;
+    arena->used = 0;
+    arena->wasted = 0;
+    arena->map = NULL;
+    arena->mapLen = 0;
+    return(arena);
+}
+
+/*freeArena
+*
+* Purpose: To free every block of a CalArena, and the arena itself.
+*
+* Arguments: A pointer to a CalArena (CalArena*)
+********************************************************************************************/
+static void freeArena(CalArena *arena)
+{
+    CalArenaBlock *block, *next;
+
+    block = arena->block;
+    while (block != NULL)
+    {
+        next = block->next;
+        free(block);
+        block = next;
+    }
+    if (arena->map != NULL)
+    {
+        munmap(arena->map,arena->mapLen);
+    }
+    free(arena);
+}
+
+/*resetArena
+*
+* Purpose: To empty a CalArena for reuse, keeping one of its ordinary blocks.
+*
+* Arguments: A pointer to a CalArena (CalArena*)
+********************************************************************************************/
+static void resetArena(CalArena *arena)
+{
+    CalArenaBlock *block, *next, *kept;
+
+    kept = NULL;
+    block = arena->block;
+    while (block != NULL)
+    {
+        next = block->next;
+        if (kept == NULL && block->size == ARENA_BLOCK_SIZE)
+        {
+            kept = block;
+        }
+        else
+        {
+            free(block);
+        }
+        block = next;
+    }
+    if (kept != NULL)
+    {
+        kept->used = 0;
+        kept->next = NULL;
+    }
+    arena->block = kept;
+    arena->root = NULL;
+    arena->used = 0;
+    arena->wasted = 0;
+}
+
+/*arenaAlloc
+*
+* Purpose: To allocate memory from a CalArena, or with malloc if there is no arena.
+*          Requests that do not fit in the current block start a new block of
+*          ARENA_BLOCK_SIZE bytes; large requests get a block of their own behind
+*          the current one, so the current block keeps filling up.
+*
+* Arguments: A pointer to a CalArena or NULL (CalArena*), the number of bytes wanted (size_t)
+*            and their alignment (size_t, a power of 2)
+*
+* Returns: The address of the memory.
+********************************************************************************************/
+static void *arenaAlloc(CalArena *arena, size_t size, size_t align)
+{
+    CalArenaBlock *block;
+    size_t start, blockSize;
+    void *mem;
+
+    if (arena == NULL)
+    {
+        mem = malloc(size);
+        assert(mem != NULL);
+        return(mem);
+    }
+
+    block = arena->block;
+    if (block != NULL)
+    {
+        start = (block->used + align - 1) & ~(align - 1);
+        if (start + size <= block->size)
+        {
+            arena->wasted += start - block->used;
+            arena->used += size;
+            block->used = start + size;
+            return(block->data + start);
+        }
+    }
+
+    //Large request: give it an exact block, kept behind the current one
+    if (size > ARENA_BLOCK_SIZE/4 && block != NULL)
+    {
+        blockSize = size;
+        block = malloc(sizeof(CalArenaBlock) + blockSize);
+        assert(block != NULL);
+        block->size = blockSize;
+        block->used = size;
+        block->next = arena->block->next;
+        arena->block->next = block;
+        arena->used += size;
+        return(block->data);
+    }
+
+    //The rest of the current block can not be used any more
+    if (arena->block != NULL)
+    {
+        arena->wasted += arena->block->size - arena->block->used;
+        arena->block->used = arena->block->size;
+    }
+
+    blockSize = ARENA_BLOCK_SIZE;
+    if (size > blockSize)
+    {
+        blockSize = size;
+    }
+    block = malloc(sizeof(CalArenaBlock) + blockSize);
+    assert(block != NULL);
+    block->size = blockSize;
+    block->used = size;
+    block->next = arena->block;
+    arena->block = block;
+    arena->used += size;
+    return(block->data);
+}
+
+/*arenaString
+*
+* Purpose: To copy part of a string into a CalArena (or malloc if there is no arena).
+*
+* Arguments: A pointer to a CalArena or NULL (CalArena*), the characters to copy (const char*)
+*            and the number of characters to copy (size_t)
+*
+* Returns: A null terminated copy of the characters
+********************************************************************************************/
+static char *arenaString(CalArena *arena, const char *string, size_t len)
+{
+    char *copy;
+
+    copy = arenaAlloc(arena,len+1,1);
+    memcpy(copy,string,len);
+    copy[len] = '\0';
+    return(copy);
+}
+
+/*arenaRelease
+*
+* Purpose: To give back memory allocated by arenaAlloc. Without an arena the memory is
+*          freed; memory in an arena stays until the arena is freed and is counted as wasted.
+*
+* Arguments: A pointer to a CalArena or NULL (CalArena*), the memory (void*) and its size (size_t)
+********************************************************************************************/
+static void arenaRelease(CalArena *arena, void *mem, size_t size)
+{
+    if (arena == NULL)
+    {
+        free(mem);
+        return;
+    }
+    if (mem != NULL)
+    {
+        arena->used -= size;
+        arena->wasted += size;
+    }
+}
+
+/*slotCapacity
+*
+* Purpose: To find how many slots the flexible array of a CalComp or CalParam has room for.
+*          Arrays grow by doubling (from 4), so the capacity of one that only grew that way follows
+*          from the count; the arena trees growComp and growParam add to are only built that way.
+*
+* Arguments: The number of slots in use (int)
+*
+* Returns: The number of slots allocated
+********************************************************************************************/
+static int slotCapacity(int count)
+{
+    int capacity = 4;
+
+    if (count == 0)
+    {
+        return(0);
+    }
+    while (capacity < count)
+    {
+        capacity *= 2;
+    }
+    return(capacity);
+}
+
+/*newComp, newProp, newParam
+*
+* Purpose: To create an empty CalComp, CalProp or CalParam in a CalArena (or with malloc if there is no arena).
+*
+* Arguments: A pointer to a CalArena or NULL (CalArena*)
+*
+* Returns: The initialized structure
+********************************************************************************************/
+static CalComp *newComp(CalArena *arena)
+{
+    CalComp *comp;
+
+    if (arena == NULL)
+    {
+        return(InitializeCalComp());
+    }
+    comp = arenaAlloc(arena,sizeof(CalComp),_Alignof(CalComp));
+    comp->name = NULL;
+    comp->kind = COMP_OTHER;
+    comp->nprops = 0;
+    comp->prop = NULL;
+    comp->ncomps = 0;
+    comp->arena = arena;
+    comp->text = NULL;
+    comp->textLen = 0;
+    return(comp);
+}
+
+static CalProp *newProp(CalArena *arena)
+{
+    CalProp *prop;
+
+    if (arena == NULL)
+    {
+        return(InitializeCalProp());
+    }
+    prop = arenaAlloc(arena,sizeof(CalProp),_Alignof(CalProp));
+    prop->name = NULL;
+    prop->kind = PROP_OTHER;
+    prop->rawLen = 0;
+    prop->value = NULL;
+    prop->raw = NULL;
+    prop->date = NULL;
+    prop->nparams = 0;
+    prop->param = NULL;
+    prop->next = NULL;
+    return(prop);
+}
+
+static CalParam *newParam(CalArena *arena)
+{
+    CalParam *param;
+
+    if (arena == NULL)
+    {
+        return(InitializeCalParam());
+    }
+    param = arenaAlloc(arena,sizeof(CalParam),_Alignof(CalParam));
+    param->name = NULL;
+    param->next = NULL;
+    param->nvalues = 0;
+    return(param);
+}
+
+/*dropProp
+*
+* Purpose: To throw away a CalProp that will not be part of the tree (BEGIN/END lines and
+*          properties that failed to parse).
+*
+* Arguments: A pointer to a CalArena or NULL (CalArena*), and the CalProp (CalProp*)
+********************************************************************************************/
+static void dropProp(CalArena *arena, CalProp *prop)
+{
+    CalParam *param;
+
+    if (arena == NULL)
+    {
+        freeCalProps(prop);
+        return;
+    }
+
+    for (param = prop->param; param != NULL; param = param->next)
+    {
+        for (int i = 0; i < param->nvalues; i++)
+        {
+            arenaRelease(arena,param->value[i],strlen(param->value[i])+1);
+        }
+        if (param->name != NULL)
+        {
+            arenaRelease(arena,param->name,strlen(param->name)+1);
+        }
+        arenaRelease(arena,param,sizeof(CalParam)+sizeof(char*)*slotCapacity(param->nvalues));
+    }
+    if (prop->name != NULL)
+    {
+        arenaRelease(arena,prop->name,strlen(prop->name)+1);
+    }
+    if (prop->value != NULL)
+    {
+        arenaRelease(arena,prop->value,strlen(prop->value)+1);
+    }
+    if (prop->date != NULL)
+    {
+        arenaRelease(arena,prop->date,sizeof(CalTime));
+    }
+    arenaRelease(arena,prop,sizeof(CalProp));
+}
+
+/*growComp
+*
+* Purpose: To add a subcomponent to a CalComp that may live in a CalArena. Without an arena
+*          this is expandCalComp; in an arena the array of subcomponents doubles when full.
+*
+* Arguments: The address of the CalComp pointer (CalComp **) and the CalComp to add (CalComp*)
+*
+* PostConditions: *toExpand may have moved; the arena's root is kept up to date.
+********************************************************************************************/
+static void growComp(CalComp **const toExpand, CalComp *toAdd)
+{
+    CalArena *arena;
+    CalComp *grown;
+    int count, capacity;
+
+    arena = (*toExpand)->arena;
+    if (arena == NULL)
+    {
+        expandCalComp(toExpand,toAdd);
+        return;
+    }
+
+    count = (*toExpand)->ncomps;
+    capacity = slotCapacity(count);
+    if (count == capacity)
+    {
+        capacity = count == 0 ? 4 : count*2;
+        grown = arenaAlloc(arena,sizeof(CalComp)+sizeof(CalComp*)*capacity,_Alignof(CalComp));
+        memcpy(grown,*toExpand,sizeof(CalComp)+sizeof(CalComp*)*count);
+        arenaRelease(arena,*toExpand,sizeof(CalComp)+sizeof(CalComp*)*count);
+
+        if (arena->root == *toExpand)
+        {
+            arena->root = grown;
+        }
+        *toExpand = grown;
+    }
+    (*toExpand)->comp[count] = toAdd;
+    (*toExpand)->ncomps += 1;
+}
+
+/*growParam
+*
+* Purpose: To add a value to a CalParam that may live in a CalArena (see growComp).
+*
+* Arguments: A pointer to a CalArena or NULL (CalArena*), the address of the CalParam pointer (CalParam **)
+*            and the value to add (char*)
+********************************************************************************************/
+static void growParam(CalArena *arena, CalParam **const toExpand, char *toAdd)
+{
+    CalParam *grown;
+    int count, capacity;
+
+    if (arena == NULL)
+    {
+        expandCalParam(toExpand,toAdd);
+        return;
+    }
+
+    count = (*toExpand)->nvalues;
+    capacity = slotCapacity(count);
+    if (count == capacity)
+    {
+        capacity = count == 0 ? 4 : count*2;
+        grown = arenaAlloc(arena,sizeof(CalParam)+sizeof(char*)*capacity,_Alignof(CalParam));
+        memcpy(grown,*toExpand,sizeof(CalParam)+sizeof(char*)*count);
+        arenaRelease(arena,*toExpand,sizeof(CalParam)+sizeof(char*)*count);
+        *toExpand = grown;
+    }
+    (*toExpand)->value[count] = toAdd;
+    (*toExpand)->nvalues += 1;
+}
+
+/*appendProp, appendParam
+*
+* Purpose: To add a property to the end of a CalComp's list, or a parameter to the end of a
+*          CalProp's, in constant time: the builder keeps the last one (insertProperty and
+*          insertParam walk the list to find it).
+*
+* Arguments: The CalComp or CalProp (CalComp*, CalProp*), the address of its last property or
+*            parameter (NULL if it has none; set to the one added), and the one to add
+********************************************************************************************/
+static void appendProp(CalComp *comp, CalProp **const last, CalProp *toAdd)
+{
+    if (*last == NULL)
+    {
+        comp->prop = toAdd;
+    }
+    else
+    {
+        (*last)->next = toAdd;
+    }
+    *last = toAdd;
+    comp->nprops += 1;
+}
+
+static void appendParam(CalProp *prop, CalParam **const last, CalParam *toAdd)
+{
+    if (*last == NULL)
+    {
+        prop->param = toAdd;
+    }
+    else
+    {
+        (*last)->next = toAdd;
+    }
+    *last = toAdd;
+    prop->nparams += 1;
+}
+
+/*upperCase
+*
+* Purpose: To capitalize the letters of a string in place (see toUpper for an allocated copy).
+*
+* Arguments: A string (char *)
+********************************************************************************************/
+static void upperCase(char *string)
+{
+    for (; *string != '\0'; string++)
+    {
+        if (*string >= 'a' && *string <= 'z')
+        {
+            *string -= 32;
+        }
+    }
+}
+
+/*isCanonical
+*
+* Purpose: To find whether lines read from a file are already as writeCalComp would write
+*          them: each ends with CRLF and none is blank, a long line is folded after exactly
+*          FOLD_LEN characters and goes on after one space, and the names of properties and
+*          parameters, and the names on BEGIN and END lines, are uppercase.
+*
+* Arguments: The lines and their length (const char*, size_t), from the start of a contentline
+*            to the CRLF that ends one
+*
+* Returns: 1 if they are, 0 otherwise
+********************************************************************************************/
+static int isCanonical(const char *text, size_t n)
+{
+    const char *end, *cr, *c;
+    size_t len, lastLen;
+    char name[6];       // the start of the property's name, to know BEGIN and END
+    size_t nameLen;
+    int part;           // 0 the name, 1 a parameter's name, 2 a parameter's value, 3 the value,
+                        // 4 the name on a BEGIN or END line
+    int quoted;
+
+    end = text + n;
+    lastLen = 0;
+    part = 3;
+    quoted = 0;
+    nameLen = 0;
+    while (text < end)
+    {
+        cr = memchr(text,'\r',end - text);
+        if (cr == NULL || end - cr < 2 || cr[1] != '\n' || cr - text > FOLD_LEN)
+        {
+            return(0);
+        }
+        len = cr - text;
+
+        //A folded line goes on after the one space writeFolded puts there
+        if (len > 0 && (text[0] == ' ' || text[0] == '\t'))
+        {
+            if (text[0] != ' ' || len == 1 || lastLen != FOLD_LEN)
+            {
+                return(0);
+            }
+            c = text + 1;
+        }
+        //A new contentline, which blank lines are not
+        else if (len > 0 && (part == 3 || part == 4))
+        {
+            part = 0;
+            quoted = 0;
+            nameLen = 0;
+            c = text;
+        }
+        else
+        {
+            return(0);
+        }
+
+        for (; c < cr; c++)
+        {
+            if (part == 0 && (*c == ';' || *c == ':'))
+            {
+                if ((nameLen == 5 && strncmp(name,"BEGIN",5) == 0) || (nameLen == 3 && strncmp(name,"END",3) == 0))
+                {
+                    //writeNameLine writes them with no parameters
+                    if (*c == ';')
+                    {
+                        return(0);
+                    }
+                    part = 4;
+                }
+                else
+                {
+                    part = (*c == ';') ? 1 : 3;
+                }
+            }
+            else if (part == 1 && *c == '=')
+            {
+                part = 2;
+            }
+            else if (part == 2 && *c == '"')
+            {
+                quoted = !quoted;
+            }
+            else if (part == 2 && !quoted && (*c == ';' || *c == ':'))
+            {
+                part = (*c == ';') ? 1 : 3;
+            }
+            else if ((part == 0 || part == 1 || part == 4) && *c >= 'a' && *c <= 'z')
+            {
+                return(0);
+            }
+            else if (part == 0 && nameLen < sizeof(name))
+            {
+                name[nameLen] = *c;
+                nameLen += 1;
+            }
+        }
+        lastLen = len;
+        text = cr + 2;
+    }
+    return(part == 3 || part == 4);
+}
+
+/*findCompText
+*
+* Purpose: To find where a component just read is in the mapped file (CAL_SOURCE): from its
+*          BEGIN line, past any blank lines read with it, to the CRLF of the END line just
+*          read. A component whose lines do not begin and end that way, or are not as
+*          writeCalComp would write them (see isCanonical), is given no text; it is then
+*          written out the same as if it had been read from a stream that is not mapped.
+*          Its subcomponents, found first, are not checked again.
+*
+* Arguments: The input (const CalInput*), the offset of the line that began the component
+*            (size_t) and the component (CalComp*)
+********************************************************************************************/
+static void findCompText(const CalInput *in, size_t from, CalComp *comp)
+{
+    const char *data;
+    const CalComp *sub;
+    size_t to, at;
+
+    data = in->data;
+    while (from < in->len && (data[from] == ' ' || data[from] == '\t' || data[from] == '\r' || data[from] == '\n'))
+    {
+        from += 1;
+    }
+    to = in->lineEnd + 2;
+    if (in->lineEnd == 0 || to > in->len || data[to-2] != '\r' || data[to-1] != '\n')
+    {
+        return;
+    }
+    if (from + 5 > to || (from > 0 && data[from-1] != '\n') || strncasecmp(data+from,"BEGIN",5) != 0)
+    {
+        return;
+    }
+
+    //The component's own lines, between those of its subcomponents, which must have text
+    at = from;
+    for (int i = 0; i < comp->ncomps; i++)
+    {
+        sub = comp->comp[i];
+        if (sub->text == NULL || sub->text < data + at || sub->text + sub->textLen > data + to ||
+            !isCanonical(data + at,sub->text - (data + at)))
+        {
+            return;
+        }
+        at = sub->text + sub->textLen - data;
+    }
+    if (!isCanonical(data + at,to - at))
+    {
+        return;
+    }
+    comp->text = data + from;
+    comp->textLen = to - from;
+}
+
+/*dropTextVisit
+*
+* Purpose: To forget where a component is in the mapped file, once the component is kept
+*          past the mapping (the pre callback of streamComp's walk).
+********************************************************************************************/
+static CalVisit dropTextVisit(const CalComp *visited, int depth, void *data)
+{
+    CalComp *comp = (CalComp *)visited;
+
+    comp->text = NULL;
+    comp->textLen = 0;
+    return(CAL_VISIT);
+}
+
+/*adoptArenaVisit
+*
+* Purpose: To point a component at the arena it now belongs to, once its run's arena has been
+*          joined to the calendar's (the pre callback of joinChunk's walk).
+********************************************************************************************/
+static CalVisit adoptArenaVisit(const CalComp *visited, int depth, void *data)
+{
+    CalComp *comp = (CalComp *)visited;
+
+    comp->arena = data;
+    return(CAL_VISIT);
+}
+
+/*streamComp
+*
+* Purpose: To hand a top level component that readCalStream has read to its comp callback
+*          (calling the header callback first, for the first component), then free it.
+*          VTIMEZONEs are kept in the calendar instead, for the components after them.
+*
+* Arguments: The parser (CalParser*), the address of the calendar (CalComp **), the component
+*            (CalComp*) and the status of its read (CalStatus)
+*
+* Returns: The status of the read, or the first error of a callback
+********************************************************************************************/
+static CalStatus streamComp(CalParser *parser, CalComp **const pcal, CalComp *comp, CalStatus stat)
+{
+    const CalStreamCallbacks *stream;
+    CalVisitor dropText = { NULL, dropTextVisit, NULL };
+    CalComp *given;
+    CalError code;
+
+    stream = parser->stream;
+    if (stat.code != OK)
+    {
+        freeCalComp(comp);
+        return(stat);
+    }
+    if (comp->name[0] == 'V')
+    {
+        parser->vComponent = 1;
+    }
+    if (comp->kind == COMP_VTIMEZONE)
+    {
+        growComp(pcal,comp);
+        updateCalTzCache(parser->zones,*pcal);
+    }
+    resolveCalCompTimes(comp,parser->zones);
+
+    code = OK;
+    if (parser->streamed == 0 && stream->header != NULL)
+    {
+        resolveCalCompTimes(*pcal,parser->zones);
+        code = stream->header(*pcal,stream->data);
+    }
+    parser->streamed += 1;
+
+    given = comp;
+    if (code == OK && stream->comp != NULL)
+    {
+        code = stream->comp(&given,*pcal,stream->data);
+    }
+    //A component the callback keeps outlives the mapping its text is in
+    if (given == NULL && comp->text != NULL)
+    {
+        walkCalComp(comp,&dropText);
+    }
+    //The arena of a component not kept is emptied for the next one
+    if (given != NULL && comp->kind != COMP_VTIMEZONE)
+    {
+        if (comp->arena != NULL && parser->spare == NULL)
+        {
+            resetArena(comp->arena);
+            parser->spare = comp->arena;
+        }
+        else
+        {
+            freeCalComp(comp);
+        }
+    }
+
+    if (code != OK)
+    {
+        stat = parser->in.stat;
+        stat.code = code;
+    }
+    return(stat);
+}
+
+CalStatus readCalCompEx( CalParser *const parser, CalComp **const pcomp )
+{
+    CalStatus stat;
+    char *propLine, *upperValue;
+    CalArena *arena, *compArena;
+    CalProp *property;
+    CalComp *newCalComp;
+    CalProp *lastProp;
+    const CalInput *slices, *source;
+    size_t textFrom;
+    int streamed;
+
+    propLine = NULL;
+    property = NULL;
+
+    //Subcomponents come from the same arena as the component (if any)
+    arena = (*pcomp)->arena;
+
+    //Properties are added after the last one the component already has (if any)
+    lastProp = (*pcomp)->prop;
+    while (lastProp != NULL && lastProp->next != NULL)
+    {
+        lastProp = lastProp->next;
+    }
+
+    //Values may stay in a mapped file that the tree will own (see readCalFileEx)
+    slices = NULL;
+    if ((parser->options & CAL_SLICES) && arena != NULL && parser->stream == NULL && parser->in.mapped)
+    {
+        slices = &parser->in;
+    }
+
+    //Components may keep where they are in it, as long as it is there to copy from
+    source = NULL;
+    if ((parser->options & CAL_SOURCE) && parser->in.mapped && (slices != NULL || parser->stream != NULL))
+    {
+        source = &parser->in;
+    }
+    
+    //Read Line
+    stat = readInputLine(&parser->in,&propLine);
+
+    if (stat.code != OK)
+    {
+        return(stat);
+    }
+    while(propLine != NULL)
+    {
+        
+        property = newProp(arena);
+
+        //Parse Line
+
+        stat.code = parseProp(arena,propLine,property,slices);
+        propLine = NULL;
+        if (stat.code != OK)
+        {
+            dropProp(arena,property);
+            parser->depth = 0;
+            return(stat);
+        }
+
+        //The name is already uppercase; BEGIN/END values are capitalized in place
+        if (property->kind == PROP_BEGIN)
+        {
+            upperValue = property->value;
+            upperCase(upperValue);
+
+            if(parser->depth != 0)
+            {
+                //Exceeds Nesting
+                if (parser->depth == 3)
+                {
+                    stat.code = SUBCOM;
+                    dropProp(arena,property);
+                    parser->depth = 0;
+                    return(stat);
+                }
+                parser->depth += 1;
+                textFrom = parser->in.lineStart;
+
+                //Create a new comp and give it the UPPERCASE value. A streamed top level
+                //component is not part of the tree, so it may have an arena of its own
+                streamed = parser->stream != NULL && parser->depth == 2;
+                if (streamed && (parser->options & CAL_ARENA))
+                {
+                    compArena = parser->spare;
+                    parser->spare = NULL;
+                    if (compArena == NULL)
+                    {
+                        compArena = newArena();
+                    }
+                    newCalComp = newComp(compArena);
+                    compArena->root = newCalComp;
+
+                    //The name goes with the component's arena; the line's copy is dropped
+                    newCalComp->name = arenaString(compArena,upperValue,strlen(upperValue));
+                }
+                else
+                {
+                    newCalComp = newComp(arena);
+                    newCalComp->name = upperValue;
+                    property->value = NULL;
+                }
+                newCalComp->kind = calCompKind(newCalComp->name);
+                dropProp(arena,property);
+             
+                stat = readCalCompEx(parser,&newCalComp);
+                if (stat.code == OK && source != NULL)
+                {
+                    findCompText(source,textFrom,newCalComp);
+                }
+
+                if (streamed)
+                {
+                    stat = streamComp(parser,pcomp,newCalComp,stat);
+                }
+                else
+                {
+                    growComp(pcomp,newCalComp);
+                }
+                if (stat.code != OK)
+                {
+                    parser->depth = 0;
+                    return(stat);
+                }
+
+            }
+            //If the first card is being parsed
+            else if ((*pcomp)->name == NULL && strcmp(upperValue,"VCALENDAR") == 0)
+            {
+                (*pcomp)->name = upperValue;
+                (*pcomp)->kind = COMP_VCALENDAR;
+                property->value = NULL;
+                parser->depth = 1;
+                dropProp(arena,property);
+            }
+            else
+            {
+                stat.code = NOCAL;
+                dropProp(arena,property);
+                parser->depth = 0;
+                return(stat);
+            }
+        }
+        else if(property->kind == PROP_END)
+        {
+            upperValue = property->value;
+            upperCase(upperValue);
+
+            //Error if NoData
+            if ((*pcomp)->nprops == 0 && (*pcomp)->ncomps == 0)
+            {
+                stat.code = NODATA;
+            }
+            //Error if BEGIN:x Does not match with END:x
+            else if (strcmp(upperValue,(*pcomp)->name) != 0)
+            {
+                stat.code = BEGEND;
+            }
+
+            dropProp(arena,property);
+            
+            if (stat.code == OK)
+            {
+                parser->depth -= 1;             
+            }
+
+            return(stat);
+        }
+        //Regular property
+        else
+        {
+            //Name should only be NULL if BEGIN:VACALENDAR is expected
+            if ((*pcomp)->name == NULL)
+            {
+                stat.code = NOCAL;
+                dropProp(arena,property);
+                parser->depth = 0;
+                return(stat);
+            }
+            appendProp(*pcomp,&lastProp,property);
+        }
+        
+        //Read Line
+        stat = readInputLine(&parser->in,&propLine);
+        if (stat.code != OK)
+        {
+            parser->depth = 0;
+            return(stat);
+        }
+    }
+    if (parser->depth != 0)
+    {
+        stat.code = BEGEND;
+    }
+    parser->ranOut = 1;
+    return(stat);
+}
+
+/*newRoot
+*
+* Purpose: To create the empty root of a calendar read by readCalFileEx, with an arena of its
+*          own if the parser has CAL_ARENA.
+*
+* Arguments: The parser (CalParser*)
+*
+* Returns: The root (CalComp*)
+********************************************************************************************/
+static CalComp *newRoot(CalParser *parser)
+{
+    CalArena *arena;
+    CalComp *root;
+
+    //The whole tree comes from one arena if asked for; freeCalComp releases it
+    arena = NULL;
+    if (parser->options & CAL_ARENA)
+    {
+        arena = newArena();
+    }
+    root = newComp(arena);
+    if (arena != NULL)
+    {
+        arena->root = root;
+    }
+    return(root);
+}
+
+/*joinArena
+*
+* Purpose: To give the blocks of one CalArena to another, which frees them with its own,
+*          and free the first. The block being filled stays the same.
+*
+* Arguments: The CalArena to keep (CalArena*) and the CalArena to join to it (CalArena*)
+********************************************************************************************/
+static void joinArena(CalArena *into, CalArena *from)
+{
+    CalArenaBlock *last;
+
+    if (from->block != NULL)
+    {
+        //The rest of the joined arena's current block can not be used any more
+        from->wasted += from->block->size - from->block->used;
+        from->block->used = from->block->size;
+
+        last = from->block;
+        while (last->next != NULL)
+        {
+            last = last->next;
+        }
+        if (into->block != NULL)
+        {
+            last->next = into->block->next;
+            into->block->next = from->block;
+        }
+        else
+        {
+            into->block = from->block;
+        }
+    }
+    into->used += from->used;
+    into->wasted += from->wasted;
+    free(from);
+}
+
+/*startsProp
+*
+* Purpose: To find whether a contentline starts with a property name (in any case), followed
+*          by its value or parameters.
+*
+* Arguments: The line (const char*), the no. of characters available (size_t) and the uppercase name (const char*)
+*
+* Returns: 1 if it does, 0 otherwise
+********************************************************************************************/
+static int startsProp(const char *line, size_t avail, const char *name)
+{
+    size_t len;
+
+    len = strlen(name);
+    if (avail <= len || strncasecmp(line,name,len) != 0)
+    {
+        return(0);
+    }
+    return(line[len] == ':' || line[len] == ';');
+}
+
+/*splitChunks
+*
+* Purpose: To cut a mapped calendar into runs of top level components of about equal size.
+*          BEGIN and END lines are counted to find the components at the calendar's level, and
+*          each run starts at the BEGIN line of one of them. The lines before the first run
+*          (BEGIN:VCALENDAR and the first properties) and from the calendar's END line on
+*          are not part of any run. Nothing is checked here; a cut in the wrong place makes
+*          the runs fail to parse (see parseChunk).
+*
+* Arguments: The input (const CalInput*), the most runs wanted (int) and the array of that
+*            many runs to fill (CalChunk*), and the address of the offset of the calendar's
+*            END line to set (size_t*)
+*
+* Returns: The no. of runs found, or 0 if the calendar's END line was not found
+********************************************************************************************/
+static int splitChunks(const CalInput *in, int wanted, CalChunk *chunks, size_t *tail)
+{
+    const char *line, *end, *next;
+    size_t target, at;
+    int depth, nchunks;
+
+    line = in->data + in->pos;
+    end = in->data + in->len;
+    target = (in->len - in->pos) / wanted;
+    depth = 0;
+    nchunks = 0;
+
+    while (line < end)
+    {
+        at = line - in->data;
+        if (startsProp(line,end-line,"BEGIN"))
+        {
+            //A run starts at the first component, then at the first one past each target size
+            if (depth == 1 && (nchunks == 0 || (nchunks < wanted && at >= chunks[nchunks-1].from + target)))
+            {
+                if (nchunks > 0)
+                {
+                    chunks[nchunks-1].to = at;
+                }
+                chunks[nchunks].from = at;
+                chunks[nchunks].cal = NULL;
+                chunks[nchunks].lines = 0;
+                nchunks += 1;
+            }
+            depth += 1;
+        }
+        else if (startsProp(line,end-line,"END"))
+        {
+            depth -= 1;
+            if (depth < 0)
+            {
+                return(0);
+            }
+            if (depth == 0)
+            {
+                if (nchunks > 0)
+                {
+                    chunks[nchunks-1].to = at;
+                }
+                *tail = at;
+                return(nchunks);
+            }
+        }
+
+        next = memchr(line,'\n',end-line);
+        if (next == NULL)
+        {
+            break;
+        }
+        line = next + 1;
+    }
+    return(0);
+}
+
+/*parseChunk
+*
+* Purpose: To parse a run of top level components into a VCALENDAR of its own, reading only
+*          the run's bytes. The run is good if it ends at the calendar's level with no error.
+*
+* Arguments: The parser of the thread (CalParser*) and the run (CalChunk*)
+*
+* PostConditions: The run's cal is its VCALENDAR (in an arena of its own if the parser has
+*                 CAL_ARENA), or NULL if the run is not good; its lines are counted.
+********************************************************************************************/
+static void parseChunk(CalParser *parser, CalChunk *chunk)
+{
+    CalStatus stat;
+    CalComp *cal;
+
+    seekInput(&parser->in,chunk->from,chunk->to,0);
+    cal = newRoot(parser);
+    cal->name = arenaString(cal->arena,"VCALENDAR",strlen("VCALENDAR"));
+    cal->kind = COMP_VCALENDAR;
+    parser->depth = 1;
+    parser->ranOut = 0;
+
+    stat = readCalCompEx(parser,&cal);
+
+    //Only the end of the run may stop the read, with the calendar still open
+    if (stat.code != BEGEND || !parser->ranOut || parser->depth != 1 || parser->in.pos != parser->in.len)
+    {
+        freeCalComp(cal);
+        cal = NULL;
+    }
+    chunk->cal = cal;
+    chunk->lines = parser->in.stat.lineto;
+}
+
+/*threadCount
+*
+* Purpose: To work out how many threads to use when asked for some (setCalParserThreads,
+*          writeCalCompThreads).
+*
+* Arguments: The threads asked for (int): 0 or less for one per online processor
+*
+* Returns: The threads to use, from 1 to CAL_THREADS_MAX
+********************************************************************************************/
+static int threadCount(int threads)
+{
+    if (threads <= 0)
+    {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    if (threads > CAL_THREADS_MAX)
+    {
+        threads = CAL_THREADS_MAX;
+    }
+    return(threads);
+}
+
+/*parseChunks
+*
+* Purpose: To parse the runs of a CalChunkWork not yet taken by another thread, one at a time.
+*
+* Arguments: The parser of the thread (CalParser*) and the work (CalChunkWork*)
+********************************************************************************************/
+static void parseChunks(CalParser *parser, CalChunkWork *work)
+{
+    int next;
+
+    next = atomic_fetch_add(&work->next,1);
+    while (next < work->nchunks)
+    {
+        parseChunk(parser,&work->chunks[next]);
+        next = atomic_fetch_add(&work->next,1);
+    }
+}
+
+/*chunkThread
+*
+* Purpose: To parse runs of a mapped calendar on a thread started by readChunks, with a parser
+*          of its own that reads the same mapping.
+*
+* Arguments: The work (CalChunkWork*, as void*)
+*
+* Returns: NULL
+********************************************************************************************/
+static void *chunkThread(void *arg)
+{
+    CalChunkWork *work;
+    CalParser parser;
+
+    work = arg;
+    initParser(&parser);
+    parser.in.data = (char *)work->data;
+    parser.in.mapped = 1;
+    parser.in.eof = 1;
+    parser.options = work->options;
+
+    parseChunks(&parser,work);
+
+    //The mapping belongs to the calendar's parser
+    free(parser.in.line);
+    return(NULL);
+}
+
+/*joinChunk
+*
+* Purpose: To move the properties and components of a run's VCALENDAR to the end of the
+*          calendar's, and free the run's VCALENDAR (its arena becomes part of the calendar's).
+*
+* Arguments: The address of the calendar (CalComp **) and the run's VCALENDAR (CalComp*)
+********************************************************************************************/
+static void joinChunk(CalComp **const pcal, CalComp *cal)
+{
+    CalProp *last;
+    CalArena *arena;
+    CalVisitor visitor = { NULL, adoptArenaVisit, NULL };
+
+    if (cal->nprops > 0)
+    {
+        if ((*pcal)->nprops == 0)
+        {
+            (*pcal)->prop = cal->prop;
+        }
+        else
+        {
+            last = (*pcal)->prop;
+            while (last->next != NULL)
+            {
+                last = last->next;
+            }
+            last->next = cal->prop;
+        }
+        (*pcal)->nprops += cal->nprops;
+    }
+    for (int i = 0; i < cal->ncomps; i++)
+    {
+        growComp(pcal,cal->comp[i]);
+    }
+
+    arena = cal->arena;
+    if (arena == NULL)
+    {
+        cal->nprops = 0;
+        cal->prop = NULL;
+        cal->ncomps = 0;
+        freeCalComp(cal);
+        return;
+    }
+    //The run's arena is freed once joined, so its components allocate from the calendar's
+    //from now on (e.g. the values calPropValue unfolds)
+    visitor.data = (*pcal)->arena;
+    for (int i = 0; i < cal->ncomps; i++)
+    {
+        walkCalComp(cal->comp[i],&visitor);
+    }
+    arenaRelease(arena,cal->name,strlen(cal->name)+1);
+    arenaRelease(arena,cal,sizeof(CalComp)+sizeof(CalComp*)*slotCapacity(cal->ncomps));
+    joinArena((*pcal)->arena,arena);
+}
+
+/*readChunks
+*
+* Purpose: To read a mapped calendar on several threads (see setCalParserThreads). This thread
+*          reads the lines before the first run of components while the other threads start,
+*          then helps parse the runs; the runs are joined in order and the calendar's END line
+*          is read as usual.
+*
+* Arguments: The parser (CalParser*), its input at the start of the calendar, and the address
+*            of the calendar's empty root (CalComp **)
+*
+* Returns: The CalStatus of the read, as readCalCompEx returns it. If part of the calendar
+*          does not parse cleanly, the root is made again and the whole calendar read by
+*          readCalCompEx on this thread.
+********************************************************************************************/
+static CalStatus readChunks(CalParser *parser, CalComp **const pcomp)
+{
+    pthread_t threads[CAL_THREADS_MAX];
+    CalChunkWork work;
+    CalInput *in;
+    CalStatus stat;
+    size_t start, size, tail;
+    int wanted, nthreads, good, lines;
+
+    in = &parser->in;
+    start = in->pos;
+    size = in->len;
+    lines = in->stat.lineto;
+
+    wanted = parser->threads * CAL_CHUNKS_PER_THREAD;
+    if ((size - start) / CAL_CHUNK_MIN < (size_t)wanted)
+    {
+        wanted = (size - start) / CAL_CHUNK_MIN;
+    }
+    if (wanted < 2)
+    {
+        return(readCalCompEx(parser,pcomp));
+    }
+
+    work.chunks = malloc(sizeof(CalChunk)*wanted);
+    assert(work.chunks != NULL);
+    work.nchunks = splitChunks(in,wanted,work.chunks,&tail);
+    if (work.nchunks < 2)
+    {
+        free(work.chunks);
+        return(readCalCompEx(parser,pcomp));
+    }
+    work.data = in->data;
+    work.options = parser->options;
+    atomic_init(&work.next,0);
+
+    //If a thread can not be started, the ones that did (and this one) parse its runs
+    nthreads = 0;
+    while (nthreads < parser->threads-1 && nthreads < work.nchunks-1)
+    {
+        if (pthread_create(&threads[nthreads],NULL,chunkThread,&work) != 0)
+        {
+            break;
+        }
+        nthreads += 1;
+    }
+
+    //BEGIN:VCALENDAR and the properties before the first run
+    in->len = work.chunks[0].from;
+    parser->ranOut = 0;
+    stat = readCalCompEx(parser,pcomp);
+    good = stat.code == BEGEND && parser->ranOut && parser->depth == 1 && in->pos == in->len;
+    lines = in->stat.lineto;
+    in->len = size;
+
+    if (!good)
+    {
+        atomic_store(&work.next,work.nchunks);
+    }
+    parseChunks(parser,&work);
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_join(threads[i],NULL);
+    }
+
+    for (int i = 0; i < work.nchunks; i++)
+    {
+        good = good && work.chunks[i].cal != NULL;
+    }
+    for (int i = 0; i < work.nchunks; i++)
+    {
+        if (good)
+        {
+            joinChunk(pcomp,work.chunks[i].cal);
+            lines += work.chunks[i].lines;
+        }
+        else if (work.chunks[i].cal != NULL)
+        {
+            freeCalComp(work.chunks[i].cal);
+        }
+    }
+    free(work.chunks);
+
+    //Read again on one thread, for the status a single read gives
+    if (!good)
+    {
+        freeCalComp(*pcomp);
+        *pcomp = newRoot(parser);
+        seekInput(in,start,size,0);
+        parser->depth = 0;
+        return(readCalCompEx(parser,pcomp));
+    }
+
+    //END:VCALENDAR and anything after it, counting lines on from the runs
+    seekInput(in,tail,size,lines);
+    return(readCalCompEx(parser,pcomp));
+}
+
+CalStatus readCalFileEx( CalParser *const parser, CalComp **const pcomp )
+{
+    CalStatus stat;
+    int vComponent = 0;
+    char *string;
+    size_t textFrom;
+    string = NULL;
+
+    *pcomp = newRoot(parser);
+    textFrom = parser->in.pos;
+
+    //Read in the CalFile, on several threads if it is mapped and that is asked for
+    if (parser->threads > 1 && parser->in.mapped)
+    {
+        stat = readChunks(parser,pcomp);
+    }
+    else
+    {
+        stat = readCalCompEx(parser,pcomp);
+    }
+
+    if (stat.code != OK)
+    {
+        freeCalComp(*pcomp);
+        return(stat);
+    }
+
+    // Check for the letter V in component's name
+    for (int i = 0; i < (*pcomp)->ncomps; i++)
+    {
+
+        if((*pcomp)->comp[i]->name[0] == 'V')
+        {
+            vComponent = 1;
+            break;
+        }
+
+    }
+    //No components with the letter V and/or no components exist
+    if (vComponent != 1)
+    {
+        stat.code = NOCAL;
+        freeCalComp(*pcomp);
+        return (stat);
+    }
+
+    stat = VersionIDCheck(pcomp,stat);
+    if (stat.code != OK)
+    {
+        freeCalComp(*pcomp);
+        return(stat);
+    }
+
+    //The whole calendar is in the mapping the tree is to keep (see below), up to its END just read
+    if ((parser->options & (CAL_SLICES | CAL_SOURCE)) == (CAL_SLICES | CAL_SOURCE) && (*pcomp)->arena != NULL && parser->in.mapped)
+    {
+        findCompText(&parser->in,textFrom,*pcomp);
+    }
+
+    //Check if there is something past 'END: VCALENDAR'
+    stat = readInputLine(&parser->in,&string);
+    if (string != NULL)
+    {
+        stat.code = AFTEND;
+        freeCalComp(*pcomp);
+        return(stat);
+    }
+
+    //Place UTC and TZID-qualified dates in time, now that every VTIMEZONE is known
+    if (stat.code == OK)
+    {
+        resolveCalTimes(*pcomp);
+    }
+
+    //Raw values point into the mapped file, so the tree keeps it (freeCalComp unmaps it)
+    if (stat.code == OK && (parser->options & CAL_SLICES) && (*pcomp)->arena != NULL && parser->in.mapped)
+    {
+        (*pcomp)->arena->map = parser->in.data;
+        (*pcomp)->arena->mapLen = parser->in.len;
+        parser->in.data = NULL;
+        parser->in.len = 0;
+        parser->in.pos = 0;
+        parser->in.mapped = 0;
+    }
+    return(stat);
+}
+
+CalStatus readCalStream( CalParser *const parser, const CalStreamCallbacks *callbacks )
+{
+    CalStatus stat;
+    CalComp *cal;
+    CalError code;
+    char *string;
+
+    string = NULL;
+
+    //The calendar keeps only its properties and VTIMEZONEs, so it never has an arena
+    cal = newComp(NULL);
+    parser->stream = callbacks;
+    parser->zones = InitializeCalTzCache(cal);
+    parser->vComponent = 0;
+    parser->streamed = 0;
+
+    stat = readCalCompEx(parser,&cal);
+
+    //The checks of readCalFileEx, in the same order
+    if (stat.code == OK && !parser->vComponent)
+    {
+        stat.code = NOCAL;
+    }
+    if (stat.code == OK)
+    {
+        stat = VersionIDCheck(&cal,stat);
+    }
+    if (stat.code == OK)
+    {
+        stat = readInputLine(&parser->in,&string);
+        if (string != NULL)
+        {
+            stat.code = AFTEND;
+        }
+    }
+    if (stat.code == OK && callbacks->end != NULL)
+    {
+        updateCalTzCache(parser->zones,cal);
+        resolveCalCompTimes(cal,parser->zones);
+        code = callbacks->end(cal,callbacks->data);
+        if (code != OK)
+        {
+            stat.code = code;
+        }
+    }
+
+    //VTIMEZONEs may each have an arena of their own
+    for (int i = 0; i < cal->ncomps; i++)
+    {
+        freeCalComp(cal->comp[i]);
+    }
+    cal->ncomps = 0;
+    freeCalComp(cal);
+    freeCalTzCache(parser->zones);
+    if (parser->spare != NULL)
+    {
+        freeArena(parser->spare);
+    }
+    parser->zones = NULL;
+    parser->spare = NULL;
+    parser->stream = NULL;
+    return(stat);
+}
+
+CalStatus readCalFile( FILE *const ics, CalComp **const pcomp )
+{
+    CalParser parser;
+    CalStatus stat;
+
+    initParser(&parser);
+    parser.in.file = ics;
+
+    stat = readCalFileEx(&parser,pcomp);
+    closeInput(&parser.in);
+    return(stat);
+}
+
+CalStatus readCalFilePath( const char *const path, CalComp **const pcomp )
+{
+    CalStatus stat;
+    int fd;
+
+    *pcomp = NULL;
+    stat = InitializeCalStatus();
+
+    fd = open(path,O_RDONLY);
+    if (fd < 0)
+    {
+        stat.code = IOERR;
+        return(stat);
+    }
+
+    stat = readCalFileFd(fd,pcomp);
+    close(fd);
+    return(stat);
+}
+
+CalStatus readCalFileFd( int fd, CalComp **const pcomp )
+{
+    CalParser parser;
+    CalStatus stat;
+
+    *pcomp = NULL;
+    initParser(&parser);
+
+    stat = InitializeCalStatus();
+    stat.code = openInputFd(&parser.in,fd);
+    if (stat.code == OK)
+    {
+        stat = readCalFileEx(&parser,pcomp);
+    }
+    closeInput(&parser.in);
+    return(stat);
+}
+
+CalStatus readCalComp( FILE *const ics, CalComp **const pcomp )
+{
+    if (fileShim.in.file != ics)
+    {
+        closeInput(&fileShim.in);
+        initParser(&fileShim);
+        fileShim.in.file = ics;
+    }
+    return(readCalCompEx(&fileShim,pcomp));
+}
+
+CalStatus readCalLine( FILE *const ics, char **const pbuff )
+{
+    if (ics == NULL)
+    {
+        closeInput(&fileShim.in);
+        initParser(&fileShim);
+        return(fileShim.in.stat);
+    }
+
+    if (fileShim.in.file != ics)
+    {
+        closeInput(&fileShim.in);
+        initParser(&fileShim);
+        fileShim.in.file = ics;
+    }
+    return(readCalLineEx(&fileShim,pbuff));
+}
+
+CalStatus readCalLineEx( CalParser *const parser, char **const pbuff )
+{
+    CalStatus stat;
+    char *line;
+
+    stat = readInputLine(&parser->in,&line);
+
+    //Caller owns the returned line
+    *pbuff = NULL;
+    if (line != NULL)
+    {
+        *pbuff = malloc(sizeof(char)*(parser->in.lineLen+1));
+        assert(*pbuff != NULL);
+        memcpy(*pbuff,line,parser->in.lineLen+1);
+    }
+    return(stat);
+}
+
+/*readDigits
+*
+* Purpose: To read a fixed number of decimal digits.
+*
+* Arguments: The text (const char*), the number of digits (int) and the address of the result (int*)
+*
+* Returns: 1 if all n chars are digits, 0 otherwise
+********************************************************************************************/
+static int readDigits(const char *text, int n, int *result)
+{
+    *result = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (text[i] < '0' || text[i] > '9')
+        {
+            return(0);
+        }
+        *result = *result*10 + (text[i] - '0');
+    }
+    return(1);
+}
+
+/* Local time offsets of recently seen days, per thread (see localDayOffset) */
+typedef struct LocalDay {
+    int day;            // days from 1970-01-01
+    int offset;         // epoch - wall seconds, for the whole day
+    int valid;          // 1 once set
+} LocalDay;
+
+static _Thread_local LocalDay localDays[LOCAL_DAY_CACHE];
+
+/*wallSeconds
+*
+* Purpose: To count the seconds from 1970-01-01 00:00 to the wall time in a struct tm, as if it were UTC.
+*
+* Arguments: A normalized struct tm (const struct tm*)
+*
+* Returns: The number of seconds
+********************************************************************************************/
+static long wallSeconds(const struct tm *tm)
+{
+    return(calDaysFromCivil(tm->tm_year+1900,tm->tm_mon+1,tm->tm_mday)*86400 +
+           tm->tm_hour*3600 + tm->tm_min*60 + tm->tm_sec);
+}
+
+/*localDayOffset
+*
+* Purpose: To find how far local time is from UTC on a day, so that floating times need the
+*          timezone database (mktime, which takes glibc's tz lock) once a day rather than
+*          once a value.
+*
+* Arguments: The day, counted from 1970-01-01 (long), and the addresses of the offsets
+*            (seconds to add to the wall time, read as UTC, to get the epoch) at the start
+*            and at the end of the day (long*)
+*
+* Returns: 1 if the offset holds for the whole day, 0 for a day with a DST change
+********************************************************************************************/
+static int localDayOffset(long day, long *start, long *end)
+{
+    LocalDay *cached;
+    struct tm tm;
+    time_t first, last;
+    int year, mon, mday;
+
+    cached = &localDays[(unsigned long)day % LOCAL_DAY_CACHE];
+    if (cached->valid && cached->day == day)
+    {
+        *start = cached->offset;
+        *end = cached->offset;
+        return(1);
+    }
+
+    calCivilFromDays(day,&year,&mon,&mday);
+    memset(&tm,0,sizeof(tm));
+    tm.tm_year = year - 1900;
+    tm.tm_mon = mon - 1;
+    tm.tm_mday = mday;
+    tm.tm_isdst = -1;
+    first = mktime(&tm);
+
+    memset(&tm,0,sizeof(tm));
+    tm.tm_year = year - 1900;
+    tm.tm_mon = mon - 1;
+    tm.tm_mday = mday;
+    tm.tm_hour = 23;
+    tm.tm_min = 59;
+    tm.tm_sec = 59;
+    tm.tm_isdst = -1;
+    last = mktime(&tm);
+
+    *start = first - day*86400;
+    *end = last - (day*86400 + 86399);
+    //A DST change makes the day an hour shorter or longer
+    if (*start != *end)
+    {
+        return(0);
+    }
+    cached->day = day;
+    cached->offset = *start;
+    cached->valid = 1;
+    return(1);
+}
+
+/*decodeDate
+*
+* Purpose: To decode the value of a date property (DTSTART, DTEND, ...) once, when it is parsed.
+*
+* Arguments: A pointer to a CalArena or NULL (CalArena*), and the parsed CalProp (CalProp*)
+*
+* Returns: The decoded value, or NULL if the property is not a date or its value is malformed
+********************************************************************************************/
+static CalTime *decodeDate(CalArena *arena, CalProp *prop)
+{
+    CalTime date;
+    CalTime *decoded;
+    CalParam *param;
+
+    switch (prop->kind)
+    {
+        case PROP_DTSTART: case PROP_DTEND: case PROP_DUE: case PROP_COMPLETED:
+        case PROP_CREATED: case PROP_DTSTAMP: case PROP_LAST_MODIFIED: case PROP_RECURRENCE_ID:
+            break;
+        default:
+            return(NULL);
+    }
+    if (parseCalTime(prop->value,&date) != OK)
+    {
+        return(NULL);
+    }
+    for (param = prop->param; param != NULL && date.zone == CAL_FLOATING; param = param->next)
+    {
+        if (strcmp(param->name,"TZID") == 0)
+        {
+            date.zone = CAL_TZID;
+        }
+    }
+
+    decoded = arenaAlloc(arena,sizeof(CalTime),_Alignof(CalTime));
+    *decoded = date;
+    return(decoded);
+}
+
+/*isBlank
+*
+* Purpose: To find whether some characters are all spaces and tabs (see isEmpty), without
+*          needing them to be null terminated.
+*
+* Arguments: The characters (const char*) and their number (size_t)
+*
+* Returns: 1 if they are blank (or there are none), 0 otherwise
+********************************************************************************************/
+static int isBlank(const char *text, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (text[i] != ' ' && text[i] != '\t')
+        {
+            return(0);
+        }
+    }
+    return(1);
+}
+
+/*findDelimiters
+*
+* Purpose: To find the ':', ';', ',' and '=' characters outside double quotes in a block of up
+*          to 64 characters of a contentline, as one bit per character. The quotes and the
+*          delimiters are found in bulk (with SSE2, 16 characters per compare), and the
+*          characters between quotes by a prefix XOR of the quote bits: after it, each bit
+*          is the parity of the quotes up to and including its character.
+*
+* Arguments: The characters (const char*), their number (size_t, 1..64), and the address of
+*            the quote state at their start (uint64_t*: 0, or all ones between quotes),
+*            which is set to the state at their end
+*
+* Returns: The mask of delimiters outside quotes (bit 0 for the first character)
+********************************************************************************************/
+static uint64_t findDelimiters(const char *text, size_t count, uint64_t *inQuotes)
+{
+    char block[64];
+    uint64_t quotes, delims, inside;
+
+    //A short block is padded with nulls, which are neither quotes nor delimiters
+    if (count < 64)
+    {
+        memset(block,0,sizeof(block));
+        memcpy(block,text,count);
+        text = block;
+    }
+
+    quotes = 0;
+    delims = 0;
+#if CAL_SCAN_SSE2
+    __m128i chars, found;
+
+    for (int i = 0; i < 64; i += 16)
+    {
+        chars = _mm_loadu_si128((const __m128i *)(text+i));
+        found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chars,_mm_set1_epi8(':')),_mm_cmpeq_epi8(chars,_mm_set1_epi8(';'))),
+                             _mm_or_si128(_mm_cmpeq_epi8(chars,_mm_set1_epi8(',')),_mm_cmpeq_epi8(chars,_mm_set1_epi8('='))));
+        delims |= (uint64_t)(unsigned int)_mm_movemask_epi8(found) << i;
+        found = _mm_cmpeq_epi8(chars,_mm_set1_epi8('"'));
+        quotes |= (uint64_t)(unsigned int)_mm_movemask_epi8(found) << i;
+    }
+#else
+    for (int i = 0; i < 64; i++)
+    {
+        if (text[i] == '"')
+        {
+            quotes |= (uint64_t)1 << i;
+        }
+        else if (text[i] == ':' || text[i] == ';' || text[i] == ',' || text[i] == '=')
+        {
+            delims |= (uint64_t)1 << i;
+        }
+    }
+#endif
+
+    inside = quotes;
+    inside ^= inside << 1;
+    inside ^= inside << 2;
+    inside ^= inside << 4;
+    inside ^= inside << 8;
+    inside ^= inside << 16;
+    inside ^= inside << 32;
+    inside ^= *inQuotes;
+
+    //the state after the last character, for the next block
+    *inQuotes = (inside >> 63) ? ~(uint64_t)0 : 0;
+    return(delims & ~inside);
+}
+
+/*lowestBit
+*
+* Purpose: To find the index of the lowest set bit of a mask (which must not be 0).
+********************************************************************************************/
+static int lowestBit(uint64_t bits)
+{
+#if defined(__GNUC__)
+    return(__builtin_ctzll(bits));
+#else
+    int i = 0;
+
+    while ((bits & 1) == 0)
+    {
+        bits >>= 1;
+        i += 1;
+    }
+    return(i);
+#endif
+}
+
+/*readsValue
+*
+* Purpose: To find whether the library reads the values of a kind of property itself (to
+*          check the calendar, place its dates in time or expand recurrences), so they are
+*          always copied, even with CAL_SLICES.
+*
+* Arguments: The kind of property (CalPropKind)
+*
+* Returns: 1 if it does, 0 otherwise
+********************************************************************************************/
+static int readsValue(CalPropKind kind)
+{
+    switch (kind)
+    {
+        case PROP_BEGIN: case PROP_END: case PROP_VERSION:
+        case PROP_TZID: case PROP_TZOFFSETFROM: case PROP_TZOFFSETTO:
+        case PROP_RRULE: case PROP_RDATE: case PROP_EXDATE: case PROP_DURATION:
+        case PROP_DTSTART: case PROP_DTEND: case PROP_DUE: case PROP_COMPLETED:
+        case PROP_CREATED: case PROP_DTSTAMP: case PROP_LAST_MODIFIED: case PROP_RECURRENCE_ID:
+            return(1);
+        default:
+            return(0);
+    }
+}
+
+/*sliceValue
+*
+* Purpose: To point a property's raw value at the text after the ':' of the line just read
+*          from a mapped file, instead of copying it (CAL_SLICES). This is only done when the
+*          line is in the file as it was read: one stretch ending in CRLF that differs from
+*          the unfolded line by its folds alone (a CRLF and a space or tab each).
+*
+* Arguments: The input the line was read from (const CalInput*), the offset of the value in
+*            the unfolded line (size_t) and the property (CalProp*)
+*
+* Returns: 1 if raw and rawLen were set, 0 if the value has to be copied
+********************************************************************************************/
+static int sliceValue(const CalInput *in, size_t valueAt, CalProp *prop)
+{
+    const char *text, *end, *cr;
+    size_t skipped; // characters of the unfolded line before text
+
+    if (!in->mapped || in->lineEnd <= in->lineStart || in->lineEnd - in->lineStart > INT_MAX ||
+        in->lineEnd - in->lineStart != in->lineLen + 3*(size_t)in->folds)
+    {
+        return(0);
+    }
+
+    //Step over the folds before the value's first character
+    text = in->data + in->lineStart;
+    end = in->data + in->lineEnd;
+    skipped = 0;
+    for (;;)
+    {
+        cr = memchr(text,'\r',end-text);
+        if (cr == NULL)
+        {
+            cr = end;
+        }
+        if (skipped + (cr-text) >= valueAt)
+        {
+            break;
+        }
+        skipped += cr - text;
+        text = cr + 3;
+    }
+    text += valueAt - skipped;
+
+    //A fold at the very end holds none of the value
+    while (end - text >= 3 && end[-3] == '\r')
+    {
+        end -= 3;
+    }
+    prop->raw = text;
+    prop->rawLen = end - text;
+    return(1);
+}
+
+/*parseProp
+*
+* Purpose: To parse a contentline into a CalProp (see parseCalProp), allocating the
+*          property's strings and parameters from a CalArena (or with malloc if there is no arena).
+*          The line is read once, from delimiter to delimiter (see findDelimiters), as far as
+*          the ':' before the value; the name, parameters and value are copied straight
+*          from the line. Given the mapped input the line came from, a value the library does
+*          not read is left there instead (see sliceValue).
+*
+* Arguments: A pointer to a CalArena or NULL (CalArena*), the contentline (char*),
+*            an initialized CalProp (CalProp*), and the input of a CAL_SLICES read or NULL (const CalInput*)
+*
+* Returns: OK or SYNTAX (also for a parameter value with no parameter name before it)
+********************************************************************************************/
+static CalError parseProp(CalArena *arena, char *const buff, CalProp *const prop, const CalInput *in)
+{
+    CalParam *param = NULL; // parameter being read
+    CalParam *lastParam = NULL; // last parameter added to the property
+    CalError code = OK;
+    uint64_t delims;     // delimiters outside quotes in the block at base (bit 0 = buff[base])
+    uint64_t inQuotes;   // all ones if the block at base starts between quotes
+    size_t base;         // start of the block of (up to) 64 characters being read
+    size_t start = 0;    // start of the text before the next delimiter
+    size_t len, i;
+    long namePos = -1;   // end of the property's name: its first ';' or ':'
+    long colPos = -1;    // the first ':' outside quotes, where the value starts
+    int paramName = 0;   // Boolean flag signaling if a parameter has recieved its name.
+    char ch;
+
+    len = strlen(buff);
+    inQuotes = 0;
+
+    //Go from delimiter to delimiter up to the ':' before the value; the value is not read
+    for (base = 0; base < len && colPos == -1 && code == OK; base += 64)
+    {
+        delims = findDelimiters(buff+base,len-base < 64 ? len-base : 64,&inQuotes);
+        while (delims != 0 && colPos == -1 && code == OK)
+        {
+            i = base + lowestBit(delims);
+            delims &= delims - 1;
+            ch = buff[i];
+
+            //The name ends at the first ';' or ':' (',' and '=' are part of it)
+            if (namePos == -1)
+            {
+                if (ch == ';' || ch == ':')
+                {
+                    namePos = i;
+                    colPos = ch == ':' ? (long)i : -1;
+                    start = i + 1;
+                }
+                continue;
+            }
+
+            //propName
+            if (ch == '=')
+            {
+                //There is already a name for the parameter or it doesn't have a name
+                if (paramName == 1 || isBlank(buff+start,i-start))
+                {
+                    code = SYNTAX;
+                    continue;
+                }
+                param = newParam(arena);
+
+                //param Name needs to be uppercase
+                param->name = arenaString(arena,buff+start,i-start);
+                upperCase(param->name);
+                paramName = 1;
+            }
+            //Parameter Value: only after a parameter's name
+            else if (paramName == 0)
+            {
+                code = SYNTAX;
+                continue;
+            }
+            else
+            {
+                growParam(arena,&param,arenaString(arena,buff+start,i-start));
+
+                //New Parameter on semicolen
+                if (ch == ';' || ch == ':')
+                {
+                    appendParam(prop,&lastParam,param);
+                    param = NULL;
+                    paramName = 0;
+                }
+                if (ch == ':')
+                {
+                    colPos = i;
+                }
+            }
+            start = i + 1;
+        }
+    }
+
+    //Each property must have a value and therefore a colen, and a name
+    if (code != OK || colPos == -1 || namePos == 0)
+    {
+        if (param != NULL && arena == NULL)
+        {
+            freeCalParams(param);
+        }
+        return(SYNTAX);
+    }
+
+    //store the property name as UPPERCASE
+    prop->name = arenaString(arena,buff,namePos);
+    upperCase(prop->name);
+    prop->kind = calPropKind(prop->name);
+
+    if (in == NULL || readsValue(prop->kind) || !sliceValue(in,colPos+1,prop))
+    {
+        prop->value = arenaString(arena,buff+colPos+1,len-colPos-1);
+    }
+
+    //decode date values once, for the tools
+    prop->date = decodeDate(arena,prop);
+    return(OK);
+
+}
+
+CalError parseCalProp( char *const buff, CalProp *const prop )
+{
+    return(parseProp(NULL,buff,prop,NULL));
+}
+
+/*writeHead, writeTail
+*
+* Purpose: To write a component's BEGIN line and properties, or its END line.
+*
+* Arguments: The writer (CalWriter*) and the component (const CalComp*)
+********************************************************************************************/
+static void writeHead(CalWriter *w, const CalComp *comp)
+{
+    CalProp *writeProp;
+
+    // 1. OutPut BEGIN
+    writeNameLine(w,"BEGIN:",comp->name);
+
+    // 2. Add Properties
+    writeProp = comp->prop;
+    while(writeProp != NULL && w->code == OK)
+    {
+        writePropertyLine(w,writeProp);
+        writeProp = writeProp->next;
+    }
+}
+
+static void writeTail(CalWriter *w, const CalComp *comp)
+{
+    writeNameLine(w,"END:",comp->name);
+}
+
+CalStatus writeCalCompHead( FILE *const ics, const CalComp *comp )
+{
+    CalWriter w;
+
+    initWriter(&w,ics);
+    writeHead(&w,comp);
+    return(endWriter(&w));
+}
+
+CalStatus writeCalProp( FILE *const ics, const CalProp *prop )
+{
+    CalWriter w;
+
+    initWriter(&w,ics);
+    writePropertyLine(&w,prop);
+    return(endWriter(&w));
+}
+
+CalStatus writeCalCompTail( FILE *const ics, const CalComp *comp )
+{
+    CalWriter w;
+
+    initWriter(&w,ics);
+    writeTail(&w,comp);
+    return(endWriter(&w));
+}
+
+/*writeCompHead, writeCompTail
+*
+* Purpose: To write a component's BEGIN line and properties before its subcomponents, and
+*          its END line after them (the callbacks of writeCalComp). A component with text
+*          (CAL_SOURCE) is copied whole instead, and its subcomponents are skipped.
+********************************************************************************************/
+static CalVisit writeCompHead(const CalComp *comp, int depth, void *data)
+{
+    CalWriter *w = data;
+
+    if (comp->text != NULL)
+    {
+        writeSource(w,comp->text,comp->textLen);
+        return(w->code == OK ? CAL_SKIP : CAL_STOP);
+    }
+    writeHead(w,comp);
+    return(w->code == OK ? CAL_VISIT : CAL_STOP);
+}
+
+static CalVisit writeCompTail(const CalComp *comp, int depth, void *data)
+{
+    CalWriter *w = data;
+
+    if (comp->text == NULL)
+    {
+        writeTail(w,comp);
+    }
+    return(w->code == OK ? CAL_VISIT : CAL_STOP);
+}
+
+CalStatus writeCalComp( FILE *const ics, const CalComp *comp )
+{
+    CalWriter w;
+    CalVisitor visitor = { &w, writeCompHead, writeCompTail };
+
+    // BEGIN and properties, subcomponents, then END
+    initWriter(&w,ics);
+    walkCalComp(comp,&visitor);
+    return(endWriter(&w));
+}
+
+/*addLine
+*
+* Purpose: To add a line writeCalComp writes to a CalLength.
+*
+* Arguments: The length (CalLength*) and the length of the line before folding (size_t)
+********************************************************************************************/
+static void addLine(CalLength *length, size_t n)
+{
+    length->bytes += foldedLength(n);
+    length->lines += foldedLines(n);
+}
+
+/*sizeCompHead, sizeCompTail
+*
+* Purpose: To add up the bytes (and lines) writeCompHead and writeCompTail write for a
+*          component (the callbacks of calCompLength and calCompLines).
+********************************************************************************************/
+static CalVisit sizeCompHead(const CalComp *comp, int depth, void *data)
+{
+    CalLength *length = data;
+    const CalProp *prop;
+
+    if (comp->text != NULL)
+    {
+        length->bytes += comp->textLen;
+        if (length->counting)
+        {
+            length->lines += countLines(comp->text,comp->textLen);
+        }
+        return(CAL_SKIP);
+    }
+    addLine(length,strlen("BEGIN:") + strlen(comp->name));
+    for (prop = comp->prop; prop != NULL; prop = prop->next)
+    {
+        addLine(length,propertyLength(prop));
+    }
+    return(CAL_VISIT);
+}
+
+static CalVisit sizeCompTail(const CalComp *comp, int depth, void *data)
+{
+    CalLength *length = data;
+
+    if (comp->text == NULL)
+    {
+        addLine(length,strlen("END:") + strlen(comp->name));
+    }
+    return(CAL_VISIT);
+}
+
+size_t calCompLength( const CalComp *comp )
+{
+    CalLength length = { 0, 0, 0 };
+    CalVisitor visitor = { &length, sizeCompHead, sizeCompTail };
+
+    walkCalComp(comp,&visitor);
+    return(length.bytes);
+}
+
+int calCompLines( const CalComp *comp )
+{
+    CalLength length = { 0, 0, 1 };
+    CalVisitor visitor = { &length, sizeCompHead, sizeCompTail };
+
+    walkCalComp(comp,&visitor);
+    return(length.lines);
+}
+
+CalStatus writeCalCompToBuffer( const CalComp *comp, char **const pbuff, size_t *const plen )
+{
+    CalWriter w;
+    CalVisitor visitor = { &w, writeCompHead, writeCompTail };
+    CalStatus stat;
+    size_t size;
+
+    //The text is kept in one allocation of the length it comes to (and a '\0')
+    size = calCompLength(comp) + 1;
+    initMemoryWriter(&w,size);
+
+    walkCalComp(comp,&visitor);
+    *reserveWriter(&w,1) = '\0';
+    *pbuff = w.buff;
+    *plen = w.len;
+
+    stat = InitializeCalStatus();
+    stat.linefrom = w.lines;
+    updateLines(&stat);
+    return(stat);
+}
+
+/*writeRange
+*
+* Purpose: To write a run of a calendar's subcomponents to memory, as writeCalComp writes them.
+*
+* Arguments: The calendar (const CalComp*) and the run (CalWriteRange*), whose text is set
+********************************************************************************************/
+static void writeRange(const CalComp *comp, CalWriteRange *range)
+{
+    CalWriter w;
+    CalVisitor visitor = { &w, writeCompHead, writeCompTail };
+
+    initMemoryWriter(&w,CAL_WRITE_FLUSH);
+    for (int i = range->from; i < range->to; i++)
+    {
+        walkCalComp(comp->comp[i],&visitor);
+    }
+    range->text = w.buff;
+    range->len = w.len;
+    range->lines = w.lines;
+}
+
+/*writeRanges
+*
+* Purpose: To write the runs of a CalWriteWork not yet taken by another thread, one at a time.
+*
+* Arguments: The work (CalWriteWork*)
+********************************************************************************************/
+static void writeRanges(CalWriteWork *work)
+{
+    int next;
+
+    next = atomic_fetch_add(&work->next,1);
+    while (next < work->nranges)
+    {
+        writeRange(work->comp,&work->ranges[next]);
+        next = atomic_fetch_add(&work->next,1);
+    }
+}
+
+/*writeThread
+*
+* Purpose: To write runs of a calendar on a thread started by writeCalCompThreads.
+*
+* Arguments: The work (CalWriteWork*, as void*)
+*
+* Returns: NULL
+********************************************************************************************/
+static void *writeThread(void *arg)
+{
+    writeRanges(arg);
+    return(NULL);
+}
+
+/*writePieces
+*
+* Purpose: To hand the text of a calendar's head, runs and tail to a stream in order. The
+*          stream is flushed and the pieces go to its file in one writev (more if the file
+*          takes part of them); a stream with no file (e.g. open_memstream) is written to with
+*          fwrite. Where the stream's file can seek, the stream is then moved to its end.
+*
+* Arguments: The stream (FILE*), the pieces (const CalWriteRange*) and their number (int, at
+*            most CAL_THREADS_MAX*CAL_CHUNKS_PER_THREAD+2)
+*
+* Returns: The CalStatus of the write, with the number of lines the file took, and IOERR if
+*          it did not take them all
+********************************************************************************************/
+static CalStatus writePieces(FILE *const ics, const CalWriteRange *pieces, int npieces)
+{
+    struct iovec iov[CAL_THREADS_MAX*CAL_CHUNKS_PER_THREAD+2];
+    CalStatus stat;
+    ssize_t done;
+    size_t part;
+    off_t end;
+    int fd, first, partial, lines;
+
+    stat = InitializeCalStatus();
+    fd = fileno(ics);
+    if (fflush(ics) != 0)
+    {
+        stat.code = IOERR;
+        return(stat);
+    }
+
+    if (fd < 0)
+    {
+        for (int i = 0; i < npieces && stat.code == OK; i++)
+        {
+            part = fwrite(pieces[i].text,1,pieces[i].len,ics);
+            stat.linefrom += (part == pieces[i].len) ? pieces[i].lines : countLines(pieces[i].text,part);
+            stat.code = (part == pieces[i].len) ? OK : IOERR;
+        }
+        updateLines(&stat);
+        return(stat);
+    }
+
+    for (int i = 0; i < npieces; i++)
+    {
+        iov[i].iov_base = pieces[i].text;
+        iov[i].iov_len = pieces[i].len;
+    }
+    first = 0;
+    partial = 0;
+    while (first < npieces)
+    {
+        done = writev(fd,iov+first,npieces-first);
+        if (done < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (done <= 0)
+        {
+            //Nothing written: only pieces of no text may be left
+            while (first < npieces && iov[first].iov_len == 0)
+            {
+                first += 1;
+            }
+            if (first < npieces)
+            {
+                stat.code = IOERR;
+            }
+            break;
+        }
+
+        //Whole pieces, then the start of the one the file stopped in
+        while (first < npieces && (size_t)done >= iov[first].iov_len)
+        {
+            done -= iov[first].iov_len;
+            stat.linefrom += pieces[first].lines - partial;
+            partial = 0;
+            first += 1;
+        }
+        if (done > 0)
+        {
+            lines = countLines(iov[first].iov_base,done);
+            stat.linefrom += lines;
+            partial += lines;
+            iov[first].iov_base = (char *)iov[first].iov_base + done;
+            iov[first].iov_len -= done;
+        }
+    }
+
+    //The stream would otherwise go on from where it was before the writev
+    end = lseek(fd,0,SEEK_CUR);
+    if (end >= 0)
+    {
+        fseeko(ics,end,SEEK_SET);
+    }
+    updateLines(&stat);
+    return(stat);
+}
+
+CalStatus writeCalCompThreads( FILE *const ics, const CalComp *comp, int threads )
+{
+    pthread_t tids[CAL_THREADS_MAX];
+    CalWriteWork work;
+    CalWriteRange *pieces;
+    CalWriter w;
+    CalStatus stat;
+    int wanted, nthreads;
+
+    threads = threadCount(threads);
+    wanted = threads * CAL_CHUNKS_PER_THREAD;
+    if (comp->ncomps / CAL_WRITE_RANGE_MIN < wanted)
+    {
+        wanted = comp->ncomps / CAL_WRITE_RANGE_MIN;
+    }
+    if (ics == NULL || comp->text != NULL || threads < 2 || wanted < 2)
+    {
+        return(writeCalComp(ics,comp));
+    }
+
+    //The head, the runs of subcomponents (about as many in each), then the tail
+    pieces = malloc(sizeof(CalWriteRange)*(wanted+2));
+    assert(pieces != NULL);
+    for (int i = 0; i < wanted; i++)
+    {
+        pieces[i+1].from = (int)((long long)comp->ncomps * i / wanted);
+        pieces[i+1].to = (int)((long long)comp->ncomps * (i+1) / wanted);
+    }
+    work.comp = comp;
+    work.ranges = pieces+1;
+    work.nranges = wanted;
+    atomic_init(&work.next,0);
+
+    //If a thread can not be started, the ones that did (and this one) write its runs
+    nthreads = 0;
+    while (nthreads < threads-1 && nthreads < wanted-1)
+    {
+        if (pthread_create(&tids[nthreads],NULL,writeThread,&work) != 0)
+        {
+            break;
+        }
+        nthreads += 1;
+    }
+
+    initMemoryWriter(&w,CAL_WRITE_LOCAL);
+    writeHead(&w,comp);
+    pieces[0].text = w.buff;
+    pieces[0].len = w.len;
+    pieces[0].lines = w.lines;
+    initMemoryWriter(&w,CAL_WRITE_LOCAL);
+    writeTail(&w,comp);
+    pieces[wanted+1].text = w.buff;
+    pieces[wanted+1].len = w.len;
+    pieces[wanted+1].lines = w.lines;
+
+    writeRanges(&work);
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_join(tids[i],NULL);
+    }
+
+    stat = writePieces(ics,pieces,wanted+2);
+    for (int i = 0; i < wanted+2; i++)
+    {
+        free(pieces[i].text);
+    }
+    free(pieces);
+    return(stat);
+}
+
+void freeCalComp( CalComp *const comp )
+{
+    //A tree read into an arena is released with its root
+    if (comp->arena != NULL)
+    {
+        if (comp->arena->root == comp)
+        {
+            freeArena(comp->arena);
+        }
+        return;
+    }
+    freeCalComps(comp);
+}
+
+/*iterFrames
+*
+* Purpose: To find the stack of a CalIter: its own frames, or the heap copy once it has grown.
+********************************************************************************************/
+static CalIterFrame *iterFrames(CalIter *iter)
+{
+    return(iter->heap != NULL ? iter->heap : iter->frames);
+}
+
+/*pushIter
+*
+* Purpose: To add a component to the path of a CalIter, doubling its stack if it is full.
+*
+* Arguments: The iterator (CalIter*) and the component, which becomes the deepest (const CalComp*)
+*
+* Returns: The component's frame
+********************************************************************************************/
+static CalIterFrame *pushIter(CalIter *iter, const CalComp *comp)
+{
+    CalIterFrame *frames;
+
+    if (iter->depth + 1 == iter->size)
+    {
+        frames = malloc(sizeof(CalIterFrame)*iter->size*2);
+        assert(frames != NULL);
+        memcpy(frames,iterFrames(iter),sizeof(CalIterFrame)*iter->size);
+        free(iter->heap);
+        iter->heap = frames;
+        iter->size *= 2;
     }
-    return (stat);
+    iter->depth += 1;
+    frames = iterFrames(iter);
+    frames[iter->depth].comp = comp;
+    frames[iter->depth].next = 0;
+    return(&frames[iter->depth]);
 }
 
-CalError parseCalProp( char *const buff, CalProp *const prop )
+void initCalIter( CalIter *iter, const CalComp *root )
 {
-    CalParam *newParam = NULL; // new Paramerter to allocate
-    char *upperStr;    //To store an uppercase string
-    char buffer[PARSE_BUFF_SIZE];   //static buffer
-    int buffUsed = 0;  //amount of static buffer used
-    char *info = NULL; //dynamic buffer
-    char *pValue = NULL; //used to store Parameter Value
-    char ch;             //used to store a character from a buffer
-    int ignore = 0;      //Boolean flag to ignore special charaters that occur betwwen quataion marks when parsing
-    int semiPos = -1;  //Stores the location of the first semicolen that appears in "buff". -1 if non occurs
-    int colPos = -1;   //Stores the location of the first colen that appears in  "buff". -1 if non occurs
-    int namePos = 0;   //Stores the smaller of the semiPos or colPos variables. used to find the name of the prop
-    int paramName = 0; //Boolean flag signaling if a parameter has recieved its name.
-
-    int len;
-    len = strlen(buff);
+    iter->depth = -1;
+    iter->comp = NULL;
+    iter->prop = NULL;
+    iter->size = CAL_ITER_DEPTH;
+    iter->heap = NULL;
+    iter->frames[0].comp = root;
+    iter->frames[0].next = 0;
+}
+
+const CalComp *nextCalComp( CalIter *iter )
+{
+    CalIterFrame *frame;
 
-    //Find first semicolen and colen
-    for (int i = 0; i < len; i++)
+    //The root first (endCalIter leaves none)
+    if (iter->depth < 0)
     {
-        ch = buff[i];
-        //ignore between the quotes
-        if (ch == '"')
-        {
-            if (ignore == 1)
-            {
-                ignore = 0;    
-            }
-            else
-            {
-                ignore = 1;
-            }
-        }
-        
-        if (ignore == 0)
+        iter->comp = iter->frames[0].comp;
+        iter->depth = iter->comp != NULL ? 0 : -1;
+        return(iter->comp);
+    }
+
+    //The next subcomponent of the deepest component that has one left
+    frame = &iterFrames(iter)[iter->depth];
+    while (frame->next == frame->comp->ncomps)
+    {
+        if (iter->depth == 0)
         {
-            //Find the first colen
-            if (ch == ':' && colPos == -1)
-            {
-                colPos = i;
-            }
-            //find the first semicolen
-            else if (ch == ';' && semiPos == -1)
-            {
-                semiPos = i;
-            }
+            endCalIter(iter);
+            return(NULL);
         }
+        iter->depth -= 1;
+        frame -= 1;
     }
-    //Each property must have a value and therefore a colen. error if not
-    if (colPos == -1)
+    iter->comp = frame->comp->comp[frame->next];
+    frame->next += 1;
+    pushIter(iter,iter->comp);
+    return(iter->comp);
+}
+
+CalProp *nextCalProp( CalIter *iter )
+{
+    if (iter->prop != NULL)
     {
-        return(SYNTAX);
+        iter->prop = iter->prop->next;
     }
-    //Namepos become the small of semiPos or colenPos
-    if (colPos < semiPos || semiPos == -1)
+    while (iter->prop == NULL)
     {
-        namePos = colPos;
+        if (nextCalComp(iter) == NULL)
+        {
+            return(NULL);
+        }
+        iter->prop = iter->comp->prop;
     }
-    else
+    return(iter->prop);
+}
+
+void skipCalIter( CalIter *iter )
+{
+    CalIterFrame *frame;
+
+    if (iter->depth >= 0)
     {
-        namePos = semiPos;
+        frame = &iterFrames(iter)[iter->depth];
+        frame->next = frame->comp->ncomps;
     }
-    
-    //store the property name as UPPERCASE
-    prop->name = malloc(sizeof(char)*namePos+1);
-    assert(prop->name != NULL);
+}
 
-    strncpy(prop->name,buff,namePos);
-    prop->name[namePos] = '\0';
-    
-    upperStr = toUpper(prop->name);
-    free(prop->name);
-    prop->name = upperStr;
-    upperStr = NULL;
+void endCalIter( CalIter *iter )
+{
+    free(iter->heap);
+    iter->heap = NULL;
+    iter->size = CAL_ITER_DEPTH;
+    iter->depth = -1;
+    iter->comp = NULL;
+    iter->prop = NULL;
+    iter->frames[0].comp = NULL;
+}
 
-    //Empty name violates spec
-    if (strlen(prop->name) == 0)
+int walkCalComp( const CalComp *root, const CalVisitor *visitor )
+{
+    CalIter iter;
+    CalIterFrame *frame;
+    const CalComp *comp;
+    CalVisit visit;
+
+    if (root == NULL)
     {
-        return(SYNTAX);
+        return(0);
     }
-    
-    //Find the length of the property's value and store it
-
-    prop->value = malloc(sizeof(char)*(len-colPos)+1);
-    assert(prop->value != NULL);
-    strncpy(prop->value, buff+colPos+1,len-colPos);
- 
-    //If there was a semicolen, look for parameters
-    if (semiPos != -1)
+    initCalIter(&iter,root);
+    frame = pushIter(&iter,root);
+    visit = visitor->pre != NULL ? visitor->pre(root,0,visitor->data) : CAL_VISIT;
+    while (visit != CAL_STOP)
     {
-        ignore = 0;
-        for (int i = semiPos+1; i < colPos+1; i++)
+        if (visit == CAL_SKIP)
         {
-            pValue = NULL;
-            ch = buff[i];
-            if(ch == '"')
-            {
-                if (ignore == 1)
-                {
-                    ignore = 0;
-                }
-                else
-                {
-                    ignore = 1;
-                }
-            }
+            frame->next = frame->comp->ncomps;
+        }
 
-            if(ignore == 0)
-            {
-                if (ch == ';' || ch == ',' || ch == '=' || ch == ':')
-                {
-                    //Flush buffer
-                    buffer[buffUsed] = '\0';
-                    expandString(&info,buffer);
-                    buffUsed = 0;
+        //Down to the next subcomponent, or up once a component's subcomponents are done
+        if (frame->next < frame->comp->ncomps)
+        {
+            comp = frame->comp->comp[frame->next];
+            frame->next += 1;
+            frame = pushIter(&iter,comp);
+            visit = visitor->pre != NULL ? visitor->pre(comp,iter.depth,visitor->data) : CAL_VISIT;
+            continue;
+        }
+        comp = frame->comp;
+        iter.depth -= 1;
+        visit = visitor->post != NULL ? visitor->post(comp,iter.depth+1,visitor->data) : CAL_VISIT;
+        if (iter.depth < 0)
+        {
+            break;
+        }
+        frame = &iterFrames(&iter)[iter.depth];
+        visit = visit == CAL_STOP ? CAL_STOP : CAL_VISIT;
+    }
+    endCalIter(&iter);
+    return(visit == CAL_STOP);
+}
 
-                    //propName
-                    if(ch == '=')
-                    {
-                        //There is already a name for the parameter or it doesn't have a name
-                        if (paramName == 1 || isEmpty(info))
-                        {
-                            return(SYNTAX);
-                        }
-
-                        newParam = InitializeCalParam();
-
-                        //param Name needs to be uppercase
-                        //Memory is malloced in toUpper;
-                        newParam->name = toUpper(info);
-
-                        paramName = 1;
-                        free(info);
-                        info = NULL;
-                        continue;
-                    }
-                    //Parameter Value: needs to be  regular
-                    if (ch == ',' || ch == ';' || ch == ':')
-                    {
-                        if (isEmpty(info))
-                        {
-                            expandString(&info,"\0");
-                        }
-                        pValue = malloc(sizeof(char)*strlen(info)+1);
-                        assert(pValue != NULL);
-
-                        strcpy(pValue,info);
-                        expandCalParam(&newParam,pValue);
-                        free(info);
-                        info = NULL;
-                        //New Parameter on semicolen
-                        if (ch == ';' || ch == ':')
-                        {
-                            insertParam(prop,newParam);
-                            paramName = 0;
-                        }
-                        continue;
-                    }
-                }
-            }
-            //Add to buffer
-            buffer[buffUsed] = ch;
-            buffUsed += 1;
+CalPropKind calPropKind( const char *name )
+{
+    const unsigned char *s;
+    size_t len;
+    unsigned int slot;
 
-            //flush buffer
-            if (buffUsed == PARSE_BUFF_SIZE - 1)
-            {
-                buffer[buffUsed] = '\0';
-                expandString(&info,buffer);
-                buffUsed = 0;
-            }
-        }
+    if (name == NULL)
+    {
+        return(PROP_OTHER);
+    }
+    if (name[0] == 'X' && name[1] == '-')
+    {
+        return(PROP_X);
+    }
+    //every RFC 5545 property name has at least 3 chars
+    len = strlen(name);
+    if (len < 3)
+    {
+        return(PROP_OTHER);
     }
-    return(OK);
 
+    s = (const unsigned char*)name;
+    slot = (len + s[0] + 14*s[1] + 30*s[2] + 8*s[len-1]) & (PROP_HASH_SIZE-1);
+    if (propKinds[slot].name != NULL && strcmp(propKinds[slot].name,name) == 0)
+    {
+        return(propKinds[slot].kind);
+    }
+    return(PROP_OTHER);
 }
 
-CalStatus writeCalComp( FILE *const ics, const CalComp *comp )
+CalCompKind calCompKind( const char *name )
 {
-    CalStatus stat, subStat;
-    CalProp *writeProp;
+    const unsigned char *s;
+    size_t len;
+    unsigned int slot;
 
-    char *toWrite;
+    if (name == NULL)
+    {
+        return(COMP_OTHER);
+    }
+    //every RFC 5545 component name has at least 5 chars
+    len = strlen(name);
+    if (len < 5)
+    {
+        return(COMP_OTHER);
+    }
 
-    toWrite = NULL;
-    writeProp = NULL;
-    stat = InitializeCalStatus();
+    s = (const unsigned char*)name;
+    slot = (len + s[0] + 2*s[1] + 14*s[len-1]) & (COMP_HASH_SIZE-1);
+    if (compKinds[slot].name != NULL && strcmp(compKinds[slot].name,name) == 0)
+    {
+        return(compKinds[slot].kind);
+    }
+    return(COMP_OTHER);
+}
 
-    // 1. OutPut BEGIN
-    expandString(&toWrite,"BEGIN:\0");
-    expandString(&toWrite,comp->name);
-    
-    writeLine(ics,toWrite,&stat);
+long calDaysFromCivil( int year, int mon, int mday )
+{
+    long era, yoe, doy, doe;
+
+    year -= mon <= 2;
+    era = (year >= 0 ? year : year - 399) / 400;
+    yoe = year - era * 400;
+    doy = (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + mday - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return(era * 146097 + doe - 719468);
+}
 
-    free(toWrite);
-    toWrite = NULL;
+void calCivilFromDays( long days, int *year, int *mon, int *mday )
+{
+    long era, doe, yoe, doy, mp;
+
+    days += 719468;
+    era = (days >= 0 ? days : days - 146096) / 146097;
+    doe = days - era * 146097;
+    yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    doy = doe - (365*yoe + yoe/4 - yoe/100);
+    mp = (5*doy + 2) / 153;
+    *mday = doy - (153*mp + 2)/5 + 1;
+    *mon = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*mon <= 2);
+}
 
-    if (stat.code != OK)
+int calWeekday( long days )
+{
+    return(((days % 7) + 11) % 7); // 1970-01-01 was a Thursday
+}
+
+int calDaysInMonth( int year, int mon )
+{
+    if (mon == 12)
     {
-        return(stat);
+        return(31);
     }
+    return(calDaysFromCivil(year,mon+1,1) - calDaysFromCivil(year,mon,1));
+}
 
-    // 2. Add Properties
-    writeProp = comp->prop;
-    while(writeProp != NULL)
-    {
-        toWrite = createPropertyLine(writeProp);
-        writeLine(ics,toWrite,&stat);
+long calWallSeconds( const CalTime *date )
+{
+    return(calDaysFromCivil(date->year,date->mon,date->mday)*86400 +
+           date->hour*3600 + date->min*60 + date->sec);
+}
 
-        free(toWrite);
-        toWrite = NULL;
+CalError parseCalTime( const char *value, CalTime *date )
+{
+    int year, mon, mday, hour, min, sec;
+    long wall;
+
+    hour = 0;
+    min = 0;
+    sec = 0;
+    if (value == NULL || !readDigits(value,4,&year) || !readDigits(value+4,2,&mon) ||
+        !readDigits(value+6,2,&mday))
+    {
+        return(SYNTAX);
+    }
 
-        if (stat.code != OK)
+    date->zone = CAL_FLOATING;
+    date->dateOnly = 1;
+    if (value[8] == 'T')
+    {
+        if (!readDigits(value+9,2,&hour) || !readDigits(value+11,2,&min) || !readDigits(value+13,2,&sec))
         {
-            return(stat);
+            return(SYNTAX);
         }
+        date->dateOnly = 0;
+        if (value[15] == 'Z')
+        {
+            date->zone = CAL_UTC;
+        }
+    }
+    //the ranges strptime accepts
+    if (mon < 1 || mon > 12 || mday < 1 || mday > 31 || hour > 23 || min > 59 || sec > 61)
+    {
+        return(SYNTAX);
+    }
 
-        writeProp = writeProp->next;
+    //Wall time in seconds as if it were UTC; this normalizes Feb 30, second 60 etc.
+    wall = calDaysFromCivil(year,mon,mday)*86400 + hour*3600 + min*60 + sec;
+
+    //Read as local time, as the tools always have
+    date->t = calLocalToUtc(&wall);
+    calTimeFromWall(wall,date);
+    return(OK);
+}
+
+time_t calLocalToUtc( long *wall )
+{
+    struct tm tm;
+    time_t t;
+    long day, offset, offsetEnd;
+
+    day = *wall / 86400;
+    if (*wall % 86400 < 0)
+    {
+        day -= 1;
+    }
+    if (localDayOffset(day,&offset,&offsetEnd))
+    {
+        return(*wall + offset);
     }
 
-    // 3. add subComponents
-    
-    for (int i = 0; i < comp->ncomps; i++)
+    //Day of a DST change: the time is after or before the change. Like mktime, a
+    //repeated time is read as after it, and a skipped time with the offset from before it.
+    t = *wall + offsetEnd;
+    localtime_r(&t,&tm);
+    if (wallSeconds(&tm) != *wall)
     {
-    
-        //recursive call
-        subStat = writeCalComp(ics,comp->comp[i]);
+        t = *wall + offset;
+        localtime_r(&t,&tm);
+    }
+    *wall = wallSeconds(&tm);
+    return(t);
+}
 
-        //update stat with number of successful lines written
-        stat.code = subStat.code;
-        stat.linefrom += subStat.linefrom;
+void calTimeFromWall( long wall, CalTime *date )
+{
+    long day;
+    int year, mon, mday;
 
-        updateLines(&stat);
-        if (stat.code != OK)
-        {
-            return(stat);
-        }
+    day = wall / 86400;
+    if (wall % 86400 < 0)
+    {
+        day -= 1;
     }
+    calCivilFromDays(day,&year,&mon,&mday);
+    date->year = year;
+    date->mon = mon;
+    date->mday = mday;
+    date->hour = (wall - day*86400) / 3600;
+    date->min = (wall - day*86400) / 60 % 60;
+    date->sec = (wall - day*86400) % 60;
+}
 
-    // 4. Add END
-    expandString(&toWrite,"END:\0");
-    expandString(&toWrite,comp->name);
-
-    writeLine(ics,toWrite,&stat);
+CalError parseCalUtcOffset( const char *value, long *offset )
+{
+    int hour, min, sec;
 
-    free(toWrite);
-    toWrite = NULL;
-    // NOTE return IOERROR
-    return(stat);
+    sec = 0;
+    if (value == NULL || (value[0] != '+' && value[0] != '-') ||
+        !readDigits(value+1,2,&hour) || !readDigits(value+3,2,&min))
+    {
+        return(SYNTAX);
+    }
+    if (value[5] != '\0' && !readDigits(value+5,2,&sec))
+    {
+        return(SYNTAX);
+    }
+    if (min > 59 || sec > 59)
+    {
+        return(SYNTAX);
+    }
 
+    *offset = hour*3600 + min*60 + sec;
+    if (value[0] == '-')
+    {
+        *offset = -*offset;
+    }
+    return(OK);
 }
 
-void freeCalComp( CalComp *const comp )
+void calTimeToTm( const CalTime *date, struct tm *tm )
 {
-    freeCalComps(comp);
+    long days;
+
+    memset(tm,0,sizeof(struct tm));
+    tm->tm_year = date->year - 1900;
+    tm->tm_mon = date->mon - 1;
+    tm->tm_mday = date->mday;
+    tm->tm_hour = date->hour;
+    tm->tm_min = date->min;
+    tm->tm_sec = date->sec;
+    tm->tm_isdst = -1;
+
+    days = calDaysFromCivil(date->year,date->mon,date->mday);
+    tm->tm_wday = ((days % 7) + 11) % 7; // 1970-01-01 was a Thursday
+    tm->tm_yday = days - calDaysFromCivil(date->year,1,1);
 }
 
 CalComp *InitializeCalComp()
@@ -1051,9 +4246,13 @@ CalComp *InitializeCalComp()
     assert(newCalComp != NULL);
 
     newCalComp->name = NULL;
+    newCalComp->kind = COMP_OTHER;
     newCalComp->nprops = 0;
     newCalComp->prop = NULL;
     newCalComp->ncomps = 0;
+    newCalComp->arena = NULL;
+    newCalComp->text = NULL;
+    newCalComp->textLen = 0;
 
     return(newCalComp);
 }
@@ -1066,7 +4265,11 @@ CalProp *InitializeCalProp()
     assert(newCalProp != NULL);
 
     newCalProp->name = NULL;
+    newCalProp->kind = PROP_OTHER;
+    newCalProp->rawLen = 0;
     newCalProp->value = NULL;
+    newCalProp->raw = NULL;
+    newCalProp->date = NULL;
     newCalProp->nparams = 0;
     newCalProp->param = NULL;
     newCalProp->next = NULL;
@@ -1098,6 +4301,210 @@ CalStatus InitializeCalStatus()
     return(status);
 }
 
+CalParser *InitializeCalParser( FILE *const ics )
+{
+    CalParser *parser;
+
+    parser = malloc(sizeof(CalParser));
+    assert(parser != NULL);
+
+    initParser(parser);
+    parser->in.file = ics;
+
+    return(parser);
+}
+
+CalParser *InitializeCalParserFd( int fd )
+{
+    CalParser *parser;
+
+    parser = malloc(sizeof(CalParser));
+    assert(parser != NULL);
+
+    initParser(parser);
+    if (openInputFd(&parser->in,fd) != OK)
+    {
+        free(parser);
+        return(NULL);
+    }
+    return(parser);
+}
+
+void setCalParserOptions( CalParser *const parser, int options )
+{
+    parser->options = options;
+}
+
+void setCalParserThreads( CalParser *const parser, int threads )
+{
+    parser->threads = threadCount(threads);
+}
+
+/*unfoldRaw
+*
+* Purpose: To copy a raw value (see CAL_SLICES) without its folds.
+*
+* Arguments: The raw value and its length (const char*, int), and where to copy it (char*),
+*            which has room for rawLen+1 characters
+*
+* Returns: The length of the unfolded value, which is null terminated
+********************************************************************************************/
+static size_t unfoldRaw(const char *raw, int rawLen, char *value)
+{
+    const char *end, *cr;
+    size_t len;
+
+    end = raw + rawLen;
+    len = 0;
+    while (raw < end)
+    {
+        cr = memchr(raw,'\r',end-raw);
+        if (cr == NULL)
+        {
+            cr = end;
+        }
+        memcpy(value+len,raw,cr-raw);
+        len += cr - raw;
+
+        //each fold is a CRLF and a space or tab
+        raw = cr < end ? cr + 3 : end;
+    }
+    value[len] = '\0';
+    return(len);
+}
+
+const char *calPropValue( const CalComp *comp, CalProp *prop )
+{
+    char *value;
+    size_t len;
+
+    if (prop->value == NULL && prop->raw != NULL)
+    {
+        value = arenaAlloc(comp->arena,prop->rawLen+1,1);
+        len = unfoldRaw(prop->raw,prop->rawLen,value);
+
+        //the room the folds took is not part of the tree
+        if (comp->arena != NULL)
+        {
+            arenaRelease(comp->arena,value+len+1,prop->rawLen-len);
+        }
+        prop->value = value;
+    }
+    return(prop->value);
+}
+
+/*copyProps
+*
+* Purpose: To copy a component's properties and subcomponents into another in a CalArena
+*          (see copyCalComp). Raw values are copied unfolded, and decoded dates as they are.
+*
+* Arguments: The CalArena (CalArena*), the address of the copy, created with newComp from
+*            that arena and given its name (CalComp**), and the component copied (const CalComp*)
+*
+* PostConditions: *pcopy may have moved as its subcomponents were added (see growComp)
+********************************************************************************************/
+static void copyProps(CalArena *arena, CalComp **const pcopy, const CalComp *comp)
+{
+    const CalProp *from;
+    const CalParam *fromParam;
+    CalProp *prop, *lastProp;
+    CalParam *param, *lastParam;
+    CalComp *sub;
+    char *value;
+    size_t len;
+
+    lastProp = NULL;
+    for (from = comp->prop; from != NULL; from = from->next)
+    {
+        prop = newProp(arena);
+        prop->name = arenaString(arena,from->name,strlen(from->name));
+        prop->kind = from->kind;
+        if (from->value != NULL)
+        {
+            prop->value = arenaString(arena,from->value,strlen(from->value));
+        }
+        else if (from->raw != NULL)
+        {
+            value = arenaAlloc(arena,from->rawLen+1,1);
+            len = unfoldRaw(from->raw,from->rawLen,value);
+            arenaRelease(arena,value+len+1,from->rawLen-len);
+            prop->value = value;
+        }
+        if (from->date != NULL)
+        {
+            prop->date = arenaAlloc(arena,sizeof(CalTime),_Alignof(CalTime));
+            *prop->date = *from->date;
+        }
+
+        lastParam = NULL;
+        for (fromParam = from->param; fromParam != NULL; fromParam = fromParam->next)
+        {
+            param = newParam(arena);
+            param->name = arenaString(arena,fromParam->name,strlen(fromParam->name));
+            for (int i = 0; i < fromParam->nvalues; i++)
+            {
+                growParam(arena,&param,arenaString(arena,fromParam->value[i],strlen(fromParam->value[i])));
+            }
+            appendParam(prop,&lastParam,param);
+        }
+        appendProp(*pcopy,&lastProp,prop);
+    }
+
+    for (int i = 0; i < comp->ncomps; i++)
+    {
+        sub = newComp(arena);
+        sub->name = arenaString(arena,comp->comp[i]->name,strlen(comp->comp[i]->name));
+        sub->kind = comp->comp[i]->kind;
+        copyProps(arena,&sub,comp->comp[i]);
+        growComp(pcopy,sub);
+    }
+}
+
+CalComp *copyCalComp( const CalComp *comp )
+{
+    CalArena *arena;
+    CalComp *copy;
+
+    arena = newArena();
+    copy = newComp(arena);
+    arena->root = copy;
+    copy->name = arenaString(arena,comp->name,strlen(comp->name));
+    copy->kind = comp->kind;
+    copyProps(arena,&copy,comp);
+    return(copy);
+}
+
+void getCalArenaUsage( const CalComp *comp, size_t *used, size_t *wasted )
+{
+    CalArena *arena;
+
+    *used = 0;
+    *wasted = 0;
+    arena = comp->arena;
+    if (arena == NULL)
+    {
+        return;
+    }
+
+    *used = arena->used;
+    *wasted = arena->wasted;
+    //the unfilled end of the current block
+    if (arena->block != NULL)
+    {
+        *wasted += arena->block->size - arena->block->used;
+    }
+}
+
+void freeCalParser( CalParser *const parser )
+{
+    if (parser == NULL)
+    {
+        return;
+    }
+    closeInput(&parser->in);
+    free(parser);
+}
+
 void insertProperty(CalComp **const pcomp, CalProp *toAdd)
 {
     CalProp *tmpPtr;
@@ -1115,6 +4522,7 @@ void insertProperty(CalComp **const pcomp, CalProp *toAdd)
         tmpPtr->next = toAdd;
     }
     (*pcomp)->nprops += 1;
+    (*pcomp)->text = NULL;
 
 }
 
@@ -1141,20 +4549,36 @@ void insertParam(CalProp *prop,CalParam *toAdd)
 
 void expandCalComp(CalComp **const toExpand, CalComp *toAdd)
 {
+    int count;
 
-    *toExpand = realloc(*toExpand, sizeof(CalComp)+(sizeof(CalComp*)*(1+(*toExpand)->ncomps)));
-    assert(*toExpand != NULL);
+    //The room the block has is asked of malloc, not assumed from the count, so a CalComp
+    //allocated to fit its subcomponents (e.g. a shallow copy) is grown too. It grows to a
+    //doubling capacity (see slotCapacity), so adding is amortized O(1)
+    count = (*toExpand)->ncomps;
+    if (malloc_usable_size(*toExpand) < sizeof(CalComp)+(sizeof(CalComp*)*(count+1)))
+    {
+        *toExpand = realloc(*toExpand, sizeof(CalComp)+(sizeof(CalComp*)*slotCapacity(count+1)));
+        assert(*toExpand != NULL);
+    }
 
-    (*toExpand)->comp[(*toExpand)->ncomps] = toAdd;
+    (*toExpand)->comp[count] = toAdd;
     (*toExpand)->ncomps += 1;
+    (*toExpand)->text = NULL;
 }
 
 void expandCalParam(CalParam **const toExpand, char *toAdd)
 {
-    *toExpand = realloc(*toExpand, sizeof(CalParam)+ (sizeof(char*)*(1+(*toExpand)->nvalues)));
-    assert(*toExpand != NULL);
+    int count;
+
+    //as for expandCalComp
+    count = (*toExpand)->nvalues;
+    if (malloc_usable_size(*toExpand) < sizeof(CalParam)+(sizeof(char*)*(count+1)))
+    {
+        *toExpand = realloc(*toExpand, sizeof(CalParam)+ (sizeof(char*)*slotCapacity(count+1)));
+        assert(*toExpand != NULL);
+    }
 
-    (*toExpand)->value[(*toExpand)->nvalues] = toAdd;
+    (*toExpand)->value[count] = toAdd;
     (*toExpand)->nvalues += 1;
 }
 
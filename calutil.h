@@ -11,18 +11,77 @@
 #ifndef CALUTIL_H
 #define CALUTIL_H A2
 
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L // for fileno and mmap
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #define FOLD_LEN 75     // fold lines longer than this length (RFC 5545 3.1)
 #define VCAL_VER "2.0"  // version of standard accepted
 #define READ_BUFF_SIZE 75 //size of a buffer; used when reading lines of ics files
 #define PARSE_BUFF_SIZE 75 //size of a buffer; used when parsing lines of ics files
+#define READ_BLOCK_SIZE 65536 //size of a block read from a pipe or FILE stream
+#define ARENA_BLOCK_SIZE 65536 //size of a block of memory in a calendar's arena
+#define LOCAL_DAY_CACHE 4096 //days of local time offsets each thread keeps (parseCalTime)
+#define CAL_CHUNK_MIN 262144 //smallest run of components parsed on a thread of its own (setCalParserThreads)
+#define CAL_CHUNKS_PER_THREAD 4 //runs a mapped calendar is split into for each thread, so threads finish together
+#define CAL_THREADS_MAX 64 //most threads a parser uses
+#define CAL_WRITE_FLUSH 262144 //bytes of text writeCalComp gathers before handing them to the stream
+#define CAL_WRITE_LOCAL 512 //bytes of text a write gathers without allocating
+#define CAL_WRITE_RANGE_MIN 1024 //fewest subcomponents written on a thread of their own (writeCalCompThreads)
+#define CAL_ITER_DEPTH 8 //levels of a tree a CalIter walks without allocating (deeper trees grow its stack)
+
+/* parser options (setCalParserOptions) */
+#define CAL_ARENA 0x1   // allocate the whole tree from one arena; freeCalComp releases it at once
+#define CAL_SLICES 0x2  // with CAL_ARENA, leave values in the mapped file until asked for (see calPropValue)
+#define CAL_SOURCE 0x4  // keep where each component is in the mapped file, for writeCalComp to copy (see CalComp's text)
 
 /* data structures for ICS file in memory */
 
+typedef struct CalArena CalArena;   // block memory of a tree read with CAL_ARENA (see calutil.c)
+
+/* Kinds of properties and components, set from their names when they are parsed
+   (see calPropKind and calCompKind). RFC 5545 names in the order of section 3.7/3.8. */
+
+typedef enum { PROP_OTHER=0,   // IANA or unrecognized property
+    PROP_X,             // X- extension property
+    PROP_BEGIN, PROP_END,
+    PROP_CALSCALE, PROP_METHOD, PROP_PRODID, PROP_VERSION,
+    PROP_ATTACH, PROP_CATEGORIES, PROP_CLASS, PROP_COMMENT, PROP_DESCRIPTION, PROP_GEO,
+    PROP_LOCATION, PROP_PERCENT_COMPLETE, PROP_PRIORITY, PROP_RESOURCES, PROP_STATUS, PROP_SUMMARY,
+    PROP_COMPLETED, PROP_DTEND, PROP_DUE, PROP_DTSTART, PROP_DURATION, PROP_FREEBUSY, PROP_TRANSP,
+    PROP_TZID, PROP_TZNAME, PROP_TZOFFSETFROM, PROP_TZOFFSETTO, PROP_TZURL,
+    PROP_ATTENDEE, PROP_CONTACT, PROP_ORGANIZER, PROP_RECURRENCE_ID, PROP_RELATED_TO, PROP_URL, PROP_UID,
+    PROP_EXDATE, PROP_RDATE, PROP_RRULE,
+    PROP_ACTION, PROP_REPEAT, PROP_TRIGGER,
+    PROP_CREATED, PROP_DTSTAMP, PROP_LAST_MODIFIED, PROP_SEQUENCE,
+    PROP_REQUEST_STATUS,
+} CalPropKind;
+
+typedef enum { COMP_OTHER=0,   // X- or IANA component
+    COMP_VCALENDAR, COMP_VEVENT, COMP_VTODO, COMP_VJOURNAL, COMP_VFREEBUSY,
+    COMP_VTIMEZONE, COMP_STANDARD, COMP_DAYLIGHT, COMP_VALARM,
+} CalCompKind;
+
+/* How the time of a DATE-TIME value is to be read */
+typedef enum { CAL_FLOATING=0,  // local time wherever the calendar is used
+    CAL_UTC,            // value ends in 'Z'
+    CAL_TZID,           // qualified by a TZID parameter
+} CalZone;
+
+typedef struct CalTime {    // decoded DATE or DATE-TIME value
+    time_t t;           // seconds since the epoch, the value read as local time
+    short year;         // e.g. 2016
+    char mon, mday;     // 1..12, 1..31
+    char hour, min, sec;
+    char zone;          // CalZone
+    char dateOnly;      // 1 for a DATE value (no time of day)
+} CalTime;
+
 typedef struct CalParam CalParam;
 typedef struct CalParam {    // property's parameter
     char *name;         // uppercase
@@ -34,7 +93,12 @@ typedef struct CalParam {    // property's parameter
 typedef struct CalProp CalProp;
 typedef struct CalProp {    // (sub)component's property (=contentline)
     char *name;         // uppercase
-    char *value;
+    CalPropKind kind;   // kind of property named by name
+    int rawLen;         // length of raw
+    char *value;        // NULL until calPropValue if the value is still raw
+    const char *raw;    // value as it is in a file read with CAL_SLICES, folds and all (or NULL)
+    CalTime *date;      // value decoded for DTSTART, DTEND, DUE, COMPLETED, CREATED,
+                        // DTSTAMP, LAST-MODIFIED and RECURRENCE-ID (NULL otherwise or if malformed)
     int nparams;        // no. of parameters
     CalParam *param;    // -> first parameter (or NULL)
     CalProp *next;      // linked list of properties (ends with NULL)
@@ -43,8 +107,13 @@ typedef struct CalProp {    // (sub)component's property (=contentline)
 typedef struct CalComp CalComp;
 typedef struct CalComp {    // calendar's (sub)component
     char *name;         // uppercase
+    CalCompKind kind;   // kind of component named by name
     int nprops;         // no. of properties
     CalProp *prop;      // -> first property (or NULL)
+    CalArena *arena;    // arena the component was allocated from (or NULL)
+    const char *text;   // BEGIN to END as it is in a file read with CAL_SOURCE (or NULL); set it to
+                        // NULL when the component, or any component it holds, is changed
+    size_t textLen;     // length of text
     int ncomps;         // no. of subcomponents
     CalComp *comp[];    // component pointers (flexible array member)
 } CalComp;
@@ -71,15 +140,264 @@ typedef struct {
 } CalStatus;    
 
 
+/* Reader state for one calendar: its input, line numbers and nesting depth.
+   Defined in calutil.c; create with InitializeCalParser / InitializeCalParserFd. */
+
+typedef struct CalParser CalParser;
+
+/* What readCalStream does with a calendar as it is read. Any callback may be NULL. Each
+   returns OK to go on reading, or an error code to stop; readCalStream then returns it. */
+
+typedef struct CalStreamCallbacks {
+    void *data;         // passed to every callback
+    CalError (*header)( const CalComp *cal, void *data );
+                        // VCALENDAR and its properties, before the first component
+    CalError (*comp)( CalComp **const pcomp, const CalComp *cal, void *data );
+                        // each top level component, its dates resolved; set *pcomp to
+                        // NULL to keep it (then free it with freeCalComp)
+    CalError (*end)( const CalComp *cal, void *data );
+                        // END:VCALENDAR read and the calendar checked as readCalFile does
+} CalStreamCallbacks;
+
+
+/* Place of a depth first walk over a calendar tree, kept on an explicit stack rather than
+   by recursion. Declare one, start it with initCalIter and step it with nextCalComp or
+   nextCalProp (see below). */
+
+typedef struct CalIterFrame {
+    const CalComp *comp;    // component on the path from the root
+    int next;               // its next subcomponent to visit
+} CalIterFrame;
+
+typedef struct CalIter {
+    int depth;              // depth of the component last returned (0 for the root; -1 before it)
+    const CalComp *comp;    // component last returned, or holding the property last returned
+    CalProp *prop;          // property last returned by nextCalProp (or NULL)
+    int size;               // frames the stack has room for
+    CalIterFrame *heap;     // the stack, once it outgrows frames (or NULL)
+    CalIterFrame frames[CAL_ITER_DEPTH];
+} CalIter;
+
+/* What walkCalComp does after a visitor's callback */
+typedef enum { CAL_VISIT=0,    // go on, into the component's subcomponents
+    CAL_SKIP,       // go on, leaving out the component's subcomponents (from pre)
+    CAL_STOP,       // end the walk
+} CalVisit;
+
+typedef struct CalVisitor {
+    void *data;         // passed to every callback
+    CalVisit (*pre)( const CalComp *comp, int depth, void *data );
+                        // each component, before its subcomponents (may be NULL)
+    CalVisit (*post)( const CalComp *comp, int depth, void *data );
+                        // each component, after its subcomponents (may be NULL)
+} CalVisitor;
+
+
 /* File I/O functions */
 
 CalStatus readCalFile( FILE *const ics, CalComp **const pcomp );
+CalStatus readCalFilePath( const char *const path, CalComp **const pcomp );
+CalStatus readCalFileFd( int fd, CalComp **const pcomp );
 CalStatus readCalComp( FILE *const ics, CalComp **const pcomp );
 CalStatus readCalLine( FILE *const ics, char **const pbuff );
+CalStatus readCalFileEx( CalParser *const parser, CalComp **const pcomp );
+CalStatus readCalCompEx( CalParser *const parser, CalComp **const pcomp );
+CalStatus readCalLineEx( CalParser *const parser, char **const pbuff );
+CalStatus readCalStream( CalParser *const parser, const CalStreamCallbacks *callbacks );
 CalError parseCalProp( char *const buff, CalProp *const prop );
 CalStatus writeCalComp( FILE *const ics, const CalComp *comp );
+CalStatus writeCalCompThreads( FILE *const ics, const CalComp *comp, int threads );
+CalStatus writeCalCompHead( FILE *const ics, const CalComp *comp );
+CalStatus writeCalProp( FILE *const ics, const CalProp *prop );
+CalStatus writeCalCompTail( FILE *const ics, const CalComp *comp );
+CalStatus writeCalCompToBuffer( const CalComp *comp, char **const pbuff, size_t *const plen );
+size_t calCompLength( const CalComp *comp );
+int calCompLines( const CalComp *comp );
 void freeCalComp( CalComp *const comp );
 
+/*readCalFilePath / readCalFileFd
+*
+* Purpose: To read an ics file the same way as readCalFile, but from a file path or an
+*          open file descriptor. Regular files are memory mapped and parsed in place;
+*          pipes (e.g. caltool's stdin) are read in blocks of READ_BLOCK_SIZE bytes.
+*          readCalFile(FILE*) remains as a compatibility shim that reads the stream in blocks.
+*
+* Arguments: The path of an ics file (const char*) or a descriptor open for reading (int),
+*            and the address of a CalComp pointer to populate (CalComp **).
+*
+* Returns: The CalStatus of the read. IOERR if the file could not be opened or mapped.
+*          The descriptor is not closed.
+********************************************************************************************/
+
+/*readCalStream
+*
+* Purpose: To read a calendar one top level component at a time, so that memory is needed
+*          only for the component being read (however long the file is). Each component is
+*          handed to the comp callback as soon as its END is read, and freed when it returns.
+*          The VCALENDAR passed to the callbacks (cal) has the calendar's properties and its
+*          VTIMEZONEs; VTIMEZONEs stay with it to resolve the TZIDs of later components (a
+*          TZID used before its VTIMEZONE is looked up in the system's zoneinfo).
+*          Properties of the VCALENDAR that come after its first component are only in the
+*          cal passed to the end callback. With CAL_ARENA each component has its own arena.
+*
+* Arguments: A CalParser (CalParser*) and the callbacks (const CalStreamCallbacks*)
+*
+* Returns: The CalStatus of the read (the same as readCalFile's for the same file), or the
+*          first error a callback returned. The checks that need the whole calendar
+*          (NOCAL, BADVER, NOPROD and AFTEND) are made at its end, after every comp callback.
+********************************************************************************************/
+
+/*writeCalComp
+*
+* Purpose: To write a component and its subcomponents to an ics file, folding lines longer
+*          than FOLD_LEN. The text is gathered in a buffer and handed to the stream
+*          CAL_WRITE_FLUSH bytes at a time, not a line at a time; the stream is not flushed,
+*          so what is left in its own buffer goes out when the caller flushes or closes it.
+*          A component read with CAL_SOURCE and not changed since (its text is not NULL) is
+*          copied as it was read, subcomponents and all; its text is only kept when it is what
+*          would be written anyway.
+*
+* Arguments: An open ics file (FILE*) and the component (const CalComp*)
+*
+* Returns: The CalStatus of the write, with the number of lines written. IOERR if the stream
+*          did not take all of them; the lines are then those it took.
+********************************************************************************************/
+
+/*writeCalCompThreads
+*
+* Purpose: To write a component as writeCalComp does, on several threads. Its subcomponents
+*          are split into runs of at least CAL_WRITE_RANGE_MIN, which threads write to memory
+*          at the same time; the stream is then flushed and the texts handed to its file in
+*          order with one writev, so the whole text is in memory at once. The text is the
+*          same as writeCalComp's. Components with too few subcomponents, or copied as they
+*          were read (CAL_SOURCE), and writes given one thread are left to writeCalComp.
+*
+* Arguments: An open ics file (FILE*), the component (const CalComp*) and the most threads to
+*            use (int): 0 for one per online processor (at most CAL_THREADS_MAX)
+*
+* Returns: The CalStatus of the write, as writeCalComp returns it: the number of lines
+*          written, and IOERR if the file did not take them all (the lines are then those it
+*          took). The stream has been flushed if the component was written on threads.
+********************************************************************************************/
+
+/*writeCalCompToBuffer / calCompLength / calCompLines
+*
+* Purpose: To write a component and its subcomponents to memory instead of a file, exactly as
+*          writeCalComp writes them. calCompLength works out the length of the text first
+*          (without writing it), so the text is written into one allocation of that size;
+*          calCompLines works out the number of lines the same way.
+*
+* Arguments: The component (const CalComp*), and the addresses of the text's pointer and
+*            length to set (char **, size_t *)
+*
+* Returns: calCompLength: the bytes writeCalComp writes for the component.
+*          calCompLines: the lines writeCalComp writes for the component.
+*          writeCalCompToBuffer: the CalStatus of the write (OK), with the number of lines
+*          written. *pbuff is malloced and '\0' terminated (free it), *plen its length.
+********************************************************************************************/
+
+/*writeCalCompHead / writeCalProp / writeCalCompTail
+*
+* Purpose: To write a component piece by piece, the way writeCalComp writes it whole: its
+*          BEGIN line and properties, one property, or its END line (e.g. to write a
+*          calendar whose components are read with readCalStream).
+*
+* Returns: The CalStatus of the write, with the number of lines written (as writeCalComp)
+********************************************************************************************/
+
+/*calPropKind / calCompKind
+*
+* Purpose: To identify an uppercase property or component name. The RFC 5545 names are
+*          looked up in a perfect-hash table, so identifying a name costs one hash and
+*          at most one strcmp. The parser stores the result in CalProp/CalComp's kind.
+*
+* Arguments: An uppercase name (const char*)
+*
+* Returns: The kind of the name, PROP_X for X- properties, or PROP_OTHER / COMP_OTHER
+*          for any other name (and for NULL).
+********************************************************************************************/
+CalPropKind calPropKind( const char *name );
+CalCompKind calCompKind( const char *name );
+
+/*parseCalTime
+*
+* Purpose: To decode an RFC 5545 DATE (yyyymmdd) or DATE-TIME (yyyymmddThhmmss[Z]) value.
+*          The parser does this once for every date property and keeps the result in
+*          CalProp's date, so the tools need not call strptime and mktime again.
+*          The date is decoded with days-from-civil arithmetic; local time offsets are
+*          cached per thread and day, so mktime (and glibc's tz lock) is needed about once
+*          for each day seen, and for values on the day of a DST change.
+*
+* Arguments: The value (const char*) and the address of a CalTime to fill (CalTime*)
+*
+* Returns: OK, or SYNTAX if the value is not a DATE or DATE-TIME. A TZID parameter is
+*          not seen here; the parser sets zone to CAL_TZID when the property has one.
+*          Fields out of range (e.g. Feb 30) are normalized the way mktime does.
+********************************************************************************************/
+CalError parseCalTime( const char *value, CalTime *date );
+
+/*calTimeToTm
+*
+* Purpose: To fill a struct tm with the wall time of a CalTime, e.g. for strftime.
+*
+* Arguments: A decoded time (const CalTime*) and the struct tm to fill (struct tm*)
+********************************************************************************************/
+void calTimeToTm( const CalTime *date, struct tm *tm );
+
+/*calDaysFromCivil / calCivilFromDays
+*
+* Purpose: To convert between a date of the proleptic Gregorian calendar (year, month 1..12,
+*          day of the month) and the number of days from 1970-01-01 (negative before it).
+*          Out of range days of the month (e.g. Feb 30) are counted on into the next month.
+********************************************************************************************/
+long calDaysFromCivil( int year, int mon, int mday );
+void calCivilFromDays( long days, int *year, int *mon, int *mday );
+
+/*calWeekday / calDaysInMonth
+*
+* Purpose: To find the day of the week of a day counted from 1970-01-01 (0 = Sunday ..
+*          6 = Saturday), and the number of days in a month (1..12) of a year.
+********************************************************************************************/
+int calWeekday( long days );
+int calDaysInMonth( int year, int mon );
+
+/*calWallSeconds
+*
+* Purpose: To count the seconds from 1970-01-01 00:00 to the wall time of a CalTime,
+*          as if it were UTC (i.e. ignoring its zone).
+********************************************************************************************/
+long calWallSeconds( const CalTime *date );
+
+/*calLocalToUtc
+*
+* Purpose: To find the instant of a wall time read as local time (a floating time), the way
+*          parseCalTime does. A time skipped by a DST change is read with the offset from
+*          before the change, so it moves past the change.
+*
+* Arguments: The address of the wall time, in seconds from 1970-01-01 00:00 as if it were UTC
+*            (long*); it is set to the wall time actually read
+*
+* Returns: Seconds since the epoch
+********************************************************************************************/
+time_t calLocalToUtc( long *wall );
+
+/*calTimeFromWall
+*
+* Purpose: To set the date and time of day of a CalTime (year .. sec) from a wall time in
+*          seconds from 1970-01-01 00:00, as if it were UTC. t, zone and dateOnly are unchanged.
+********************************************************************************************/
+void calTimeFromWall( long wall, CalTime *date );
+
+/*parseCalUtcOffset
+*
+* Purpose: To decode an RFC 5545 UTC-OFFSET value ((+|-)hhmm[ss], e.g. TZOFFSETFROM).
+*
+* Arguments: The value (const char*) and the address of the offset in seconds to set (long*)
+*
+* Returns: OK, or SYNTAX if the value is not a UTC-OFFSET
+********************************************************************************************/
+CalError parseCalUtcOffset( const char *value, long *offset );
+
 /*Data Structure  Management functions*/
 
 /*InitializeCalComp
@@ -109,6 +427,169 @@ CalProp *InitializeCalProp();
 ********************************************************************************************/
 CalParam *InitializeCalParam();
 
+/*InitializeCalParser
+*
+* Purpose: To create a parser that reads one calendar from a FILE stream (in blocks).
+*          All state that readCalLine and readCalComp keep between calls lives in the
+*          parser, so no reset call is needed and several calendars can be read at once.
+*
+* Post Conditions: A CalParser is returned with malloced memory. Free it with freeCalParser
+*                  (the stream is not closed).
+********************************************************************************************/
+CalParser *InitializeCalParser( FILE *const ics );
+
+/*InitializeCalParserFd
+*
+* Purpose: To create a parser that reads one calendar from a file descriptor. Regular
+*          files are memory mapped; pipes are read in blocks.
+*
+* Post Conditions: A CalParser is returned with malloced memory, or NULL if the
+*                  descriptor could not be mapped. Free it with freeCalParser
+*                  (the descriptor is not closed).
+********************************************************************************************/
+CalParser *InitializeCalParserFd( int fd );
+
+/*setCalParserOptions
+*
+* Purpose: To choose how a parser builds its tree. With CAL_ARENA, readCalFileEx
+*          allocates every component, property, parameter and string of the calendar
+*          from one arena, and freeCalComp on the root releases it in one step.
+*          (Subcomponents of an arena tree are not freed on their own.)
+*
+*          With CAL_ARENA | CAL_SLICES as well, a memory mapped calendar read by readCalFileEx
+*          keeps the mapping (freeCalComp unmaps it), and a property value the library does not
+*          read itself is left there: the property's value is NULL and raw/rawLen point at the
+*          value as it is in the file. calPropValue unfolds such a value when it is needed,
+*          and writeCalComp copies it out as it is.
+*
+*          With CAL_SOURCE as well, each component of such a calendar whose lines are already
+*          as writeCalComp writes them (uppercase names, CRLF, folded after FOLD_LEN characters)
+*          keeps where they are in the mapping (text/textLen, BEGIN to END), and writeCalComp
+*          copies it straight from there instead of writing it out property by property. Either
+*          way it is written the same as if it had been read from a pipe. CAL_SOURCE
+*          also does this for the components readCalStream hands to its comp callback while
+*          they are being handed (a component the callback keeps loses its text).
+*
+* Arguments: A CalParser (CalParser*) and the options to use (CAL_ARENA, CAL_ARENA | CAL_SLICES,
+*            either with CAL_SOURCE, or 0)
+********************************************************************************************/
+void setCalParserOptions( CalParser *const parser, int options );
+
+/*setCalParserThreads
+*
+* Purpose: To let readCalFileEx parse a memory mapped calendar on several threads. The file is
+*          scanned for the BEGIN lines of its top level components and cut there into runs of
+*          at least CAL_CHUNK_MIN bytes, which threads parse at the same time; the runs are then
+*          joined into one tree in the order of the file, as a single thread would build it.
+*          If a run does not parse cleanly the whole file is read again on one thread, so the
+*          CalStatus of a bad file (code and line numbers) is the one readCalFile returns.
+*          Pipes, FILE streams and small files are always read on one thread.
+*
+* Arguments: A CalParser (CalParser*) and the most threads to use (int): 1 (the default) for
+*            one thread, or 0 for one per online processor (at most CAL_THREADS_MAX)
+********************************************************************************************/
+void setCalParserThreads( CalParser *const parser, int threads );
+
+/*getCalArenaUsage
+*
+* Purpose: To report the memory held by the arena of a tree read with CAL_ARENA.
+*
+* Arguments: The root of the tree (CalComp*), and the addresses of two sizes to set (size_t*):
+*            - used: bytes that hold the tree
+*            - wasted: bytes the arena holds but the tree does not use (dropped lines,
+*              replaced arrays, alignment and the unused end of blocks)
+*            Both are 0 for trees allocated with malloc.
+********************************************************************************************/
+void getCalArenaUsage( const CalComp *comp, size_t *used, size_t *wasted );
+
+/*calPropValue
+*
+* Purpose: To get the value of a property, unfolding a raw value (see CAL_SLICES) into the
+*          arena of its component the first time it is asked for.
+*
+* Arguments: The component that holds the property (const CalComp*) and the property (CalProp*)
+*
+* Returns: The value, as parseCalProp would have stored it (valid as long as the tree)
+********************************************************************************************/
+const char *calPropValue( const CalComp *comp, CalProp *prop );
+
+/*copyCalComp
+*
+* Purpose: To copy a component, its properties and its subcomponents into a tree of its own,
+*          allocated from one arena as if it had been read with CAL_ARENA, that lives on after
+*          the trees it was copied from are freed. The component may be a shallow copy that
+*          shares its properties or subcomponents with other trees (see calFilter). Raw values
+*          (see CAL_SLICES) are copied unfolded, dates are kept as they were decoded and placed
+*          in time, and no component of the copy has text (see CAL_SOURCE).
+*
+* Arguments: The component (const CalComp*)
+*
+* Returns: The copy (free it with freeCalComp)
+********************************************************************************************/
+CalComp *copyCalComp( const CalComp *comp );
+
+/*initCalIter
+*
+* Purpose: To start a walk over a component and its subcomponents, in pre-order: each
+*          component comes before its subcomponents, which come in the order of comp[].
+*          The walk keeps the path from the root on a stack, so it takes no stack space per
+*          level and allocates nothing unless the tree is deeper than CAL_ITER_DEPTH.
+*
+* Arguments: The iterator (CalIter*) and the root of the walk (const CalComp*, may be NULL)
+********************************************************************************************/
+void initCalIter( CalIter *iter, const CalComp *root );
+
+/*nextCalComp
+*
+* Purpose: To step a walk to the next component. iter->depth is then its depth below the root.
+*
+* Returns: The component, or NULL at the end of the walk
+********************************************************************************************/
+const CalComp *nextCalComp( CalIter *iter );
+
+/*nextCalProp
+*
+* Purpose: To step a walk to the next property: the properties of each component, in the
+*          order of the components nextCalComp returns. iter->comp is the component that
+*          holds it. Use either nextCalComp or nextCalProp on one iterator, not both.
+*
+* Returns: The property, or NULL at the end of the walk
+********************************************************************************************/
+CalProp *nextCalProp( CalIter *iter );
+
+/*skipCalIter
+*
+* Purpose: To leave the subcomponents of the component nextCalComp returned last out of a walk.
+********************************************************************************************/
+void skipCalIter( CalIter *iter );
+
+/*endCalIter
+*
+* Purpose: To free what a walk holds when it is given up before its end (a walk that
+*          reaches its end frees it itself).
+********************************************************************************************/
+void endCalIter( CalIter *iter );
+
+/*walkCalComp
+*
+* Purpose: To call a visitor's callbacks for a component and each of its subcomponents, the
+*          pre callback in pre-order and the post callback once the component's subcomponents
+*          are done (post-order). post is called for every component pre was, even if pre
+*          returned CAL_SKIP. A post callback may free its component. Like nextCalComp this
+*          uses no recursion.
+*
+* Arguments: The root (const CalComp*) and the visitor (const CalVisitor*)
+*
+* Returns: 1 if a callback stopped the walk (CAL_STOP), 0 otherwise
+********************************************************************************************/
+int walkCalComp( const CalComp *root, const CalVisitor *visitor );
+
+/*freeCalParser
+*
+* Purpose: To free a CalParser and any input buffer or file mapping it holds.
+********************************************************************************************/
+void freeCalParser( CalParser *const parser );
+
 /*InitializeCalStatus
 *
 * Purpose: To create an empty CalStatus sctructre
@@ -127,6 +608,7 @@ CalStatus InitializeCalStatus();
 *           and a pointer to the property desired to add (CalProp *).
 *
 * PostConditions: The CalComp's number of properties increases and and desired property is added to the CalComp. 
+*                 The CalComp has changed, so its text is set to NULL (see CalComp).
 ********************************************************************************************/
 void insertProperty(CalComp **const pcomp, CalProp *toAdd);
 
@@ -149,7 +631,11 @@ void insertParam(CalProp *prop,CalParam *toAdd);
 *           CalComp wished to be inserted (CalComp*)
 *
 *PostConditions: The CalComp's flexible array size has been increased and the CalComp has been added to it
-*                as desired
+*                as desired. When the block has no room left (malloc_usable_size) the array is
+*                reallocated to a capacity that doubles (from 4 slots), so the CalComp may be any
+*                malloced one, including one allocated to fit its subcomponents, but not one read
+*                into an arena (CAL_ARENA).
+*                The CalComp has changed, so its text is set to NULL (see CalComp).
 ********************************************************************************************/
 void expandCalComp(CalComp **const toExpand, CalComp *toAdd);
 
@@ -161,7 +647,7 @@ void expandCalComp(CalComp **const toExpand, CalComp *toAdd);
 *           value wished to be inserted (char*)
 *
 *PostConditions: The CalParam's flexible array size has been increased and the value has been added to it
-*                as desired
+*                as desired. The array grows as with expandCalComp.
 ********************************************************************************************/
 void expandCalParam(CalParam **const toExpand, char *toAdd);
 
@@ -14,7 +14,6 @@ from tkinter import messagebox
 from tkinter import filedialog
 from tkinter import ttk
 
-import subprocess
 import os
 import sys
 import getpass
@@ -208,56 +207,30 @@ def fileCombine(fvpTree):
 
 
     if (len(combine) != 0):
-        #write temp file
-        result = cal.writeFile("./tempIn.temp",fvpTree.cal.pointer, fvpTree.cal.visibleComps)
-
-        #Print some error if intermediate writefile fails
-        if (result[:2] != "OK"):
-            writeToTextLog(textLog,"&SEP&")
-            writeToTextLog(textLog,"Unexpected Combine Error.\n")
-            writeToTextLog(textLog,'Combine "'+str(curFileName)+'" and "'+str(combineName)+'" failed.\n')
-            return()
-
-
-        args = ["./caltool","-combine",str(combine)]
-        inFile = open("./tempIn.temp","r")
-        outFile = open("./tempOut.temp","w")
-        errFile = open("./tempErr.temp","w")
-
-        #combine into new ics 'tempOut.temp'
-        Pcaltool = subprocess.Popen(args,stdin = inFile, stdout = outFile ,stderr = errFile)
-        Pcaltool.wait()
-        inFile.close()
-        outFile.close()
-        errFile.close()
-
-        #Read In errors from actual combine
-        errFile = open("tempErr.temp","r")
-        errors = errFile.read()
-        errFile.close()
+        #combine into a new calendar in memory
+        combCalData = []
+        status = cal.calCombine(fvpTree.cal.pointer,fvpTree.cal.visibleComps,str(combine),combCalData)
 
         #on no errors
-        if (len(errors) == 0):
+        if (status == "OK"):
+
+            #display the new CalComp
+            combCal = calFile(combCalData[0],combCalData[1],combCalData[2])
+            fvpTree.clear()
+            fvpTree.addCal(combCal)
 
-            #Read from tempOut.temp to store new CalComp
-            status = readAndDisplayComp("./tempOut.temp",fvpTree)
-            if (status == "OK"):
-                writeToTextLog(textLog,"&SEP&")
-                writeToTextLog(textLog,'Combine "'+str(curFileName)+'" and "'+str(combineName)+'" successful!\n')
-                updateTitlebar("xcal- *"+curFileName)
-                unsavedChanges = 1
+            writeToTextLog(textLog,"&SEP&")
+            writeToTextLog(textLog,'Combine "'+str(curFileName)+'" and "'+str(combineName)+'" successful!\n')
+            updateTitlebar("xcal- *"+curFileName)
+            unsavedChanges = 1
 
         #write Errors
         else:
             writeToTextLog(textLog,"&SEP&")
-            writeToTextLog(textLog,errors)
+            writeToTextLog(textLog,status+"\n")
             writeToTextLog(textLog,'Error in "'+str(combineName)+'":\n')
             writeToTextLog(textLog,'Combine "'+str(curFileName)+'" and "'+str(combineName)+'" failed.\n')
 
-        os.remove("tempIn.temp")
-        os.remove("tempOut.temp")
-        os.remove("tempErr.temp")
-
 #####################################################################
 # fileFilter
 #
@@ -326,67 +299,40 @@ def fileFilter(fvpTree):
     #On Confirm
     if (confirmFilter.get() == 1):
         filtCalData = []
-        filtIndexes = []
 
-        #Run caltool with  'date to' and 'date from' args
+        #Filter with 'date to' and 'date from' args
         dateFromstr = str(dateFrom.get())
         dateTostr = str(dateTo.get())
         kindCode = str(filterType.get())
-        args = ["./caltool","-filter",kindCode]
 
-        if (not dateFromstr.isspace() and len(dateFromstr) != 0):
-            args.append("from")
-            args.append(dateFromstr)
+        if (dateFromstr.isspace()):
+            dateFromstr = ""
 
-        if (not dateTostr.isspace() and len(dateTostr) != 0):
-            args.append("to")
-            args.append(dateTostr)
+        if (dateTostr.isspace()):
+            dateTostr = ""
 
-        inFile = open(curFilePath,"r")
-        outFile = open("./tempOut.temp","w")
-        errFile = open("./tempErr.temp","w")
-
-        Pcaltool = subprocess.Popen(args,stdin = inFile, stdout = outFile ,stderr = errFile)
-        Pcaltool.wait()
-        inFile.close()
-        outFile.close()
-        errFile.close()
-
-        # read temp file for errors
-        errFile = open("./tempErr.temp","r")
-        errors = errFile.read()
-        errFile.close()
+        #filter into a new calendar in memory
+        status = cal.calFilter(fvpTree.cal.pointer,fvpTree.cal.visibleComps,kindCode,dateFromstr,dateTostr,filtCalData)
 
         #If there are no errors
-        if (len(errors) == 0):
-
-            #read file and collect inforamtion in a list
-            status = "OK"
-            status = cal.readFile("./tempOut.temp",filtCalData)
+        if (status == "OK"):
 
-            #if there are no errors in reading
-            if (status == "OK"):
-                
-                #create new calFile object
-                filtCal = calFile(filtCalData[0],filtCalData[1],filtCalData[2])
+            #create new calFile object
+            filtCal = calFile(filtCalData[0],filtCalData[1],filtCalData[2])
 
 
-                #write Success
-                writeToTextLog(textLog,"&SEP&")
-                writeToTextLog(textLog,"Filter \""+ curFileName+"\""+ " successful!\n")
+            #write Success
+            writeToTextLog(textLog,"&SEP&")
+            writeToTextLog(textLog,"Filter \""+ curFileName+"\""+ " successful!\n")
 
-                #add the new items to tree
-                fvpTree.clear()
-                showSelBut.configure(state=DISABLED)
+            #add the new items to tree
+            fvpTree.clear()
+            showSelBut.configure(state=DISABLED)
 
-                fvpTree.addCal(filtCal)
-                updateTitlebar("xcal- *"+curFileName)
-                unsavedChanges = 1;
+            fvpTree.addCal(filtCal)
+            updateTitlebar("xcal- *"+curFileName)
+            unsavedChanges = 1;
 
-            #output error to textLog
-            else:
-                status = "Failed to filter \""+curFileName+"\"\n" + status
-                writeToTextLog(textLog,status)
         #output error to text log
         else:
             if (kindCode == "e"):
@@ -394,11 +340,12 @@ def fileFilter(fvpTree):
             else:
                 kind = "to-dos"
             writeToTextLog(textLog,"&SEP&")
-            writeToTextLog(textLog,"No "+kind+" found\n")
+            #nothing found, or a date that could not be read
+            if (status.startswith("Error")):
+                writeToTextLog(textLog,"No "+kind+" found\n")
+            else:
+                writeToTextLog(textLog,status)
             writeToTextLog(textLog,"Error filtering "+kind+":\n")
-        
-        os.remove("tempOut.temp")
-        os.remove("tempErr.temp")
 
 #####################################################################
 # fileExit
@@ -1186,50 +1133,21 @@ def clearTextLog(textLog):
 #####################################################################
 # callCalInfo
 #
-# Purpose:    To Call 'calTool -info' on specific subcomponents
+# Purpose:    To show what 'caltool -info' gives for specific subcomponents
 #
 # Arguments:  comp         - The address of an allocated CalComp (int)
-#             writeIndexes - A list indicating the subcomponents to have in the Calendar when
-#                           'caltool' is called
+#             writeIndexes - A list indicating the subcomponents to describe
 #             
 ##########################
 def callCalInfo(comp, writeIndexes):
 
-    info = ""
-    err = ""
+    info, errors = cal.calInfo(comp,writeIndexes)
 
-    result = cal.writeFile("tempIn.temp",comp,writeIndexes)
-    if (result[0:2] == "OK"):
-    
-        inFile = open("./tempIn.temp","r")
-        outFile = open("./tempOut.temp","w")
-        errFile = open("./tempErr.temp","w")
-        args = ["./caltool","-info"]
-        Pcaltool = subprocess.Popen(args,stdin = inFile, stdout = outFile ,stderr = errFile)
-
-        #wait for the process to end
-        Pcaltool.wait()
-        inFile.close()
-        outFile.close()
-        errFile.close()
-
-
-        errFile = open("./tempErr.temp","r")
-        errors = errFile.read()
-        errFile.close()
-
-        writeToTextLog(textLog,"&SEP&")
-        if (len(errors) == 0):
-            inFile = open("./tempOut.temp","r")
-            info = inFile.read()
-            inFile.close()
-            writeToTextLog(textLog,info)
-        else:
-            writeToTextLog(textLog,errors)
-
-        os.remove("tempIn.temp")
-        os.remove("tempOut.temp")
-        os.remove("tempErr.temp")
+    writeToTextLog(textLog,"&SEP&")
+    if (len(errors) == 0):
+        writeToTextLog(textLog,info)
+    else:
+        writeToTextLog(textLog,errors)
 
 #####################################################################
 # getSelectedIndex
@@ -1269,12 +1187,8 @@ def showSelected(fvpTree):
 
     itemIndexes[itemIndex] = 1;
 
-    cal.writeFile("./tempOut.temp",fvpTree.cal.pointer,itemIndexes)
-    fh = open("./tempOut.temp","r")
-    info = fh.read()
-    fh.close()
-    os.remove("./tempOut.temp")
-    info = info.split("\n")
+    info = cal.writeBuffer(fvpTree.cal.pointer,itemIndexes)
+    info = info.decode("utf-8","replace").split("\n")
 
     ignore = 0
     depth = -1
@@ -1308,45 +1222,15 @@ def extractKind(fvpTree,kind):
 
     global curFileName
 
-    result = cal.writeFile("tempIn.temp",fvpTree.cal.pointer,fvpTree.cal.visibleComps)
-    if (result[0:2] == "OK"):  
+    if (not(kind == "e" or kind == "x")):
+        writeToTextLog(textLog,"BAD KIND\n")
 
-        inFile = open("./tempIn.temp","r")
-        outFile = open("./tempOut.temp","w")
-        errFile = open("./tempErr.temp","w")
-
-        if (not(kind == "e" or kind == "x")):
-            writeToTextLog(textLog,"BAD KIND\n")
-
-        if (kind == "e"):
-            info = "Extract Events - "+str(curFileName)+":\n\n"
-        else:
-            info = "Extract X-Props - "+str(curFileName)+":\n\n"
-
-
-        args = ["./caltool","-extract",kind]
-
-        Pcaltool = subprocess.Popen(args,stdin = inFile, stdout = outFile ,stderr = errFile)
-        Pcaltool.wait()
-    
-
-        inFile.close()
-        outFile.close()
-        errFile.close()
-       
-
-        inFile = open("./tempOut.temp","r")
-        extractOut = inFile.read()
-        inFile.close()
-        errFile = open("./tempErr.temp","r")
-        errors = errFile.read()
-        errFile.close()
-
-        #remove Files
-        os.remove("tempIn.temp")
-        os.remove("tempOut.temp")
-        os.remove("tempErr.temp")
+    if (kind == "e"):
+        info = "Extract Events - "+str(curFileName)+":\n\n"
+    else:
+        info = "Extract X-Props - "+str(curFileName)+":\n\n"
 
+    extractOut, errors = cal.calExtract(fvpTree.cal.pointer,fvpTree.cal.visibleComps,kind)
 
 
     writeToTextLog(textLog,"&SEP&")